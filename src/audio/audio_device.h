@@ -24,6 +24,19 @@ struct IAllocator;
 class Path;
 
 
+// source of s16 interleaved frames decoded on demand by the device
+struct AudioStream
+{
+	virtual ~AudioStream() {}
+	// returns less than requested frames only at the end of the stream
+	virtual int read(i16* out, int frames) = 0;
+	virtual void seek(u32 frame) = 0;
+	virtual int getChannels() const = 0;
+	virtual int getSampleRate() const = 0;
+	virtual u32 getFramesCount() const = 0;
+};
+
+
 class LUMIX_AUDIO_API AudioDevice
 {
 public:
@@ -45,6 +58,8 @@ public:
 	static void destroy(AudioDevice& device);
 
 	virtual BufferHandle createBuffer(const void* data, int size_bytes, int channels, int sample_rate, int flags) = 0;
+	// stream must stay alive until the buffer is stopped
+	virtual BufferHandle createStreamBuffer(AudioStream& stream, int flags) = 0;
 	virtual void setEcho(BufferHandle handle,
 		float wet_dry_mix,
 		float feedback,
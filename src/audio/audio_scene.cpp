@@ -7,12 +7,15 @@
 #include "engine/crc32.h"
 #include "engine/engine.h"
 #include "engine/allocator.h"
+#include "engine/hash_map.h"
 #include "engine/lua_wrapper.h"
 #include "engine/math.h"
+#include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
 #include "engine/universe/universe.h"
+#include <math.h>
 
 namespace Lumix
 {
@@ -47,17 +50,80 @@ struct AmbientSound
 };
 
 
+// Logical sound, it holds a device buffer only while it is among the most important
+// audible sounds, otherwise it is virtual and just keeps track of its playback position.
 struct PlayingSound
 {
+	struct Echo
+	{
+		bool enabled;
+		float wet_dry_mix;
+		float feedback;
+		float left_delay;
+		float right_delay;
+	};
+
+	// INVALID_BUFFER_HANDLE if the sound is virtual
 	AudioDevice::BufferHandle buffer_id;
 	EntityPtr entity;
+	// nullptr if the slot is free
 	AudioScene::ClipInfo* clip;
+	// only for streamed clips, created by stream_clip
+	AudioStream* stream;
+	Clip* stream_clip;
 	bool is_3d;
+	int priority;
+	float volume;
+	float audibility;
+	// playback position in seconds, valid while virtual
+	float time;
+	// set from script, overrides echo zones
+	Echo echo;
+	// zones the sound is in, valid only for real 3d sounds
+	EntityPtr echo_zone;
+	EntityPtr chorus_zone;
+	DVec3 zones_check_pos;
+	u32 zones_version;
+};
+
+
+struct ZoneRef
+{
+	EntityRef entity;
+	bool is_chorus;
+};
+
+
+// zones overlapping a grid cell form a linked list
+struct ZoneCellEntry
+{
+	ZoneRef zone;
+	int next;
+};
+
+
+struct VoiceSortKey
+{
+	int index;
+	int priority;
+	float score;
 };
 
 
 struct AudioSceneImpl final : public AudioScene
 {
+	static const u32 DEFAULT_MAX_VOICES = 64;
+	static constexpr float MIN_DISTANCE = 2;
+	static constexpr float MAX_DISTANCE = 10000;
+	// quieter sounds never get a device buffer
+	static constexpr float MIN_AUDIBILITY = 0.001f;
+	static constexpr float REAL_VOICE_BIAS = 1.25f;
+	static constexpr double ZONE_CELL_SIZE = 32;
+	// zones overlapping more cells are not put in the grid, they are checked for every query
+	static const int MAX_ZONE_CELLS = 64;
+	// emitters moving less than this do not check zones
+	static constexpr double ZONE_CHECK_DISTANCE = 0.25;
+
 	AudioSceneImpl(AudioSystem& system, Universe& context, IAllocator& allocator)
 		: m_allocator(allocator)
 		, m_universe(context)
@@ -67,13 +133,15 @@ struct AudioSceneImpl final : public AudioScene
 		, m_ambient_sounds(allocator)
 		, m_echo_zones(allocator)
 		, m_chorus_zones(allocator)
+		, m_playing_sounds(allocator)
+		, m_voice_order(allocator)
+		, m_clip_map(allocator)
+		, m_zone_cells(allocator)
+		, m_zone_entries(allocator)
+		, m_large_zones(allocator)
 	{
 		m_listener.entity = INVALID_ENTITY;
-		for (auto& i : m_playing_sounds)
-		{
-			i.entity = INVALID_ENTITY;
-			i.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
-		}
+		m_universe.entityTransformed().bind<&AudioSceneImpl::onEntityMoved>(this);
 		context.registerComponentType(LISTENER_TYPE
 			, this
 			, &AudioSceneImpl::createListener
@@ -93,20 +161,182 @@ struct AudioSceneImpl final : public AudioScene
 	}
 
 
+	~AudioSceneImpl()
+	{
+		m_universe.entityTransformed().unbind<&AudioSceneImpl::onEntityMoved>(this);
+	}
+
+
 	int getVersion() const override { return (int)AudioSceneVersion::LAST; }
 
 
+	void onEntityMoved(EntityRef entity)
+	{
+		if (m_zones_dirty) return;
+		if (m_echo_zones.find(entity) >= 0 || m_chorus_zones.find(entity) >= 0) m_zones_dirty = true;
+	}
+
+
+	static i32 toZoneCell(double coord) { return (i32)floor(coord / ZONE_CELL_SIZE); }
+
+
+	static u64 getZoneCellKey(i32 x, i32 y, i32 z)
+	{
+		return (u64(x & 0x1FFFFF) << 42) | (u64(y & 0x1FFFFF) << 21) | u64(z & 0x1FFFFF);
+	}
+
+
+	void addZoneToGrid(EntityRef entity, float radius, bool is_chorus)
+	{
+		const DVec3 pos = m_universe.getPosition(entity);
+		const i32 x0 = toZoneCell(pos.x - radius), x1 = toZoneCell(pos.x + radius);
+		const i32 y0 = toZoneCell(pos.y - radius), y1 = toZoneCell(pos.y + radius);
+		const i32 z0 = toZoneCell(pos.z - radius), z1 = toZoneCell(pos.z + radius);
+		const i64 cells_count = i64(x1 - x0 + 1) * (y1 - y0 + 1) * (z1 - z0 + 1);
+		if (cells_count > MAX_ZONE_CELLS)
+		{
+			m_large_zones.push({entity, is_chorus});
+			return;
+		}
+
+		for (i32 z = z0; z <= z1; ++z)
+		{
+			for (i32 y = y0; y <= y1; ++y)
+			{
+				for (i32 x = x0; x <= x1; ++x)
+				{
+					const u64 key = getZoneCellKey(x, y, z);
+					ZoneCellEntry& entry = m_zone_entries.emplace();
+					entry.zone = {entity, is_chorus};
+					entry.next = -1;
+					const int idx = m_zone_entries.size() - 1;
+					auto iter = m_zone_cells.find(key);
+					if (iter.isValid())
+					{
+						entry.next = iter.value();
+						iter.value() = idx;
+					}
+					else
+					{
+						m_zone_cells.insert(key, idx);
+					}
+				}
+			}
+		}
+	}
+
+
+	void rebuildZoneGrid()
+	{
+		PROFILE_FUNCTION();
+		m_zone_cells.clear();
+		m_zone_entries.clear();
+		m_large_zones.clear();
+		for (const EchoZone& zone : m_echo_zones) addZoneToGrid(zone.entity, zone.radius, false);
+		for (const ChorusZone& zone : m_chorus_zones) addZoneToGrid(zone.entity, zone.radius, true);
+		++m_zones_version;
+		m_zones_dirty = false;
+	}
+
+
+	// returns true if pos is inside and zone is the first one of its kind found
+	bool checkZone(const ZoneRef& zone, const DVec3& pos, EntityPtr* echo_zone, EntityPtr* chorus_zone)
+	{
+		EntityPtr& result = zone.is_chorus ? *chorus_zone : *echo_zone;
+		if (result.isValid()) return false;
+
+		const float radius = zone.is_chorus ? m_chorus_zones[zone.entity].radius : m_echo_zones[zone.entity].radius;
+		const double dist2 = (pos - m_universe.getPosition(zone.entity)).squaredLength();
+		if (dist2 > radius * radius) return false;
+
+		result = zone.entity;
+		return true;
+	}
+
+
+	void queryZones(const DVec3& pos, EntityPtr* echo_zone, EntityPtr* chorus_zone)
+	{
+		if (m_zones_dirty) rebuildZoneGrid();
+
+		*echo_zone = INVALID_ENTITY;
+		*chorus_zone = INVALID_ENTITY;
+		auto iter = m_zone_cells.find(getZoneCellKey(toZoneCell(pos.x), toZoneCell(pos.y), toZoneCell(pos.z)));
+		if (iter.isValid())
+		{
+			for (int i = iter.value(); i >= 0; i = m_zone_entries[i].next)
+			{
+				checkZone(m_zone_entries[i].zone, pos, echo_zone, chorus_zone);
+			}
+		}
+		for (const ZoneRef& zone : m_large_zones) checkZone(zone, pos, echo_zone, chorus_zone);
+	}
+
+
+	// applies zone effects when the sound enters or leaves a zone
+	void updateSoundZones(PlayingSound& sound, const DVec3& pos, bool force)
+	{
+		ASSERT(isReal(sound));
+		if (!force && sound.zones_version == m_zones_version
+			&& (pos - sound.zones_check_pos).squaredLength() < ZONE_CHECK_DISTANCE * ZONE_CHECK_DISTANCE)
+		{
+			return;
+		}
+
+		EntityPtr echo_zone, chorus_zone;
+		queryZones(pos, &echo_zone, &chorus_zone);
+		sound.zones_check_pos = pos;
+		sound.zones_version = m_zones_version;
+
+		// echo set from script wins
+		if (!sound.echo.enabled && (force || echo_zone != sound.echo_zone))
+		{
+			if (echo_zone.isValid())
+			{
+				const EchoZone& zone = m_echo_zones[(EntityRef)echo_zone];
+				const double r2 = zone.radius * zone.radius;
+				const float w = r2 > 0 ? float((pos - m_universe.getPosition(zone.entity)).squaredLength() / r2) : 0;
+				m_device.setEcho(sound.buffer_id, 1, 1 - w, zone.delay, zone.delay);
+			}
+			else if (sound.echo_zone.isValid())
+			{
+				m_device.setEcho(sound.buffer_id, 0, 0, 1, 1);
+			}
+		}
+		if (force || chorus_zone != sound.chorus_zone)
+		{
+			if (chorus_zone.isValid())
+			{
+				const ChorusZone& zone = m_chorus_zones[(EntityRef)chorus_zone];
+				m_device.setChorus(sound.buffer_id, 1, 1, 0, 1, zone.delay, 0);
+			}
+			else if (sound.chorus_zone.isValid())
+			{
+				m_device.setChorus(sound.buffer_id, 0, 0, 0, 0, 0, 0);
+			}
+		}
+		sound.echo_zone = echo_zone;
+		sound.chorus_zone = chorus_zone;
+	}
+
+
 	void clear() override
 	{
+		for (PlayingSound& sound : m_playing_sounds)
+		{
+			if (sound.clip) stopSound(sound);
+		}
+		m_playing_sounds.clear();
 		for (auto* clip : m_clips)
 		{
 			clip->clip->getResourceManager().unload(*clip->clip);
 			LUMIX_DELETE(m_allocator, clip);
 		}
 		m_clips.clear();
+		m_clip_map.clear();
 		m_ambient_sounds.clear();
 		m_echo_zones.clear();
 		m_chorus_zones.clear();
+		m_zones_dirty = true;
 	}
 
 
@@ -118,12 +348,26 @@ struct AudioSceneImpl final : public AudioScene
 		return -1;
 	}
 
+
+	// scripts playing a sound often can hash the name once with getClipHash
+	int playSoundHashed(EntityRef entity, u32 clip_name_hash, bool is_3d)
+	{
+		auto* clip = getClipInfo(clip_name_hash);
+		if (clip) return play(entity, clip, is_3d);
+
+		return -1;
+	}
+
+
+	u32 getClipHash(const char* clip_name) { return crc32(clip_name); }
+
+
 	void updateAnimationEvents()
 	{
 		if (!m_animation_scene) return;
 		
 		InputMemoryStream blob(m_animation_scene->getEventStream());
-		u32 sound_type = crc32("sound");
+		static const u32 sound_type = crc32("sound");
 		while (blob.getPosition() < blob.size())
 		{
 			u32 type;
@@ -136,7 +380,7 @@ struct AudioSceneImpl final : public AudioScene
 			{
 				SoundAnimationEvent event;
 				blob.read(event);
-				ClipInfo* clip = getClipInfo(event.clip);
+				ClipInfo* clip = getClipInfo(event.clip_name_hash);
 				if (clip)
 				{
 					play(entity, clip, event.is_3d);
@@ -149,6 +393,97 @@ struct AudioSceneImpl final : public AudioScene
 		}
 	}
 
+	// same distance model as the devices
+	float computeAudibility(const PlayingSound& sound) const
+	{
+		if (!sound.is_3d || !sound.entity.isValid()) return sound.volume;
+
+		const float dist = (float)(m_universe.getPosition((EntityRef)sound.entity) - m_listener_position).length();
+		return sound.volume * MIN_DISTANCE / clamp(dist, MIN_DISTANCE, MAX_DISTANCE);
+	}
+
+
+	// returns false if a non-looped virtual sound reached its end
+	static bool advanceVirtualSound(PlayingSound& sound, float time_delta)
+	{
+		const float length = sound.clip->clip->getLengthSeconds();
+		sound.time += time_delta;
+		if (sound.time < length) return true;
+		if (!sound.clip->looped || length <= 0) return false;
+		sound.time = fmodf(sound.time, length);
+		return true;
+	}
+
+
+	void updateVoices(float time_delta)
+	{
+		PROFILE_FUNCTION();
+		m_voice_order.clear();
+		for (int i = 0, c = m_playing_sounds.size(); i < c; ++i)
+		{
+			PlayingSound& sound = m_playing_sounds[i];
+			if (!sound.clip) continue;
+
+			if (isReal(sound))
+			{
+				if (!sound.clip->looped && m_device.isEnd(sound.buffer_id))
+				{
+					stopSound(sound);
+					continue;
+				}
+				if (sound.is_3d && sound.entity.isValid())
+				{
+					const DVec3 pos = m_universe.getPosition((EntityRef)sound.entity);
+					m_device.setSourcePosition(sound.buffer_id, pos);
+					updateSoundZones(sound, pos, false);
+				}
+			}
+			else if (!advanceVirtualSound(sound, time_delta))
+			{
+				stopSound(sound);
+				continue;
+			}
+
+			sound.audibility = computeAudibility(sound);
+			if (sound.audibility < MIN_AUDIBILITY)
+			{
+				virtualizeSound(sound);
+				continue;
+			}
+
+			VoiceSortKey& key = m_voice_order.emplace();
+			key.index = i;
+			key.priority = sound.priority;
+			// real voices are a bit preferred, so voices near the cut do not swap every frame
+			key.score = isReal(sound) ? sound.audibility * REAL_VOICE_BIAS : sound.audibility;
+		}
+
+		if (m_voice_order.empty()) return;
+
+		qsort(m_voice_order.begin(), m_voice_order.size(), sizeof(m_voice_order[0]), [](const void* a, const void* b) -> int {
+			const VoiceSortKey* ka = (const VoiceSortKey*)a;
+			const VoiceSortKey* kb = (const VoiceSortKey*)b;
+			if (ka->priority != kb->priority) return ka->priority > kb->priority ? -1 : 1;
+			if (ka->score != kb->score) return ka->score > kb->score ? -1 : 1;
+			return ka->index - kb->index;
+		});
+
+		// release buffers first, so there are free ones for the voices becoming real
+		const int real_count = minimum(m_voice_order.size(), (int)m_max_voices);
+		for (int i = real_count, c = m_voice_order.size(); i < c; ++i)
+		{
+			virtualizeSound(m_playing_sounds[m_voice_order[i].index]);
+		}
+		for (int i = 0; i < real_count; ++i)
+		{
+			PlayingSound& sound = m_playing_sounds[m_voice_order[i].index];
+			if (!isReal(sound)) realizeSound(sound);
+		}
+		Profiler::pushInt("Real voices", m_real_voices_count);
+		Profiler::pushInt("Virtual voices", m_voice_order.size() - m_real_voices_count);
+	}
+
+
 	void update(float time_delta, bool paused) override
 	{
 		if (m_listener.entity.isValid())
@@ -156,30 +491,14 @@ struct AudioSceneImpl final : public AudioScene
 			const EntityRef listener = (EntityRef) m_listener.entity;
 			const DVec3 pos = m_universe.getPosition(listener);
 			m_device.setListenerPosition(pos);
+			m_listener_position = pos;
 			const Matrix orientation = m_universe.getRotation(listener).toMatrix();
 			const Vec3 front = orientation.getZVector();
 			const Vec3 up = orientation.getYVector();
 			m_device.setListenerOrientation(front.x, front.y, front.z, up.x, up.y, up.z);
 		}
 
-		for (PlayingSound & sound : m_playing_sounds)
-		{
-			if (sound.buffer_id == AudioDevice::INVALID_BUFFER_HANDLE) continue;
-			if (!sound.entity.isValid()) continue;
-
-			if (sound.is_3d)
-			{
-				auto pos = m_universe.getPosition((EntityRef)sound.entity);
-				m_device.setSourcePosition(sound.buffer_id, pos);
-			}
-
-			auto* clip_info = sound.clip;
-			if (!clip_info->looped && m_device.isEnd(sound.buffer_id))
-			{
-				m_device.stop(sound.buffer_id);
-				sound.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
-			}
-		}
+		updateVoices(time_delta);
 		m_device.update(time_delta);
 
 		updateAnimationEvents();
@@ -211,13 +530,9 @@ struct AudioSceneImpl final : public AudioScene
 	void stopGame() override
 	{
 		m_animation_scene = nullptr;
-		for (auto& i : m_playing_sounds)
+		for (PlayingSound& sound : m_playing_sounds)
 		{
-			if (i.buffer_id != AudioDevice::INVALID_BUFFER_HANDLE)
-			{
-				m_device.stop(i.buffer_id);
-				i.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
-			}
+			if (sound.clip) stopSound(sound);
 		}
 
 		for (AmbientSound& sound : m_ambient_sounds)
@@ -274,6 +589,7 @@ struct AudioSceneImpl final : public AudioScene
 		zone.entity = entity;
 		zone.delay = 500.0f;
 		zone.radius = 10;
+		m_zones_dirty = true;
 		m_universe.onComponentCreated(entity, ECHO_ZONE_TYPE, this);
 	}
 
@@ -282,6 +598,7 @@ struct AudioSceneImpl final : public AudioScene
 	{
 		int idx = m_echo_zones.find(entity);
 		m_echo_zones.eraseAt(idx);
+		m_zones_dirty = true;
 		m_universe.onComponentDestroyed(entity, ECHO_ZONE_TYPE, this);
 	}
 
@@ -292,6 +609,19 @@ struct AudioSceneImpl final : public AudioScene
 	}
 
 
+	float getEchoZoneRadius(EntityRef entity) override
+	{
+		return m_echo_zones[entity].radius;
+	}
+
+
+	void setEchoZoneRadius(EntityRef entity, float radius) override
+	{
+		m_echo_zones[entity].radius = radius;
+		m_zones_dirty = true;
+	}
+
+
 	void createChorusZone(EntityRef entity)
 	{
 		ChorusZone& zone = m_chorus_zones.insert(entity);
@@ -303,6 +633,7 @@ struct AudioSceneImpl final : public AudioScene
 		zone.frequency = 1;
 		zone.phase = 0;
 		zone.wet_dry_mix = 0.5f;
+		m_zones_dirty = true;
 		m_universe.onComponentCreated(entity, CHORUS_ZONE_TYPE, this);
 	}
 
@@ -313,10 +644,24 @@ struct AudioSceneImpl final : public AudioScene
 	}
 
 
+	float getChorusZoneRadius(EntityRef entity) override
+	{
+		return m_chorus_zones[entity].radius;
+	}
+
+
+	void setChorusZoneRadius(EntityRef entity, float radius) override
+	{
+		m_chorus_zones[entity].radius = radius;
+		m_zones_dirty = true;
+	}
+
+
 	void destroyChorusZone(EntityRef entity)
 	{
 		int idx = m_chorus_zones.find(entity);
 		m_chorus_zones.eraseAt(idx);
+		m_zones_dirty = true;
 		m_universe.onComponentDestroyed(entity, CHORUS_ZONE_TYPE, this);
 	}
 
@@ -409,6 +754,7 @@ struct AudioSceneImpl final : public AudioScene
 			serializer.read(clip->looped);
 			serializer.readString(Span(clip->name));
 			clip->name_hash = crc32(clip->name);
+			addToClipMap(clip);
 			char path[MAX_PATH_LENGTH];
 			serializer.readString(Span(path));
 
@@ -449,6 +795,7 @@ struct AudioSceneImpl final : public AudioScene
 			m_chorus_zones.insert(zone.entity, zone);
 			m_universe.onComponentCreated(zone.entity, CHORUS_ZONE_TYPE, this);
 		}
+		m_zones_dirty = true;
 	}
 
 
@@ -467,18 +814,22 @@ struct AudioSceneImpl final : public AudioScene
 		clip->looped = false;
 		clip->volume = 1;
 		m_clips.push(clip);
+		addToClipMap(clip);
+	}
+
+
+	// the first clip with a name wins, same as it would in a linear search
+	void addToClipMap(ClipInfo* clip)
+	{
+		if (!m_clip_map.find(clip->name_hash).isValid()) m_clip_map.insert(clip->name_hash, clip);
 	}
 
 
 	void removeClip(ClipInfo* info) override
 	{
-		for (auto& i : m_playing_sounds)
+		for (PlayingSound& sound : m_playing_sounds)
 		{
-			if (i.clip == info && i.buffer_id != AudioDevice::INVALID_BUFFER_HANDLE)
-			{
-				m_device.stop(i.buffer_id);
-				i.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
-			}
+			if (sound.clip == info) stopSound(sound);
 		}
 
 		for (AmbientSound& sound : m_ambient_sounds)
@@ -495,31 +846,56 @@ struct AudioSceneImpl final : public AudioScene
 		{
 			clip->getResourceManager().unload(*clip);
 		}
+		const u32 name_hash = info->name_hash;
+		auto iter = m_clip_map.find(name_hash);
+		if (iter.isValid() && iter.value() == info) m_clip_map.erase(iter);
 		LUMIX_DELETE(m_allocator, info);
 		m_clips.eraseItem(info);
+		remapClipName(name_hash);
 	}
 
 
-	ClipInfo* getClipInfo(const char* name) override
+	// after the clip mapped to name_hash was removed or renamed, maps the next clip with the same name
+	void remapClipName(u32 name_hash)
 	{
-		auto hash = crc32(name);
-		for (auto* i : m_clips)
+		for (ClipInfo* clip : m_clips)
 		{
-			if (i->name_hash == hash) return i;
+			if (clip && clip->name_hash == name_hash)
+			{
+				addToClipMap(clip);
+				break;
+			}
 		}
-
-		return nullptr;
 	}
 
 
-	ClipInfo* getClipInfo(u32 hash) override
+	void setClipName(ClipInfo& clip, const char* name) override
 	{
-		for (auto* i : m_clips)
+		const u32 old_hash = clip.name_hash;
+		copyString(clip.name, name);
+		clip.name_hash = crc32(clip.name);
+		if (clip.name_hash == old_hash) return;
+
+		auto iter = m_clip_map.find(old_hash);
+		if (iter.isValid() && iter.value() == &clip)
 		{
-			if (i->name_hash == hash) return i;
+			m_clip_map.erase(iter);
+			remapClipName(old_hash);
 		}
+		addToClipMap(&clip);
+	}
+
 
-		return nullptr;
+	ClipInfo* getClipInfo(const char* name) override
+	{
+		return getClipInfo(crc32(name));
+	}
+
+
+	ClipInfo* getClipInfo(u32 hash) override
+	{
+		auto iter = m_clip_map.find(hash);
+		return iter.isValid() ? iter.value() : nullptr;
 	}
 
 
@@ -542,64 +918,110 @@ struct AudioSceneImpl final : public AudioScene
 	}
 
 
-	SoundHandle play(EntityRef entity, ClipInfo* clip_info, bool is_3d) override
+	static bool isReal(const PlayingSound& sound) { return sound.buffer_id != AudioDevice::INVALID_BUFFER_HANDLE; }
+
+
+	// gives the sound a device buffer and resumes it where the virtual sound is
+	bool realizeSound(PlayingSound& sound)
 	{
-		for (PlayingSound& sound : m_playing_sounds)
+		ASSERT(!isReal(sound));
+		Clip* clip = sound.clip->clip;
+		if (!clip->isReady()) return false;
+
+		const int flags = sound.is_3d ? (int)AudioDevice::BufferFlags::IS3D : 0;
+		AudioStream* stream = nullptr;
+		AudioDevice::BufferHandle buffer;
+		if (clip->isStreamed())
 		{
-			if (sound.buffer_id == AudioDevice::INVALID_BUFFER_HANDLE)
-			{
-				auto* clip = clip_info->clip;
-				if (!clip->isReady()) return INVALID_SOUND_HANDLE;
+			stream = clip->createStream();
+			if (!stream) return false;
+			buffer = m_device.createStreamBuffer(*stream, flags);
+			if (buffer == AudioDevice::INVALID_BUFFER_HANDLE) clip->destroyStream(*stream);
+		}
+		else
+		{
+			buffer = m_device.createBuffer(
+				clip->getData(), clip->getSize(), clip->getChannels(), clip->getSampleRate(), flags);
+		}
+		if (buffer == AudioDevice::INVALID_BUFFER_HANDLE) return false;
+
+		if (sound.time > 0) m_device.setCurrentTime(buffer, sound.time);
+		m_device.setVolume(buffer, sound.volume);
+
+		const DVec3 pos = sound.entity.isValid() ? m_universe.getPosition((EntityRef)sound.entity) : m_listener_position;
+		m_device.setSourcePosition(buffer, pos);
+
+		sound.buffer_id = buffer;
+		sound.stream = stream;
+		sound.stream_clip = clip;
+		sound.echo_zone = INVALID_ENTITY;
+		sound.chorus_zone = INVALID_ENTITY;
+		updateSoundZones(sound, pos, true);
+		const PlayingSound::Echo& echo = sound.echo;
+		if (echo.enabled) m_device.setEcho(buffer, echo.wet_dry_mix, echo.feedback, echo.left_delay, echo.right_delay);
+		m_device.play(buffer, sound.clip->looped);
+		++m_real_voices_count;
+		return true;
+	}
 
-				int flags = is_3d ? (int)AudioDevice::BufferFlags::IS3D : 0;
-				auto buffer = m_device.createBuffer(
-					clip->getData(), clip->getSize(), clip->getChannels(), clip->getSampleRate(), flags);
-				if (buffer == AudioDevice::INVALID_BUFFER_HANDLE) return INVALID_SOUND_HANDLE;
-				m_device.play(buffer, clip_info->looped);
-				m_device.setVolume(buffer, clip_info->volume);
 
-				const DVec3 pos = m_universe.getPosition(entity);
-				m_device.setSourcePosition(buffer, pos);
+	void releaseBuffer(PlayingSound& sound)
+	{
+		m_device.stop(sound.buffer_id);
+		sound.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
+		// device does not touch the stream once stopped
+		if (sound.stream) sound.stream_clip->destroyStream(*sound.stream);
+		sound.stream = nullptr;
+		--m_real_voices_count;
+	}
 
-				sound.is_3d = is_3d;
-				sound.buffer_id = buffer;
-				sound.entity = entity;
-				sound.clip = clip_info;
 
-				for (const EchoZone& zone : m_echo_zones)
-				{
-					const double dist2 = (pos - m_universe.getPosition(zone.entity)).squaredLength();
-					const double r2 = zone.radius * zone.radius;
-					if (dist2 > r2) continue;
+	void virtualizeSound(PlayingSound& sound)
+	{
+		if (!isReal(sound)) return;
+		sound.time = maximum(m_device.getCurrentTime(sound.buffer_id), 0.f);
+		releaseBuffer(sound);
+	}
 
-					const float w = float(dist2 / r2);
-					m_device.setEcho(buffer, 1, 1 - w, zone.delay, zone.delay);
-					break;
-				}
 
-				for (const ChorusZone& zone : m_chorus_zones)
-				{
-					const double dist2 = (pos - m_universe.getPosition(zone.entity)).squaredLength();
-					double r2 = zone.radius * zone.radius;
-					if (dist2 > r2) continue;
+	SoundHandle play(EntityRef entity, ClipInfo* clip_info, bool is_3d) override
+	{
+		if (!clip_info->clip->isReady()) return INVALID_SOUND_HANDLE;
 
-					m_device.setChorus(buffer, 1, 1, 0, 1, zone.delay, 0);
-					break;
-				}
+		int idx = 0;
+		while (idx < m_playing_sounds.size() && m_playing_sounds[idx].clip) ++idx;
+		if (idx == m_playing_sounds.size()) m_playing_sounds.emplace();
 
-				return SoundHandle(&sound - m_playing_sounds);
-			}
-		}
+		PlayingSound& sound = m_playing_sounds[idx];
+		sound.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
+		sound.entity = entity;
+		sound.clip = clip_info;
+		sound.stream = nullptr;
+		sound.stream_clip = nullptr;
+		sound.is_3d = is_3d;
+		sound.priority = 0;
+		sound.volume = clip_info->volume;
+		sound.time = 0;
+		sound.echo.enabled = false;
+		sound.audibility = computeAudibility(sound);
+
+		// start right away if there is a free voice, otherwise next update decides
+		if (m_real_voices_count < m_max_voices && sound.audibility >= MIN_AUDIBILITY) realizeSound(sound);
+		return idx;
+	}
 
-		return INVALID_SOUND_HANDLE;
+
+	void stopSound(PlayingSound& sound)
+	{
+		if (isReal(sound)) releaseBuffer(sound);
+		sound.clip = nullptr;
 	}
 
 
 	void stop(SoundHandle sound_id) override
 	{
-		ASSERT(sound_id >= 0 && sound_id < (int)lengthOf(m_playing_sounds));
-		m_device.stop(m_playing_sounds[sound_id].buffer_id);
-		m_playing_sounds[sound_id].buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
+		ASSERT(sound_id >= 0 && sound_id < m_playing_sounds.size());
+		stopSound(m_playing_sounds[sound_id]);
 	}
 
 
@@ -609,15 +1031,30 @@ struct AudioSceneImpl final : public AudioScene
 	void setVolume(SoundHandle sound_id, float volume) override
 	{
 		ASSERT(sound_id != AudioScene::INVALID_SOUND_HANDLE);
-		ASSERT(sound_id >= 0 && sound_id < (int)lengthOf(m_playing_sounds));
-		m_device.setVolume(m_playing_sounds[sound_id].buffer_id, volume);
+		ASSERT(sound_id >= 0 && sound_id < m_playing_sounds.size());
+		PlayingSound& sound = m_playing_sounds[sound_id];
+		sound.volume = volume;
+		if (isReal(sound)) m_device.setVolume(sound.buffer_id, volume);
 	}
 
 
+	void setPriority(SoundHandle sound_id, int priority) override
+	{
+		ASSERT(sound_id >= 0 && sound_id < m_playing_sounds.size());
+		m_playing_sounds[sound_id].priority = priority;
+	}
+
+
+	void setMaxVoices(u32 count) override { m_max_voices = minimum(count, (u32)AudioDevice::MAX_PLAYING_SOUNDS); }
+	u32 getMaxVoices() const override { return m_max_voices; }
+
+
 	void setEcho(SoundHandle sound_id, float wet_dry_mix, float feedback, float left_delay, float right_delay) override
 	{
-		ASSERT(sound_id >= 0 && sound_id < (int)lengthOf(m_playing_sounds));
-		m_device.setEcho(m_playing_sounds[sound_id].buffer_id, wet_dry_mix, feedback, left_delay, right_delay);
+		ASSERT(sound_id >= 0 && sound_id < m_playing_sounds.size());
+		PlayingSound& sound = m_playing_sounds[sound_id];
+		sound.echo = {true, wet_dry_mix, feedback, left_delay, right_delay};
+		if (isReal(sound)) m_device.setEcho(sound.buffer_id, wet_dry_mix, feedback, left_delay, right_delay);
 	}
 
 	Universe& getUniverse() override { return m_universe; }
@@ -632,7 +1069,20 @@ struct AudioSceneImpl final : public AudioScene
 	Universe& m_universe;
 	Array<ClipInfo*> m_clips;
 	AudioSystem& m_system;
-	PlayingSound m_playing_sounds[AudioDevice::MAX_PLAYING_SOUNDS];
+	// SoundHandle is an index, free slots have null clip
+	Array<PlayingSound> m_playing_sounds;
+	Array<VoiceSortKey> m_voice_order;
+	// name_hash -> clip
+	HashMap<u32, ClipInfo*, HashFuncDirect<u32>> m_clip_map;
+	// cell key -> first entry in m_zone_entries
+	HashMap<u64, int> m_zone_cells;
+	Array<ZoneCellEntry> m_zone_entries;
+	Array<ZoneRef> m_large_zones;
+	bool m_zones_dirty = true;
+	u32 m_zones_version = 0;
+	u32 m_max_voices = DEFAULT_MAX_VOICES;
+	u32 m_real_voices_count = 0;
+	DVec3 m_listener_position = {0, 0, 0};
 	AnimationScene* m_animation_scene = nullptr;
 };
 
@@ -661,8 +1111,12 @@ void AudioScene::registerLuaAPI(lua_State* L)
 
 	REGISTER_FUNCTION(setEcho);
 	REGISTER_FUNCTION(playSound);
+	REGISTER_FUNCTION(playSoundHashed);
+	REGISTER_FUNCTION(getClipHash);
 	REGISTER_FUNCTION(setVolume);
 	REGISTER_FUNCTION(setMasterVolume);
+	REGISTER_FUNCTION(setPriority);
+	REGISTER_FUNCTION(setMaxVoices);
 
 	#undef REGISTER_FUNCTION
 }
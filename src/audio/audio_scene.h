@@ -18,7 +18,8 @@ class Path;
 
 struct SoundAnimationEvent
 {
-	u32 clip;
+	// crc32 of ClipInfo::name, resolved without touching the name at runtime
+	u32 clip_name_hash;
 	bool is_3d = true;
 };
 
@@ -69,15 +70,23 @@ public:
 	virtual u32 getClipCount() const = 0;
 	virtual const char* getClipName(u32 index) = 0;
 	virtual ClipInfo* getClipInfoByIndex(u32 index) = 0;
+	// hash is crc32 of the clip's name, see ClipInfo::name_hash
 	virtual ClipInfo* getClipInfo(u32 hash) = 0;
 	virtual ClipInfo* getClipInfo(const char* name) = 0;
 	virtual int getClipInfoIndex(ClipInfo* info) = 0;
 	virtual void addClip(const char* name, const Path& path) = 0;
 	virtual void removeClip(ClipInfo* clip) = 0;
 	virtual void setClip(u32 clip_id, const Path& path) = 0;
+	// keeps name lookups valid, do not write ClipInfo::name directly
+	virtual void setClipName(ClipInfo& clip, const char* name) = 0;
 
+	// radius must be changed with the setters, so the zone grid is rebuilt
 	virtual EchoZone& getEchoZone(EntityRef entity) = 0;
+	virtual float getEchoZoneRadius(EntityRef entity) = 0;
+	virtual void setEchoZoneRadius(EntityRef entity, float radius) = 0;
 	virtual ChorusZone& getChorusZone(EntityRef entity) = 0;
+	virtual float getChorusZoneRadius(EntityRef entity) = 0;
+	virtual void setChorusZoneRadius(EntityRef entity, float radius) = 0;
 
 	virtual ClipInfo* getAmbientSoundClip(EntityRef entity) = 0;
 	virtual int getAmbientSoundClipIndex(EntityRef entity) = 0;
@@ -89,6 +98,11 @@ public:
 	virtual SoundHandle play(EntityRef entity, ClipInfo* clip, bool is_3d) = 0;
 	virtual void stop(SoundHandle sound_id) = 0;
 	virtual void setVolume(SoundHandle sound_id, float volume) = 0;
+	// sounds with higher priority get device voices first, audibility decides among equal ones
+	virtual void setPriority(SoundHandle sound_id, int priority) = 0;
+	// number of sounds mixed at once, the rest are virtual
+	virtual void setMaxVoices(u32 count) = 0;
+	virtual u32 getMaxVoices() const = 0;
 
 	virtual void setEcho(SoundHandle sound_id,
 		float wet_dry_mix,
@@ -23,11 +23,11 @@ static void registerProperties(IAllocator& allocator)
 		),
 		component("audio_listener"),
 		component("echo_zone",
-			var_property("Radius", &AudioScene::getEchoZone, &EchoZone::radius, MinAttribute(0)),
+			property("Radius", LUMIX_PROP(AudioScene, EchoZoneRadius), MinAttribute(0)),
 			var_property("Delay (ms)", &AudioScene::getEchoZone, &EchoZone::delay, MinAttribute(0))
 		),
 		component("chorus_zone",
-			var_property("Radius", &AudioScene::getChorusZone, &ChorusZone::radius, MinAttribute(0)),
+			property("Radius", LUMIX_PROP(AudioScene, ChorusZoneRadius), MinAttribute(0)),
 			var_property("Delay (ms)", &AudioScene::getChorusZone, &ChorusZone::delay, MinAttribute(0))
 		)
 	);
@@ -1,7 +1,9 @@
 #include "clip.h"
+#include "audio_device.h"
 #include "engine/allocator.h"
 #include "engine/crt.h"
 #include "engine/lumix.h"
+#include "engine/mt/atomic.h"
 #include "engine/profiler.h"
 #include "engine/resource.h"
 #include "engine/string.h"
@@ -16,25 +18,146 @@ namespace Lumix
 const ResourceType Clip::TYPE("clip");
 
 
+struct CompressedData
+{
+	CompressedData(IAllocator& allocator)
+		: allocator(allocator)
+		, data(allocator)
+	{}
+
+	void release()
+	{
+		if (MT::atomicDecrement(&ref_count) == 0) LUMIX_DELETE(allocator, this);
+	}
+
+	IAllocator& allocator;
+	Array<u8> data;
+	volatile i32 ref_count = 1;
+};
+
+
+// decodes vorbis incrementally from the compressed data, keeps a reference so the clip can be unloaded
+// or reloaded while the device still reads the stream
+struct ClipStream final : AudioStream
+{
+	ClipStream(stb_vorbis* vorbis, CompressedData& compressed, int channels, int sample_rate, u32 frames_count)
+		: vorbis(vorbis)
+		, compressed(compressed)
+		, channels(channels)
+		, sample_rate(sample_rate)
+		, frames_count(frames_count)
+	{
+		MT::atomicIncrement(&compressed.ref_count);
+	}
+
+	~ClipStream()
+	{
+		stb_vorbis_close(vorbis);
+		compressed.release();
+	}
+
+	int read(i16* out, int frames) override
+	{
+		int total = 0;
+		while (total < frames)
+		{
+			const int read = stb_vorbis_get_samples_short_interleaved(vorbis
+				, channels
+				, out + total * channels
+				, (frames - total) * channels);
+			if (read <= 0) break;
+			total += read;
+		}
+		return total;
+	}
+
+	void seek(u32 frame) override { stb_vorbis_seek(vorbis, frame); }
+	int getChannels() const override { return channels; }
+	int getSampleRate() const override { return sample_rate; }
+	u32 getFramesCount() const override { return frames_count; }
+
+	stb_vorbis* vorbis;
+	CompressedData& compressed;
+	int channels;
+	int sample_rate;
+	u32 frames_count;
+};
+
+
+Clip::~Clip()
+{
+	if (m_compressed) m_compressed->release();
+}
+
+
 void Clip::unload()
 {
 	m_data.clear();
+	if (m_compressed) m_compressed->release();
+	m_compressed = nullptr;
+	m_frames_count = 0;
 }
 
 
 bool Clip::load(u64 size, const u8* mem)
 {
 	PROFILE_FUNCTION();
-	short* output = nullptr;
-	auto res = stb_vorbis_decode_memory((unsigned char*)mem, (int)size, &m_channels, &m_sample_rate, &output);
-	if (res <= 0) return false;
+	m_load_policy = LoadPolicy::AUTO;
+	if (size >= sizeof(Header) && ((const Header*)mem)->magic == Header::MAGIC)
+	{
+		const Header& header = *(const Header*)mem;
+		if (header.version > Header::VERSION) return false;
+		m_load_policy = header.load_policy;
+		mem += sizeof(header);
+		size -= sizeof(header);
+	}
+
+	int error;
+	stb_vorbis* vorbis = stb_vorbis_open_memory(mem, (int)size, &error, nullptr);
+	if (!vorbis) return false;
+
+	const stb_vorbis_info info = stb_vorbis_get_info(vorbis);
+	m_channels = info.channels;
+	m_sample_rate = info.sample_rate;
+	m_frames_count = stb_vorbis_stream_length_in_samples(vorbis);
+	const float length = m_frames_count / float(m_sample_rate);
+	const bool stream = m_load_policy == LoadPolicy::STREAM
+		|| (m_load_policy == LoadPolicy::AUTO && length > STREAM_THRESHOLD_SECONDS);
 
-	m_data.resize(res * m_channels);
-	memcpy(&m_data[0], output, res * m_channels * sizeof(m_data[0]));
-	free(output);
+	if (stream)
+	{
+		stb_vorbis_close(vorbis);
+		m_compressed = LUMIX_NEW(m_allocator, CompressedData)(m_allocator);
+		m_compressed->data.resize((int)size);
+		memcpy(m_compressed->data.begin(), mem, size);
+		return true;
+	}
 
+	m_data.resize(m_frames_count * m_channels);
+	const int decoded = stb_vorbis_get_samples_short_interleaved(vorbis, m_channels, (short*)m_data.begin(), m_data.size());
+	stb_vorbis_close(vorbis);
+	if (decoded <= 0) return false;
+
+	m_frames_count = decoded;
+	m_data.resize(decoded * m_channels);
 	return true;
 }
 
 
+AudioStream* Clip::createStream()
+{
+	ASSERT(isStreamed());
+	int error;
+	stb_vorbis* vorbis = stb_vorbis_open_memory(m_compressed->data.begin(), m_compressed->data.size(), &error, nullptr);
+	if (!vorbis) return nullptr;
+	return LUMIX_NEW(m_allocator, ClipStream)(vorbis, *m_compressed, m_channels, m_sample_rate, m_frames_count);
+}
+
+
+void Clip::destroyStream(AudioStream& stream)
+{
+	LUMIX_DELETE(m_allocator, static_cast<ClipStream*>(&stream));
+}
+
+
 } // namespace Lumix
@@ -10,31 +10,72 @@ namespace Lumix
 {
 
 
+struct AudioStream;
+struct CompressedData;
+
+
 class Clip final : public Resource
 {
 public:
+	enum class LoadPolicy : u8
+	{
+		// stream clips longer than STREAM_THRESHOLD_SECONDS
+		AUTO,
+		DECODE,
+		STREAM
+	};
+
+	static constexpr float STREAM_THRESHOLD_SECONDS = 10;
+
+	// compiled clip is this header followed by the ogg file, raw ogg files are loaded with AUTO policy
+	struct Header
+	{
+		static const u32 MAGIC = 0x50494c43; // 'CLIP'
+		static const u32 VERSION = 0;
+
+		u32 magic = MAGIC;
+		u32 version = VERSION;
+		LoadPolicy load_policy = LoadPolicy::AUTO;
+		u8 padding[3] = {};
+	};
+
 	Clip(const Path& path, ResourceManager& manager, IAllocator& allocator)
 		: Resource(path, manager, allocator)
+		, m_allocator(allocator)
 		, m_data(allocator)
 	{
 	}
 
+	~Clip();
+
 	ResourceType getType() const override { return TYPE; }
 
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
 	int getChannels() const { return m_channels; }
 	int getSampleRate() const { return m_sample_rate; }
+	// decoded data, empty if the clip is streamed
 	int getSize() const { return m_data.size() * sizeof(m_data[0]); }
-	u16* getData() { return &m_data[0]; }
-	float getLengthSeconds() const { return m_data.size() / float(m_channels * m_sample_rate); }
+	u16* getData() { return m_data.begin(); }
+	float getLengthSeconds() const { return m_frames_count / float(m_sample_rate); }
+	// read from the compiled clip, set in clip's meta
+	LoadPolicy getLoadPolicy() const { return m_load_policy; }
+	bool isStreamed() const { return m_compressed != nullptr; }
+	// each playing instance needs its own stream
+	AudioStream* createStream();
+	void destroyStream(AudioStream& stream);
 
 	static const ResourceType TYPE;
 
 private:
+	IAllocator& m_allocator;
 	int m_channels;
 	int m_sample_rate;
+	u32 m_frames_count = 0;
+	LoadPolicy m_load_policy = LoadPolicy::AUTO;
 	Array<u16> m_data;
+	// whole ogg file, kept only for streamed clips, shared with streams so it outlives unload
+	CompressedData* m_compressed = nullptr;
 };
 
 
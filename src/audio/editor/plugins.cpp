@@ -11,6 +11,8 @@
 #include "editor/world_editor.h"
 #include "engine/crc32.h"
 #include "engine/engine.h"
+#include "engine/file_system.h"
+#include "engine/lua_wrapper.h"
 #include "engine/plugin_manager.h"
 #include "engine/reflection.h"
 #include "engine/universe/universe.h"
@@ -24,7 +26,7 @@ namespace
 {
 
 
-struct AssetBrowserPlugin final : public AssetBrowser::IPlugin
+struct AssetBrowserPlugin final : public AssetBrowser::IPlugin, AssetCompiler::IPlugin
 {
 	explicit AssetBrowserPlugin(StudioApp& app)
 		: m_app(app)
@@ -48,18 +50,77 @@ struct AssetBrowserPlugin final : public AssetBrowser::IPlugin
 
 		getAudioDevice(m_app.getEngine()).stop(m_playing_clip);
 		m_playing_clip = -1;
+		if (m_stream) m_stream_clip->destroyStream(*m_stream);
+		m_stream = nullptr;
 	}
 
 
 	const char* getName() const override { return "Audio"; }
 
 
+	static const char* toString(Clip::LoadPolicy policy)
+	{
+		switch (policy)
+		{
+			case Clip::LoadPolicy::DECODE: return "decode";
+			case Clip::LoadPolicy::STREAM: return "stream";
+			default: return "auto";
+		}
+	}
+
+
+	Clip::LoadPolicy getLoadPolicy(const Path& path) const
+	{
+		Clip::LoadPolicy policy = Clip::LoadPolicy::AUTO;
+		m_app.getAssetCompiler().getMeta(path, [&policy](lua_State* L){
+			char tmp[32];
+			if (LuaWrapper::getOptionalStringField(L, LUA_GLOBALSINDEX, "load_policy", Span(tmp))) {
+				if (equalStrings(tmp, "decode")) policy = Clip::LoadPolicy::DECODE;
+				else if (equalStrings(tmp, "stream")) policy = Clip::LoadPolicy::STREAM;
+			}
+		});
+		return policy;
+	}
+
+
+	bool compile(const Path& src) override
+	{
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		Array<u8> src_data(m_app.getAllocator());
+		if (!fs.getContentSync(src, Ref(src_data))) return false;
+
+		Clip::Header header;
+		header.load_policy = getLoadPolicy(src);
+		OutputMemoryStream out(m_app.getAllocator());
+		out.write(header);
+		out.write(src_data.begin(), src_data.byte_size());
+		return m_app.getAssetCompiler().writeCompiledResource(src.c_str(), Span((u8*)out.getData(), (i32)out.getPos()));
+	}
+
+
 	void onGUI(Span<Resource*> resources) override
 	{
 		if(resources.length() > 1) return;
 
 		auto* clip = static_cast<Clip*>(resources[0]);
 		ImGui::LabelText("Length", "%f", clip->getLengthSeconds());
+		ImGui::LabelText("Streamed", "%s", clip->isStreamed() ? "yes" : "no");
+
+		if (clip->getPath().getHash() != m_meta_res) {
+			m_load_policy = getLoadPolicy(clip->getPath());
+			m_meta_res = clip->getPath().getHash();
+		}
+		int policy = (int)m_load_policy;
+		if (ImGui::Combo("Load policy", &policy, "Auto\0Decode\0Stream\0")) m_load_policy = (Clip::LoadPolicy)policy;
+		if (ImGui::Button("Apply")) {
+			const StaticString<64> src("load_policy = \"", toString(m_load_policy), "\"");
+			AssetCompiler& compiler = m_app.getAssetCompiler();
+			compiler.updateMeta(clip->getPath(), src);
+			if (compiler.compile(clip->getPath())) {
+				stopAudio();
+				clip->getResourceManager().reload(*clip);
+			}
+		}
 		auto& device = getAudioDevice(m_app.getEngine());
 
 		if (m_playing_clip >= 0)
@@ -80,8 +141,23 @@ struct AssetBrowserPlugin final : public AssetBrowser::IPlugin
 		{
 			stopAudio();
 
-			auto handle =
-				device.createBuffer(clip->getData(), clip->getSize(), clip->getChannels(), clip->getSampleRate(), 0);
+			AudioDevice::BufferHandle handle = AudioDevice::INVALID_BUFFER_HANDLE;
+			if (clip->isStreamed())
+			{
+				m_stream = clip->createStream();
+				m_stream_clip = clip;
+				if (m_stream) handle = device.createStreamBuffer(*m_stream, 0);
+				if (m_stream && handle == AudioDevice::INVALID_BUFFER_HANDLE)
+				{
+					clip->destroyStream(*m_stream);
+					m_stream = nullptr;
+				}
+			}
+			else
+			{
+				handle = device.createBuffer(clip->getData(), clip->getSize(), clip->getChannels(), clip->getSampleRate(), 0);
+			}
+			if (handle == AudioDevice::INVALID_BUFFER_HANDLE) return;
 			device.play(handle, true);
 			m_playing_clip = handle;
 		}
@@ -103,6 +179,10 @@ struct AssetBrowserPlugin final : public AssetBrowser::IPlugin
 
 
 	int m_playing_clip;
+	Clip::LoadPolicy m_load_policy = Clip::LoadPolicy::AUTO;
+	u32 m_meta_res = 0;
+	AudioStream* m_stream = nullptr;
+	Clip* m_stream_clip = nullptr;
 	StudioApp& m_app;
 	AssetBrowser& m_browser;
 };
@@ -144,12 +224,12 @@ struct ClipManagerUI final : public StudioApp::GUIPlugin
 			*out = scene->getClipName(idx);
 			return true;
 		};
-		AudioScene::ClipInfo* clip = scene->getClipInfo(ev->clip);
+		AudioScene::ClipInfo* clip = scene->getClipInfo(ev->clip_name_hash);
 		int current = clip ? scene->getClipInfoIndex(clip) : -1;
 
 		if (ImGui::Combo("Clip", &current, getter, scene, scene->getClipCount()))
 		{
-			ev->clip = scene->getClipInfo(current)->name_hash;
+			ev->clip_name_hash = scene->getClipInfoByIndex(current)->name_hash;
 		}
 	}
 	*/
@@ -180,8 +260,10 @@ struct ClipManagerUI final : public StudioApp::GUIPlugin
 				}
 
 				if (ImGui::TreeNode((const void*)(uintptr)clip_id, "%s", clip_info->name)) {
-					if (ImGui::InputText("Name", clip_info->name, sizeof(clip_info->name))) {
-						clip_info->name_hash = crc32(clip_info->name);
+					char name[sizeof(clip_info->name)];
+					copyString(name, clip_info->name);
+					if (ImGui::InputText("Name", name, sizeof(name))) {
+						audio_scene->setClipName(*clip_info, name);
 					}
 					char path[MAX_PATH_LENGTH];
 					copyString(path, clip_info->clip ? clip_info->clip->getPath().c_str() : "");
@@ -279,6 +361,8 @@ struct StudioAppPlugin : StudioApp::IPlugin
 
 		m_asset_browser_plugin = LUMIX_NEW(allocator, AssetBrowserPlugin)(m_app);
 		m_app.getAssetBrowser().addPlugin(*m_asset_browser_plugin);
+		const char* clip_exts[] = { "ogg", nullptr };
+		m_app.getAssetCompiler().addPlugin(*m_asset_browser_plugin, clip_exts);
 
 		m_clip_manager_ui = LUMIX_NEW(allocator, ClipManagerUI)(m_app);
 		m_app.addPlugin(*m_clip_manager_ui);
@@ -294,6 +378,7 @@ struct StudioAppPlugin : StudioApp::IPlugin
 		IAllocator& allocator = m_app.getAllocator();
 
 		m_app.getAssetBrowser().removePlugin(*m_asset_browser_plugin);
+		m_app.getAssetCompiler().removePlugin(*m_asset_browser_plugin);
 		m_app.getWorldEditor().removePlugin(*m_gizmo_plugin);
 		m_app.removePlugin(*m_clip_manager_ui);
 
@@ -1,14 +1,20 @@
 #include "audio_device.h"
 #include "engine/array.h"
-#include "engine/log.h"
+#include "engine/command_line_parser.h"
 #include "engine/engine.h"
 #include "engine/iplugin.h"
 #include "engine/log.h"
 #include "engine/math.h"
-#include "engine/mt/sync.h"
+#include "engine/mt/atomic.h"
 #include "engine/mt/task.h"
+#include "engine/mt/thread.h"
 #include "engine/os.h"
+#include "engine/string.h"
 #include <alsa/asoundlib.h>
+#include <math.h>
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
 
 
 namespace Lumix
@@ -24,6 +30,8 @@ struct AudioTask : MT::Task
 
 	virtual int task() override;
 	void handleError(int error_code);
+	void writeAlsa();
+	void writeFile();
 
 	volatile bool m_finished = false;
 	AudioDeviceImpl& m_device;
@@ -33,6 +41,47 @@ struct AudioTask : MT::Task
 class AudioDeviceImpl : public AudioDevice
 {
 public:
+	static const int MAX_BUFFERS_COUNT = 256;
+	// frames mixed in one go, both the mix bus and per voice scratch are this big
+	static const int BLOCK_FRAMES = 1024;
+	static const int OUTPUT_CHANNELS = 2;
+	// same range and distance model as the dsound device
+	static constexpr float MIN_FREQUENCY = 100;
+	static constexpr float MAX_FREQUENCY = 200000;
+	static constexpr float MIN_DISTANCE = 2;
+	static constexpr float MAX_DISTANCE = 10000;
+	static constexpr float MAX_CHORUS_DELAY_MS = 20;
+	static constexpr float MAX_CHORUS_FREQUENCY = 10;
+	// decoded frames kept around the cursor of streamed buffers
+	static const int STREAM_WINDOW_FRAMES = 16384;
+
+	struct Echo
+	{
+		bool enabled;
+		float wet_dry_mix;
+		float feedback;
+		int delay[2];
+		int length;
+		int pos;
+		float* line;
+	};
+
+	struct Chorus
+	{
+		bool enabled;
+		float wet_dry_mix;
+		float depth;
+		float feedback;
+		float delay;
+		float lfo_step;
+		float lfo_phase;
+		float phase_offset;
+		int length;
+		int pos;
+		float* line;
+	};
+
+	// owned by the mixer thread
 	struct Buffer
 	{
 		enum class RuntimeFlags
@@ -42,41 +91,282 @@ public:
 			LOOPED = 1 << 2
 		};
 
-		Buffer(IAllocator& allocator) : data(allocator) {}
-		
-		Array<u8> data;
+		int getFramesCount() const { return stream ? stream->getFramesCount() : data_frames; }
+
+		// whole clip, or a window of decoded frames starting at stream_window_start if streamed
+		i16* data;
+		int data_frames;
+		AudioStream* stream;
+		u64 stream_window_start;
+		int stream_window_frames;
+		bool stream_ended;
 		int channels;
 		int sample_rate;
 		int flags;
-		int cursor;
+		// in source frames, fractional part is used to interpolate
+		double cursor;
+		float volume;
+		float frequency;
+		DVec3 position;
+		Echo echo;
+		Chorus chorus;
 		u8 runtime_flags;
+		// seq of the last applied command which changed playback state
+		u32 seq;
+	};
+
+	// owned by the game thread, mirrors what was sent to the mixer
+	struct BufferState
+	{
+		bool allocated = false;
+		bool playing;
+		int sample_rate;
+		bool is_stream;
+		u32 seq = 0;
+		float time;
+	};
+
+	// written by the mixer after each block, read by the game thread
+	struct BufferSnapshot
+	{
+		volatile i64 cursor;
+		volatile i32 ended;
+		volatile i32 seq;
+	};
+
+	struct Command
+	{
+		enum Type : u8
+		{
+			CREATE,
+			PLAY,
+			PAUSE,
+			STOP,
+			SET_VOLUME,
+			SET_FREQUENCY,
+			SET_TIME,
+			SET_POSITION,
+			SET_ECHO,
+			SET_CHORUS,
+			SET_MASTER_VOLUME,
+			SET_LISTENER_POSITION,
+			SET_LISTENER_RIGHT
+		};
+
+		Type type;
+		BufferHandle buffer;
+		u32 seq;
+		union
+		{
+			struct
+			{
+				i16* data;
+				int frames;
+				AudioStream* stream;
+				int channels;
+				int sample_rate;
+				int flags;
+			} create;
+			bool looped;
+			float value;
+			double time;
+			double vec[3];
+			Echo echo;
+			Chorus chorus;
+		};
+	};
+
+	// Single producer single consumer ring, the producer only writes m_wr and the consumer
+	// only writes m_rd, so no locks are needed.
+	template <typename T, u32 count>
+	struct SPSCRing
+	{
+		bool push(const T& value)
+		{
+			const i32 wr = m_wr;
+			if (u32(wr - m_rd) == count) return false;
+			m_items[wr & (count - 1)] = value;
+			MT::memoryBarrier();
+			m_wr = wr + 1;
+			return true;
+		}
+
+		bool pop(T* value)
+		{
+			const i32 rd = m_rd;
+			if (rd == m_wr) return false;
+			MT::memoryBarrier();
+			*value = m_items[rd & (count - 1)];
+			MT::memoryBarrier();
+			m_rd = rd + 1;
+			return true;
+		}
+
+		T m_items[count];
+		volatile i32 m_wr = 0;
+		volatile i32 m_rd = 0;
 	};
 
 
+	void pushCommand(const Command& cmd)
+	{
+		if (!m_mixer_running)
+		{
+			// mixer is done (e.g. file output finished), so we are the only consumer now
+			Command tmp;
+			while (m_commands.pop(&tmp)) applyCommand(tmp);
+			applyCommand(cmd);
+			publishSnapshots();
+			return;
+		}
+		// only when the mixer is stalled, it is never blocked by us
+		while (!m_commands.push(cmd))
+		{
+			if (!m_mixer_running)
+			{
+				pushCommand(cmd);
+				return;
+			}
+			MT::yield();
+		}
+	}
+
+
+	Command& initCommand(Command& cmd, Command::Type type, BufferHandle buffer)
+	{
+		cmd.type = type;
+		cmd.buffer = buffer;
+		cmd.seq = buffer == INVALID_BUFFER_HANDLE ? 0 : m_states[buffer].seq;
+		return cmd;
+	}
+
+
+	// free memory released by the mixer, mixer never calls the allocator
+	void collectGarbage()
+	{
+		void* ptr;
+		while (m_garbage.pop(&ptr)) m_allocator.deallocate(ptr);
+	}
+
+
+	void releaseFromMixer(void* ptr)
+	{
+		if (!ptr) return;
+		if (!m_garbage.push(ptr))
+		{
+			// ring full, game thread is not calling update, better than leaking
+			m_allocator.deallocate(ptr);
+		}
+	}
+
+
+	BufferHandle allocBuffer(int sample_rate, bool is_stream)
+	{
+		collectGarbage();
+		for (int i = 0; i < MAX_BUFFERS_COUNT; ++i)
+		{
+			BufferState& state = m_states[i];
+			if (state.allocated) continue;
+
+			state.allocated = true;
+			state.playing = false;
+			state.sample_rate = sample_rate;
+			state.is_stream = is_stream;
+			state.time = 0;
+			++state.seq;
+			return i;
+		}
+		return INVALID_BUFFER_HANDLE;
+	}
+
+
 	BufferHandle createBuffer(const void* data,
 		int size_bytes,
 		int channels,
 		int sample_rate,
 		int flags) override
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(flags == 0); // nothing else supported yet
-		for(int i = 0, c = m_buffers.size(); i < c; ++i)
-		{
-			Buffer& buffer = m_buffers[i];
-			if((buffer.runtime_flags & (u8)Buffer::RuntimeFlags::READY)) continue;
+		ASSERT(channels == 1 || channels == 2);
+		const BufferHandle handle = allocBuffer(sample_rate, false);
+		if (handle == INVALID_BUFFER_HANDLE) return INVALID_BUFFER_HANDLE;
+
+		Command cmd;
+		initCommand(cmd, Command::CREATE, handle);
+		cmd.create.data = (i16*)m_allocator.allocate(size_bytes);
+		memcpy(cmd.create.data, data, size_bytes);
+		cmd.create.frames = size_bytes / sizeof(i16) / channels;
+		cmd.create.stream = nullptr;
+		cmd.create.channels = channels;
+		cmd.create.sample_rate = sample_rate;
+		cmd.create.flags = flags;
+		pushCommand(cmd);
+		return handle;
+	}
 
-			buffer.channels = channels;
-			buffer.sample_rate = sample_rate;
-			buffer.flags = flags;
-			buffer.data.resize(size_bytes);
-			buffer.runtime_flags = (u8)Buffer::RuntimeFlags::READY;
-			buffer.cursor = 0;
-			memcpy(&buffer.data[0], data, size_bytes);
 
-			return i;
+	BufferHandle createStreamBuffer(AudioStream& stream, int flags) override
+	{
+		ASSERT(stream.getChannels() == 1 || stream.getChannels() == 2);
+		const BufferHandle handle = allocBuffer(stream.getSampleRate(), true);
+		if (handle == INVALID_BUFFER_HANDLE) return INVALID_BUFFER_HANDLE;
+
+		Command cmd;
+		initCommand(cmd, Command::CREATE, handle);
+		cmd.create.data = (i16*)m_allocator.allocate(STREAM_WINDOW_FRAMES * stream.getChannels() * sizeof(i16));
+		cmd.create.frames = 0;
+		cmd.create.stream = &stream;
+		cmd.create.channels = stream.getChannels();
+		cmd.create.sample_rate = stream.getSampleRate();
+		cmd.create.flags = flags;
+		pushCommand(cmd);
+		return handle;
+	}
+
+
+	static void seekStream(Buffer& buffer, u64 frame)
+	{
+		buffer.stream->seek(u32(frame % maximum(buffer.stream->getFramesCount(), 1u)));
+		buffer.stream_window_start = frame;
+		buffer.stream_window_frames = 0;
+		buffer.stream_ended = false;
+		buffer.cursor = (double)frame;
+	}
+
+
+	// Streamed buffers use an unwrapped timeline, looping just keeps appending decoded frames,
+	// so the window always holds contiguous frames from the cursor on.
+	static void fillStreamWindow(Buffer& buffer, int frames_needed)
+	{
+		const int channels = buffer.channels;
+		const u64 first = (u64)buffer.cursor;
+		if (first > buffer.stream_window_start)
+		{
+			const int drop = (int)minimum(first - buffer.stream_window_start, (u64)buffer.stream_window_frames);
+			buffer.stream_window_frames -= drop;
+			buffer.stream_window_start += drop;
+			memmove(buffer.data
+				, buffer.data + drop * channels
+				, buffer.stream_window_frames * channels * sizeof(i16));
+		}
+
+		const int target = minimum(frames_needed, STREAM_WINDOW_FRAMES);
+		const bool is_looped = buffer.runtime_flags & (u8)Buffer::RuntimeFlags::LOOPED;
+		bool rewound = false;
+		while (buffer.stream_window_frames < target && !buffer.stream_ended)
+		{
+			i16* dst = buffer.data + buffer.stream_window_frames * channels;
+			const int read = buffer.stream->read(dst, STREAM_WINDOW_FRAMES - buffer.stream_window_frames);
+			buffer.stream_window_frames += read;
+			if (read > 0)
+			{
+				rewound = false;
+				continue;
+			}
+			// avoid spinning on a stream which does not return anything even after rewind
+			if (!is_looped || rewound) buffer.stream_ended = true;
+			else buffer.stream->seek(0);
+			rewound = true;
 		}
-		return INVALID_BUFFER_HANDLE;
 	}
 
 
@@ -86,8 +376,21 @@ public:
 		float left_delay,
 		float right_delay) override 
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(false); // not implemented yet
+		ASSERT(m_states[handle].allocated);
+		Command cmd;
+		Echo& echo = initCommand(cmd, Command::SET_ECHO, handle).echo;
+		echo.enabled = true;
+		echo.wet_dry_mix = clamp(wet_dry_mix, 0.f, 1.f);
+		echo.feedback = clamp(feedback, 0.f, 0.99f);
+		// delays are in ms, like in dsound
+		echo.delay[0] = maximum(1, int(left_delay * m_sample_rate / 1000));
+		echo.delay[1] = maximum(1, int(right_delay * m_sample_rate / 1000));
+		echo.length = maximum(echo.delay[0], echo.delay[1]);
+		echo.pos = 0;
+		const size_t line_size = echo.length * OUTPUT_CHANNELS * sizeof(float);
+		echo.line = (float*)m_allocator.allocate(line_size);
+		memset(echo.line, 0, line_size);
+		pushCommand(cmd);
 	}
 
 
@@ -99,142 +402,462 @@ public:
 		float delay,
 		i32 phase) override
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(false); // not implemented yet
+		ASSERT(m_states[handle].allocated);
+		Command cmd;
+		Chorus& chorus = initCommand(cmd, Command::SET_CHORUS, handle).chorus;
+		chorus.enabled = true;
+		chorus.wet_dry_mix = clamp(wet_dry_mix, 0.f, 1.f);
+		chorus.depth = clamp(depth, 0.f, 1.f);
+		chorus.feedback = clamp(feedback, 0.f, 0.99f);
+		// delay in ms, frequency of the lfo is normalized as in the dsound device
+		chorus.delay = clamp(delay, 0.f, MAX_CHORUS_DELAY_MS) * m_sample_rate / 1000;
+		chorus.lfo_step = 2 * PI * clamp(frequency, 0.f, 1.f) * MAX_CHORUS_FREQUENCY / m_sample_rate;
+		chorus.lfo_phase = 0;
+		// phase is one of dsound's -180, -90, 0, 90, 180 degrees presets
+		chorus.phase_offset = (clamp(phase, 0, 4) - 2) * HALF_PI;
+		chorus.length = int(MAX_CHORUS_DELAY_MS * m_sample_rate / 1000) * 2 + 2;
+		chorus.pos = 0;
+		const size_t line_size = chorus.length * OUTPUT_CHANNELS * sizeof(float);
+		chorus.line = (float*)m_allocator.allocate(line_size);
+		memset(chorus.line, 0, line_size);
+		pushCommand(cmd);
+	}
+
+
+	// resamples voice into stereo float block, returns number of written frames
+	static int resample(const i16* data, int channels, int frames_count, bool is_looped, double* cursor_ptr, float step, float* out, int frames)
+	{
+		const float scale = 1 / 32768.f;
+		double cursor = *cursor_ptr;
+		int i = 0;
+		for (; i < frames; ++i)
+		{
+			if (cursor >= frames_count)
+			{
+				if (!is_looped) break;
+				cursor = fmod(cursor, (double)frames_count);
+			}
+			const int idx = (int)cursor;
+			const float t = float(cursor - idx);
+			int next = idx + 1;
+			if (next >= frames_count) next = is_looped ? 0 : idx;
+
+			if (channels == 1)
+			{
+				const float v = (data[idx] + (data[next] - data[idx]) * t) * scale;
+				out[i * 2] = v;
+				out[i * 2 + 1] = v;
+			}
+			else
+			{
+				const i16* a = &data[idx * 2];
+				const i16* b = &data[next * 2];
+				out[i * 2] = (a[0] + (b[0] - a[0]) * t) * scale;
+				out[i * 2 + 1] = (a[1] + (b[1] - a[1]) * t) * scale;
+			}
+			cursor += step;
+		}
+		*cursor_ptr = minimum(cursor, (double)frames_count);
+		return i;
+	}
+
+
+	static void applyEcho(Echo& echo, float* block, int frames)
+	{
+		float* line = echo.line;
+		const float wet = echo.wet_dry_mix;
+		for (int i = 0; i < frames; ++i)
+		{
+			for (int ch = 0; ch < OUTPUT_CHANNELS; ++ch)
+			{
+				const int read = (echo.pos - echo.delay[ch] + echo.length) % echo.length;
+				const float delayed = line[read * OUTPUT_CHANNELS + ch];
+				const float in = block[i * OUTPUT_CHANNELS + ch];
+				line[echo.pos * OUTPUT_CHANNELS + ch] = in + delayed * echo.feedback;
+				block[i * OUTPUT_CHANNELS + ch] = in * (1 - wet) + delayed * wet;
+			}
+			echo.pos = (echo.pos + 1) % echo.length;
+		}
 	}
 
 
-	void mix(u16* output, int size_bytes)
+	static void applyChorus(Chorus& chorus, float* block, int frames)
 	{
-		memset(output, 0, size_bytes);
+		float* line = chorus.line;
+		const float wet = chorus.wet_dry_mix;
+		for (int i = 0; i < frames; ++i)
+		{
+			for (int ch = 0; ch < OUTPUT_CHANNELS; ++ch)
+			{
+				const float lfo = sinf(chorus.lfo_phase + ch * chorus.phase_offset);
+				const float delay = 1 + chorus.delay * (1 + chorus.depth * lfo);
+				float read = chorus.pos - delay;
+				if (read < 0) read += chorus.length;
+				const int idx = (int)read;
+				const float t = read - idx;
+				const float a = line[idx * OUTPUT_CHANNELS + ch];
+				const float b = line[((idx + 1) % chorus.length) * OUTPUT_CHANNELS + ch];
+				const float delayed = a + (b - a) * t;
+				const float in = block[i * OUTPUT_CHANNELS + ch];
+				line[chorus.pos * OUTPUT_CHANNELS + ch] = in + delayed * chorus.feedback;
+				block[i * OUTPUT_CHANNELS + ch] = in * (1 - wet) + delayed * wet;
+			}
+			chorus.pos = (chorus.pos + 1) % chorus.length;
+			chorus.lfo_phase = fmodf(chorus.lfo_phase + chorus.lfo_step, 2 * PI);
+		}
+	}
+
+
+	void getGains(const Buffer& buffer, float* left, float* right) const
+	{
+		float gain = buffer.volume * m_master_volume;
+		if (!(buffer.flags & (int)BufferFlags::IS3D))
+		{
+			*left = *right = gain;
+			return;
+		}
+
+		const Vec3 dir = (buffer.position - m_listener_position).toFloat();
+		const float dist = dir.length();
+		gain *= MIN_DISTANCE / clamp(dist, MIN_DISTANCE, MAX_DISTANCE);
+
+		// constant power pan
+		const float pan = dist > 0.001f ? dotProduct(dir, m_listener_right) / dist : 0;
+		const float angle = (clamp(pan, -1.f, 1.f) + 1) * PI * 0.25f;
+		*left = gain * cosf(angle);
+		*right = gain * sinf(angle);
+	}
+
+
+	static void accumulate(float* LUMIX_RESTRICT bus, const float* LUMIX_RESTRICT block, int frames, float left, float right)
+	{
+		int i = 0;
+		#if defined(__SSE2__)
+			const __m128 gains = _mm_setr_ps(left, right, left, right);
+			for (; i + 2 <= frames; i += 2)
+			{
+				const __m128 v = _mm_loadu_ps(block + i * 2);
+				const __m128 acc = _mm_loadu_ps(bus + i * 2);
+				_mm_storeu_ps(bus + i * 2, _mm_add_ps(acc, _mm_mul_ps(v, gains)));
+			}
+		#endif
+		for (; i < frames; ++i)
+		{
+			bus[i * 2] += block[i * 2] * left;
+			bus[i * 2 + 1] += block[i * 2 + 1] * right;
+		}
+	}
+
+
+	// triangular dither of +-1 lsb, saturates to s16
+	void convert(const float* bus, i16* output, int samples)
+	{
+		u32 seed = m_dither_seed;
+		auto rnd = [&seed]() {
+			seed = seed * 1664525 + 1013904223;
+			return (seed >> 8) * (1.f / (1 << 24));
+		};
+
+		int i = 0;
+		#if defined(__SSE2__)
+			const __m128 scale = _mm_set1_ps(32767.f);
+			for (; i + 8 <= samples; i += 8)
+			{
+				float dither[8];
+				for (float& d : dither) d = rnd() - rnd();
+				const __m128 a = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(bus + i), scale), _mm_loadu_ps(dither));
+				const __m128 b = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(bus + i + 4), scale), _mm_loadu_ps(dither + 4));
+				const __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+				_mm_storeu_si128((__m128i*)(output + i), packed);
+			}
+		#endif
+		for (; i < samples; ++i)
+		{
+			const float v = bus[i] * 32767.f + rnd() - rnd();
+			output[i] = (i16)clamp(v, -32768.f, 32767.f);
+		}
+		m_dither_seed = seed;
+	}
+
+
+	void applyCommand(const Command& cmd)
+	{
+		if (cmd.type == Command::SET_MASTER_VOLUME)
+		{
+			m_master_volume = cmd.value;
+			return;
+		}
+		if (cmd.type == Command::SET_LISTENER_POSITION)
+		{
+			m_listener_position = {cmd.vec[0], cmd.vec[1], cmd.vec[2]};
+			return;
+		}
+		if (cmd.type == Command::SET_LISTENER_RIGHT)
+		{
+			m_listener_right = {(float)cmd.vec[0], (float)cmd.vec[1], (float)cmd.vec[2]};
+			return;
+		}
+
+		Buffer& buffer = m_buffers[cmd.buffer];
+		buffer.seq = cmd.seq;
+		switch (cmd.type)
+		{
+			case Command::CREATE:
+				buffer.data = cmd.create.data;
+				buffer.data_frames = cmd.create.frames;
+				buffer.stream = cmd.create.stream;
+				buffer.channels = cmd.create.channels;
+				buffer.sample_rate = cmd.create.sample_rate;
+				buffer.flags = cmd.create.flags;
+				buffer.runtime_flags = (u8)Buffer::RuntimeFlags::READY;
+				buffer.cursor = 0;
+				buffer.volume = 1;
+				buffer.frequency = (float)buffer.sample_rate;
+				buffer.position = {0, 0, 0};
+				buffer.echo.enabled = false;
+				buffer.chorus.enabled = false;
+				if (buffer.stream) seekStream(buffer, 0);
+				break;
+			case Command::PLAY:
+				buffer.runtime_flags |= (u8)Buffer::RuntimeFlags::PLAYING;
+				if (cmd.looped) buffer.runtime_flags |= (u8)Buffer::RuntimeFlags::LOOPED;
+				else buffer.runtime_flags &= ~(u8)Buffer::RuntimeFlags::LOOPED;
+				break;
+			case Command::PAUSE: buffer.runtime_flags &= ~(u8)Buffer::RuntimeFlags::PLAYING; break;
+			case Command::STOP:
+				releaseFromMixer(buffer.data);
+				if (buffer.echo.enabled) releaseFromMixer(buffer.echo.line);
+				if (buffer.chorus.enabled) releaseFromMixer(buffer.chorus.line);
+				buffer.data = nullptr;
+				buffer.stream = nullptr;
+				buffer.echo.enabled = false;
+				buffer.chorus.enabled = false;
+				buffer.runtime_flags = 0;
+				break;
+			case Command::SET_VOLUME: buffer.volume = cmd.value; break;
+			case Command::SET_FREQUENCY: buffer.frequency = cmd.value; break;
+			case Command::SET_TIME:
+			{
+				const double frame = clamp(cmd.time * buffer.sample_rate, 0.0, (double)buffer.getFramesCount());
+				if (buffer.stream) seekStream(buffer, (u64)frame);
+				else buffer.cursor = frame;
+				break;
+			}
+			case Command::SET_POSITION: buffer.position = {cmd.vec[0], cmd.vec[1], cmd.vec[2]}; break;
+			case Command::SET_ECHO:
+				if (buffer.echo.enabled) releaseFromMixer(buffer.echo.line);
+				buffer.echo = cmd.echo;
+				break;
+			case Command::SET_CHORUS:
+				if (buffer.chorus.enabled) releaseFromMixer(buffer.chorus.line);
+				buffer.chorus = cmd.chorus;
+				break;
+			default: ASSERT(false); break;
+		}
+	}
+
+
+	bool isBufferEnd(const Buffer& buffer) const
+	{
+		if (buffer.stream) return buffer.stream_ended && buffer.cursor >= buffer.stream_window_start + buffer.stream_window_frames;
+		return buffer.cursor >= buffer.getFramesCount();
+	}
+
+
+	void publishSnapshots()
+	{
+		for (int i = 0; i < MAX_BUFFERS_COUNT; ++i)
+		{
+			const Buffer& buffer = m_buffers[i];
+			BufferSnapshot& snapshot = m_snapshots[i];
+			if ((buffer.runtime_flags & (u8)Buffer::RuntimeFlags::READY) == 0)
+			{
+				// acknowledges STOP, stop() waits for it before the stream is destroyed
+				snapshot.seq = buffer.seq;
+				continue;
+			}
+
+			double cursor = buffer.cursor;
+			if (buffer.stream) cursor = fmod(cursor, (double)maximum(buffer.getFramesCount(), 1));
+			snapshot.cursor = (i64)cursor;
+			snapshot.ended = isBufferEnd(buffer);
+			MT::memoryBarrier();
+			snapshot.seq = buffer.seq;
+		}
+	}
+
+
+	void mix(i16* output, int frames)
+	{
+		ASSERT(frames <= BLOCK_FRAMES);
+		float* bus = m_bus.begin();
+		float* block = m_voice_block.begin();
+		memset(bus, 0, frames * OUTPUT_CHANNELS * sizeof(float));
+
+		Command cmd;
+		while (m_commands.pop(&cmd)) applyCommand(cmd);
 
-		MT::CriticalSectionLock lock(m_mutex);
 		for (Buffer& buffer : m_buffers)
 		{
 			if((buffer.runtime_flags & (u8)Buffer::RuntimeFlags::PLAYING) == 0) continue;
 			
-			mixBuffer(output, size_bytes, buffer);
+			mixBuffer(bus, block, frames, buffer);
 		}
+		convert(bus, output, frames * OUTPUT_CHANNELS);
+		publishSnapshots();
 	}
 
 
-	void mixBuffer(u16* output, int size_bytes, Buffer& buffer)
+	void mixBuffer(float* bus, float* block, int frames, Buffer& buffer)
 	{
 		ASSERT(buffer.runtime_flags & (u8)Buffer::RuntimeFlags::PLAYING);
-		ASSERT(buffer.channels == 1); // nothing else supported yet
-		if (buffer.cursor >= buffer.data.size()) return;
-		int total = size_bytes;
-		bool is_looped = buffer.runtime_flags & (u8)Buffer::RuntimeFlags::LOOPED;
-		do
+		const float step = buffer.frequency / m_sample_rate;
+		int written = 0;
+		if (buffer.stream)
 		{
-			int to_copy = minimum(total, buffer.data.size() - buffer.cursor);
-			memcpy(output, &buffer.data[buffer.cursor], to_copy);
-			buffer.cursor += to_copy;
-			if(is_looped) buffer.cursor = buffer.cursor % buffer.data.size();
-			total -= to_copy;
-		} while(total > 0 && is_looped);
+			fillStreamWindow(buffer, int(frames * step) + 2);
+			double cursor = buffer.cursor - buffer.stream_window_start;
+			written = resample(buffer.data, buffer.channels, buffer.stream_window_frames, false, &cursor, step, block, frames);
+			buffer.cursor = buffer.stream_window_start + cursor;
+		}
+		else if (buffer.data_frames > 0)
+		{
+			const bool is_looped = buffer.runtime_flags & (u8)Buffer::RuntimeFlags::LOOPED;
+			written = resample(buffer.data, buffer.channels, buffer.data_frames, is_looped, &buffer.cursor, step, block, frames);
+		}
+		// effects have tails, so feed them silence after the end of the clip
+		memset(block + written * OUTPUT_CHANNELS, 0, (frames - written) * OUTPUT_CHANNELS * sizeof(float));
+		if (written == 0 && !buffer.echo.enabled && !buffer.chorus.enabled) return;
+
+		if (buffer.echo.enabled) applyEcho(buffer.echo, block, frames);
+		if (buffer.chorus.enabled) applyChorus(buffer.chorus, block, frames);
+
+		float left, right;
+		getGains(buffer, &left, &right);
+		accumulate(bus, block, frames, left, right);
 	}
 
+
+	// true if the mixer has not applied all commands which changed playback state of the buffer
+	bool isPending(BufferHandle buffer) const
+	{
+		const i32 seq = m_snapshots[buffer].seq;
+		MT::memoryBarrier();
+		return u32(seq) != m_states[buffer].seq;
+	}
+
+
 	void play(BufferHandle buffer, bool looped) override 
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		m_buffers[buffer].runtime_flags |= (u8)Buffer::RuntimeFlags::PLAYING;
-		if(looped)
-		{
-			m_buffers[buffer].runtime_flags |= (u8)Buffer::RuntimeFlags::LOOPED;
-		}
-		else
-		{
-			m_buffers[buffer].runtime_flags &= ~(u8)Buffer::RuntimeFlags::LOOPED;
-		}
+		ASSERT(m_states[buffer].allocated);
+		BufferState& state = m_states[buffer];
+		state.playing = true;
+		++state.seq;
+		Command cmd;
+		initCommand(cmd, Command::PLAY, buffer).looped = looped;
+		pushCommand(cmd);
 	}
 
 
 	bool isPlaying(BufferHandle buffer) override 
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		return m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::PLAYING;
+		ASSERT(m_states[buffer].allocated);
+		return m_states[buffer].playing;
 	}
 
 
 	void stop(BufferHandle buffer) override
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		m_buffers[buffer].runtime_flags &= ~(u8)Buffer::RuntimeFlags::PLAYING;
-		m_buffers[buffer].cursor = 0;
+		ASSERT(m_states[buffer].allocated);
+		BufferState& state = m_states[buffer];
+		state.allocated = false;
+		++state.seq;
+		Command cmd;
+		pushCommand(initCommand(cmd, Command::STOP, buffer));
+
+		// caller destroys the stream once we return, so wait until the mixer lets it go
+		if (state.is_stream)
+		{
+			while (m_mixer_running && isPending(buffer)) MT::yield();
+		}
 	}
 
 
 	bool isEnd(BufferHandle buffer) override
 	{ 
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		return m_buffers[buffer].cursor >= m_buffers[buffer].data.size();
+		ASSERT(m_states[buffer].allocated);
+		if (isPending(buffer)) return false;
+		return m_snapshots[buffer].ended != 0;
 	}
 
 
 	void pause(BufferHandle buffer) override
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		m_buffers[buffer].runtime_flags &= ~(u8)Buffer::RuntimeFlags::PLAYING;
+		ASSERT(m_states[buffer].allocated);
+		BufferState& state = m_states[buffer];
+		state.playing = false;
+		++state.seq;
+		Command cmd;
+		pushCommand(initCommand(cmd, Command::PAUSE, buffer));
 	}
 
 
 	void setMasterVolume(float volume) override 
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(false); // not implemented yet
+		Command cmd;
+		initCommand(cmd, Command::SET_MASTER_VOLUME, INVALID_BUFFER_HANDLE).value = maximum(volume, 0.f);
+		pushCommand(cmd);
 	}
 
 
 	void setVolume(BufferHandle buffer, float volume) override 
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		ASSERT(false); // not implemented yet
+		ASSERT(m_states[buffer].allocated);
+		Command cmd;
+		initCommand(cmd, Command::SET_VOLUME, buffer).value = maximum(volume, 0.f);
+		pushCommand(cmd);
 	}
 
 
 	void setFrequency(BufferHandle buffer, float frequency) override 
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		ASSERT(false); // not implemented yet
+		ASSERT(m_states[buffer].allocated);
+		Command cmd;
+		// normalized, same as in the dsound device
+		initCommand(cmd, Command::SET_FREQUENCY, buffer).value = MIN_FREQUENCY + clamp(frequency, 0.f, 1.f) * (MAX_FREQUENCY - MIN_FREQUENCY);
+		pushCommand(cmd);
 	}
 
 
-	void setCurrentTime(BufferHandle handle, float time_seconds) override 
+	void setCurrentTime(BufferHandle buffer, float time_seconds) override 
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(m_buffers[handle].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		
-		Buffer& buffer = m_buffers[handle];
-		float length = float(buffer.data.size() / double(buffer.sample_rate * 2 * buffer.channels));
-		float rel = time_seconds / length;
-		buffer.cursor = rel * buffer.data.size();
-		buffer.cursor = clamp(buffer.cursor, 0, buffer.data.size());
+		ASSERT(m_states[buffer].allocated);
+		BufferState& state = m_states[buffer];
+		state.time = maximum(time_seconds, 0.f);
+		++state.seq;
+		Command cmd;
+		initCommand(cmd, Command::SET_TIME, buffer).time = state.time;
+		pushCommand(cmd);
 	}
 
 
-	float getCurrentTime(BufferHandle handle) override
+	float getCurrentTime(BufferHandle buffer) override
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(m_buffers[handle].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		
-		Buffer& buffer = m_buffers[handle];
-		float length = float(buffer.data.size() / double(buffer.sample_rate * 2 * buffer.channels));
-		return float(length * double(buffer.cursor) / buffer.data.size());
+		ASSERT(m_states[buffer].allocated);
+		const BufferState& state = m_states[buffer];
+		if (isPending(buffer)) return state.time;
+		return float(double(m_snapshots[buffer].cursor) / state.sample_rate);
 	}
 
 
 	void setListenerPosition(const DVec3& pos) override
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(false); // not implemented yet
+		Command cmd;
+		initCommand(cmd, Command::SET_LISTENER_POSITION, INVALID_BUFFER_HANDLE);
+		cmd.vec[0] = pos.x;
+		cmd.vec[1] = pos.y;
+		cmd.vec[2] = pos.z;
+		pushCommand(cmd);
 	}
 
 
@@ -245,35 +868,49 @@ public:
 		float up_y,
 		float up_z) override
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(false); // not implemented yet
+		const Vec3 front(front_x, front_y, front_z);
+		const Vec3 up(up_x, up_y, up_z);
+		Vec3 right = crossProduct(up, front);
+		if (right.squaredLength() < 0.000001f) return;
+		right = right.normalized();
+
+		Command cmd;
+		initCommand(cmd, Command::SET_LISTENER_RIGHT, INVALID_BUFFER_HANDLE);
+		cmd.vec[0] = right.x;
+		cmd.vec[1] = right.y;
+		cmd.vec[2] = right.z;
+		pushCommand(cmd);
 	}
 	
 
 	void setSourcePosition(BufferHandle buffer, const DVec3& pos) override
 	{
-		MT::CriticalSectionLock lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		ASSERT(false); // not implemented yet
+		ASSERT(m_states[buffer].allocated);
+		Command cmd;
+		initCommand(cmd, Command::SET_POSITION, buffer);
+		cmd.vec[0] = pos.x;
+		cmd.vec[1] = pos.y;
+		cmd.vec[2] = pos.z;
+		pushCommand(cmd);
 	}
 	
 	
 	void update(float time_delta) override 
 	{
+		collectGarbage();
 	}
 
 
 	AudioDeviceImpl(Engine& engine)
 		: m_allocator(engine.getAllocator())
 		, m_engine(engine)
-		, m_buffers(m_allocator)
+		, m_bus(m_allocator)
+		, m_voice_block(m_allocator)
 	{
-		m_buffers.reserve(MAX_BUFFERS_COUNT);
-		for (int i = 0; i < MAX_BUFFERS_COUNT; ++i)
-		{
-			Buffer& buffer = m_buffers.emplace(m_allocator);
-			buffer.runtime_flags = 0;
-		}
+		for (Buffer& buffer : m_buffers) buffer = {};
+		memset((void*)m_snapshots, 0, sizeof(m_snapshots));
+		m_bus.resize(BLOCK_FRAMES * OUTPUT_CHANNELS);
+		m_voice_block.resize(BLOCK_FRAMES * OUTPUT_CHANNELS);
 	}
 
 
@@ -285,8 +922,22 @@ public:
 			m_task->destroy();
 			LUMIX_DELETE(m_allocator, m_task);
 		}
+		m_output_file.close();
 		if (m_device) m_api.snd_pcm_close(m_device);
 		if (m_alsa_lib) OS::unloadLibrary(m_alsa_lib);
+
+		// mixer is gone, apply whatever is left so everything is released
+		Command cmd;
+		while (m_commands.pop(&cmd)) applyCommand(cmd);
+		for (int i = 0; i < MAX_BUFFERS_COUNT; ++i)
+		{
+			if (m_buffers[i].runtime_flags & (u8)Buffer::RuntimeFlags::READY)
+			{
+				initCommand(cmd, Command::STOP, i);
+				applyCommand(cmd);
+			}
+		}
+		collectGarbage();
 	}
 
 
@@ -333,14 +984,81 @@ public:
 	}
 
 
+	// -audio_file <path> [-audio_file_length <seconds>] mixes into a wav file instead of
+	// the sound card, as fast as possible, so the mixer can be profiled without audio hardware
+	bool initFileOutput()
+	{
+		char cmd_line[2048];
+		OS::getCommandLine(Span(cmd_line));
+		CommandLineParser parser(cmd_line);
+		char path[MAX_PATH_LENGTH] = "";
+		i32 seconds = 60;
+		while (parser.next())
+		{
+			if (parser.currentEquals("-audio_file"))
+			{
+				if (!parser.next()) break;
+				parser.getCurrent(path, lengthOf(path));
+			}
+			else if (parser.currentEquals("-audio_file_length"))
+			{
+				if (!parser.next()) break;
+				char tmp[32];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				fromCString(Span(tmp, stringLength(tmp)), Ref(seconds));
+			}
+		}
+		if (!path[0]) return false;
+
+		if (!m_output_file.open(path))
+		{
+			logError("Audio") << "Failed to create " << path;
+			return false;
+		}
+
+		m_file_frames = u32(maximum(seconds, 1)) * m_sample_rate;
+		const u32 data_size = m_file_frames * OUTPUT_CHANNELS * sizeof(i16);
+		const u16 block_align = OUTPUT_CHANNELS * sizeof(i16);
+		const u32 byte_rate = m_sample_rate * block_align;
+		const u32 riff_size = 36 + data_size;
+		const u32 fmt_size = 16;
+		const u16 format = 1; // PCM
+		const u16 channels = OUTPUT_CHANNELS;
+		const u16 bits = 16;
+		m_output_file.write("RIFF", 4);
+		m_output_file.write(&riff_size, sizeof(riff_size));
+		m_output_file.write("WAVEfmt ", 8);
+		m_output_file.write(&fmt_size, sizeof(fmt_size));
+		m_output_file.write(&format, sizeof(format));
+		m_output_file.write(&channels, sizeof(channels));
+		m_output_file.write(&m_sample_rate, sizeof(m_sample_rate));
+		m_output_file.write(&byte_rate, sizeof(byte_rate));
+		m_output_file.write(&block_align, sizeof(block_align));
+		m_output_file.write(&bits, sizeof(bits));
+		m_output_file.write("data", 4);
+		m_output_file.write(&data_size, sizeof(data_size));
+
+		m_is_file_output = true;
+		logInfo("Audio") << "Writing audio to " << path;
+		return true;
+	}
+
+
 	bool init()
 	{
+		if (initFileOutput())
+		{
+			m_task = LUMIX_NEW(m_allocator, AudioTask)(*this, m_allocator);
+			m_mixer_running = true;
+			m_task->create("AudioTask", true);
+			return true;
+		}
+
 		if (!loadAlsa()) return false;
 		
-		unsigned int rate = 44100;
-		int channels = 1;
+		unsigned int rate = m_sample_rate;
 		snd_pcm_hw_params_t* hw_params;
-		snd_pcm_uframes_t buffer_size = 1024;
+		snd_pcm_uframes_t buffer_size = BLOCK_FRAMES;
 
 		int res = m_api.snd_pcm_open(&m_device, "default", SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
 		if(res < 0) goto error;
@@ -351,11 +1069,12 @@ public:
 
 		if (m_api.snd_pcm_hw_params_set_access(m_device, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED) < 0) goto error;
 		if (m_api.snd_pcm_hw_params_set_format(m_device, hw_params, SND_PCM_FORMAT_S16_LE) < 0)  goto error;
-		if (m_api.snd_pcm_hw_params_set_channels(m_device, hw_params, channels) < 0) goto error; 
+		if (m_api.snd_pcm_hw_params_set_channels(m_device, hw_params, OUTPUT_CHANNELS) < 0) goto error; 
 		if (m_api.snd_pcm_hw_params_set_rate_near(m_device, hw_params, &rate, 0) < 0) goto error;
 		if (m_api.snd_pcm_hw_params_set_buffer_size_near(m_device, hw_params, &buffer_size) < 0) goto error;
 		res = m_api.snd_pcm_hw_params(m_device, hw_params);
 		if(res < 0) goto error;
+		m_sample_rate = rate;
 		
 		res = m_api.snd_pcm_start(m_device);
 		if(res < 0) goto error;
@@ -364,6 +1083,7 @@ public:
 		logInfo("Audio") << "PCM state: '" << m_api.snd_pcm_state(m_device) << "'";
 
 		m_task = LUMIX_NEW(m_allocator, AudioTask)(*this, m_allocator);
+		m_mixer_running = true;
 		m_task->create("AudioTask", true);
 
 		return true;
@@ -400,17 +1120,29 @@ public:
 	};
 
 
-	static const int MAX_BUFFERS_COUNT = 256;
-
-
 	IAllocator& m_allocator;
-	Array<Buffer> m_buffers;
+	Buffer m_buffers[MAX_BUFFERS_COUNT];
+	BufferState m_states[MAX_BUFFERS_COUNT];
+	BufferSnapshot m_snapshots[MAX_BUFFERS_COUNT];
+	SPSCRing<Command, 4096> m_commands;
+	SPSCRing<void*, 1024> m_garbage;
+	Array<float> m_bus;
+	Array<float> m_voice_block;
 	AudioTask* m_task = nullptr;
 	Engine& m_engine;
-	MT::CriticalSection m_mutex;
+	// set while the audio task is calling mix()
+	volatile bool m_mixer_running = false;
 	void* m_alsa_lib = nullptr;
 	snd_pcm_t* m_device = nullptr;
 	API m_api;
+	u32 m_sample_rate = 44100;
+	float m_master_volume = 1;
+	DVec3 m_listener_position = {0, 0, 0};
+	Vec3 m_listener_right = {1, 0, 0};
+	u32 m_dither_seed = 1;
+	bool m_is_file_output = false;
+	OS::OutputFile m_output_file;
+	u32 m_file_frames = 0;
 };
 
 
@@ -421,18 +1153,36 @@ void AudioTask::handleError(int error_code)
 }
 
 
-int AudioTask::task()
+void AudioTask::writeFile()
+{
+	i16 buffer[AudioDeviceImpl::BLOCK_FRAMES * AudioDeviceImpl::OUTPUT_CHANNELS];
+	u32 frames_left = m_device.m_file_frames;
+	OS::Timer timer;
+	while (!m_finished && frames_left > 0)
+	{
+		const int frames = minimum(frames_left, (u32)AudioDeviceImpl::BLOCK_FRAMES);
+		m_device.mix(buffer, frames);
+		m_device.m_output_file.write(buffer, frames * AudioDeviceImpl::OUTPUT_CHANNELS * sizeof(buffer[0]));
+		frames_left -= frames;
+	}
+	m_device.m_output_file.close();
+	const float mixed_seconds = float(m_device.m_file_frames - frames_left) / m_device.m_sample_rate;
+	logInfo("Audio") << "Mixed " << mixed_seconds << " s of audio in " << timer.getTimeSinceStart() << " s";
+}
+
+
+void AudioTask::writeAlsa()
 {
 	while(!m_finished)
 	{
-		u16 buffer[2*1024];
-		int frames_avail = lengthOf(buffer);
-		m_device.mix(buffer, frames_avail * 2);
+		i16 buffer[AudioDeviceImpl::BLOCK_FRAMES * AudioDeviceImpl::OUTPUT_CHANNELS];
+		int frames_avail = AudioDeviceImpl::BLOCK_FRAMES;
+		m_device.mix(buffer, frames_avail);
 
-		u16* iter = buffer;
+		i16* iter = buffer;
 		while(frames_avail > 0)
 		{		
-			snd_pcm_sframes_t frames_written = m_device.m_api.snd_pcm_writei(m_device.m_device, buffer, frames_avail);
+			snd_pcm_sframes_t frames_written = m_device.m_api.snd_pcm_writei(m_device.m_device, iter, frames_avail);
 			if (frames_written < 0)
 			{
 				if (frames_written == -EAGAIN) continue;
@@ -444,26 +1194,29 @@ int AudioTask::task()
 						handleError(recover_result);
 						break;
 					}
-
-					frames_written = m_device.m_api.snd_pcm_writei(m_device.m_device, buffer, frames_avail);
-					if (frames_written < 0)
-					{
-						handleError(recover_result);
-						break;
-					}
 				} 
 				else 
 				{
 					handleError(frames_written);
+					break;
 				}
 			}
 			else
 			{
 				frames_avail -= frames_written;
-				iter += frames_written;
+				iter += frames_written * AudioDeviceImpl::OUTPUT_CHANNELS;
 			}
 		}
 	}
+}
+
+
+int AudioTask::task()
+{
+	if (m_device.m_is_file_output) writeFile();
+	else writeAlsa();
+	MT::memoryBarrier();
+	m_device.m_mixer_running = false;
 	return 0;
 }
 
@@ -479,6 +1232,7 @@ public:
 	{
 		return INVALID_BUFFER_HANDLE;
 	}
+	BufferHandle createStreamBuffer(AudioStream& stream, int flags) override { return INVALID_BUFFER_HANDLE; }
 	void setEcho(BufferHandle handle,
 		float wet_dry_mix,
 		float feedback,
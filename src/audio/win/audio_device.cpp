@@ -5,8 +5,10 @@
 #include "engine/allocator.h"
 #include "engine/crt.h"
 #include "engine/engine.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/math.h"
+#include "engine/profiler.h"
 
 
 namespace Lumix
@@ -21,6 +23,7 @@ struct AudioDeviceImpl final : public AudioDevice
 		LPDIRECTSOUND3DBUFFER8 handle_3d;
 		IDirectSoundBuffer8* handle8;
 		const void* data;
+		AudioStream* stream;
 		DWORD data_size;
 		DWORD written;
 		int sparse_idx;
@@ -35,6 +38,9 @@ struct AudioDeviceImpl final : public AudioDevice
 	Buffer m_buffers[MAX_PLAYING_SOUNDS];
 	int m_buffer_map[MAX_PLAYING_SOUNDS];
 	int m_buffer_count;
+	// refill of streamed buffers runs on a worker, so decoding does not block the game thread,
+	// game thread waits for it only before it changes buffers
+	JobSystem::SignalHandle m_stream_signal = JobSystem::INVALID_HANDLE;
 
 	static const int STREAM_SIZE = 32768;
 
@@ -142,6 +148,7 @@ struct AudioDeviceImpl final : public AudioDevice
 
 	~AudioDeviceImpl()
 	{
+		waitStreaming();
 		if (m_listener) m_listener->Release();
 		if (m_primary_buffer) m_primary_buffer->Release();
 		if (m_direct_sound) m_direct_sound->Release();
@@ -149,12 +156,48 @@ struct AudioDeviceImpl final : public AudioDevice
 	}
 
 
+	// memory buffers are read from data, streamed ones are read sequentially from the stream
+	static void readData(const void* data, AudioStream* stream, void* dst, DWORD offset, DWORD size)
+	{
+		if (!stream)
+		{
+			memcpy(dst, (const u8*)data + offset, size);
+			return;
+		}
+
+		if (offset == 0) stream->seek(0);
+		const DWORD frame_size = stream->getChannels() * sizeof(i16);
+		const int frames = int(size / frame_size);
+		const int read = stream->read((i16*)dst, frames);
+		ZeroMemory((u8*)dst + read * frame_size, size - read * frame_size);
+	}
+
+
 	BufferHandle createBuffer(const void* data,
 		int data_size,
 		int channels,
 		int sample_rate,
 		int flags) override
 	{
+		return createBuffer(data, nullptr, data_size, channels, sample_rate, flags);
+	}
+
+
+	BufferHandle createStreamBuffer(AudioStream& stream, int flags) override
+	{
+		const int data_size = stream.getFramesCount() * stream.getChannels() * sizeof(i16);
+		return createBuffer(nullptr, &stream, data_size, stream.getChannels(), stream.getSampleRate(), flags);
+	}
+
+
+	BufferHandle createBuffer(const void* data,
+		AudioStream* stream,
+		int data_size,
+		int channels,
+		int sample_rate,
+		int flags)
+	{
+		waitStreaming();
 		if (m_buffer_count == MAX_PLAYING_SOUNDS) return INVALID_BUFFER_HANDLE;
 
 		int buffer_size = data_size > STREAM_SIZE ? STREAM_SIZE : data_size;
@@ -189,7 +232,7 @@ struct AudioDeviceImpl final : public AudioDevice
 			buffer->Release();
 			return INVALID_BUFFER_HANDLE;
 		}
-		memcpy(p1, data, s1);
+		readData(data, stream, p1, 0, s1);
 		result = SUCCEEDED(buffer->Unlock(p1, s1, p2, s2));
 		if (!result)
 		{
@@ -221,6 +264,7 @@ struct AudioDeviceImpl final : public AudioDevice
 				handle = m_buffer_count;
 				m_buffers[m_buffer_count].handle = buffer;
 				m_buffers[m_buffer_count].data = data;
+				m_buffers[m_buffer_count].stream = stream;
 				m_buffers[m_buffer_count].data_size = data_size;
 				m_buffers[m_buffer_count].written = buffer_size;
 				m_buffers[m_buffer_count].sparse_idx = i;
@@ -368,6 +412,7 @@ struct AudioDeviceImpl final : public AudioDevice
 
 	void play(BufferHandle handle, bool looped) override
 	{
+		waitStreaming();
 		auto& buffer = m_buffers[m_buffer_map[handle]];
 		buffer.looped = looped;
 		buffer.handle->Play(0, 0, looped || buffer.data_size > STREAM_SIZE ? DSBPLAY_LOOPING : 0);
@@ -395,6 +440,7 @@ struct AudioDeviceImpl final : public AudioDevice
 
 	void stop(BufferHandle handle) override
 	{
+		waitStreaming();
 		--m_buffer_count;
 		int dense_idx = m_buffer_map[handle];
 
@@ -457,6 +503,7 @@ struct AudioDeviceImpl final : public AudioDevice
 
 	void setCurrentTime(BufferHandle handle, float time_seconds) override
 	{
+		waitStreaming();
 		auto& buffer = m_buffers[m_buffer_map[handle]];
 		WAVEFORMATEX format;
 		if (SUCCEEDED(buffer.handle->GetFormat(&format, sizeof(format), nullptr)))
@@ -470,6 +517,7 @@ struct AudioDeviceImpl final : public AudioDevice
 			else
 			{
 				buffer.written = pos;
+				if (buffer.stream) buffer.stream->seek(pos / format.nBlockAlign);
 			}
 		}
 	}
@@ -488,12 +536,12 @@ struct AudioDeviceImpl final : public AudioDevice
 			if (!p) return;
 			if (buffer.written + size > buffer.data_size)
 			{
-				memcpy(p, (u8*)buffer.data + buffer.written, buffer.data_size - buffer.written);
+				readData(buffer.data, buffer.stream, p, buffer.written, buffer.data_size - buffer.written);
 				void* p_2 = (u8*)p + (buffer.data_size - buffer.written);
 				DWORD size_2 = size - (buffer.data_size - buffer.written);
 				if (buffer.looped)
 				{
-					memcpy(p_2, buffer.data, size_2);
+					readData(buffer.data, buffer.stream, p_2, 0, size_2);
 				}
 				else
 				{
@@ -502,7 +550,7 @@ struct AudioDeviceImpl final : public AudioDevice
 			}
 			else
 			{
-				memcpy(p, (u8*)buffer.data + buffer.written, size);
+				readData(buffer.data, buffer.stream, p, buffer.written, size);
 			}
 			buffer.written += size;
 			buffer.written = buffer.written % buffer.data_size;
@@ -518,8 +566,17 @@ struct AudioDeviceImpl final : public AudioDevice
 	}
 
 
-	void update(float) override 
+	void waitStreaming()
 	{
+		if (!JobSystem::isValid(m_stream_signal)) return;
+		JobSystem::wait(m_stream_signal);
+		m_stream_signal = JobSystem::INVALID_HANDLE;
+	}
+
+
+	void updateStreams()
+	{
+		PROFILE_FUNCTION();
 		for (int i = 0; i < m_buffer_count; ++i)
 		{
 			auto& buffer = m_buffers[i];
@@ -537,6 +594,23 @@ struct AudioDeviceImpl final : public AudioDevice
 				updateStreamData(buffer, update_size);
 			}
 		}
+	}
+
+
+	void update(float) override 
+	{
+		waitStreaming();
+		bool any_streamed = false;
+		for (int i = 0; i < m_buffer_count; ++i)
+		{
+			if (m_buffers[i].data_size > STREAM_SIZE) any_streamed = true;
+		}
+		if (any_streamed)
+		{
+			JobSystem::run(this, [](void* data){
+				((AudioDeviceImpl*)data)->updateStreams();
+			}, &m_stream_signal);
+		}
 		m_listener->CommitDeferredSettings(); 
 	}
 
@@ -577,6 +651,7 @@ public:
 	{
 		return INVALID_BUFFER_HANDLE;
 	}
+	BufferHandle createStreamBuffer(AudioStream& stream, int flags) override { return INVALID_BUFFER_HANDLE; }
 	void setEcho(BufferHandle handle,
 		float wet_dry_mix,
 		float feedback,
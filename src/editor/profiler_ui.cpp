@@ -546,7 +546,15 @@ void ProfilerUIImpl::onGUICPUProfiler()
 	if (ImGui::BeginMenu("Advanced")) {
 		ImGui::Checkbox("Show frames", &m_show_frames);
 		ImGui::Text("Zoom: %f", m_range / double(DEFAULT_RANGE));
+		const float event_overhead = Profiler::getEventOverhead();
+		if (event_overhead >= 0) ImGui::Text("Event overhead: %.1f ns", event_overhead);
 		if (ImGui::MenuItem("Reset zoom")) m_range = DEFAULT_RANGE;
+		if (Profiler::isCapturing()) {
+			if (ImGui::MenuItem("Stop trace capture")) Profiler::stopCapture();
+		}
+		else if (ImGui::MenuItem("Start trace capture")) {
+			Profiler::startCapture("profiler_trace.json");
+		}
 		bool do_autopause = m_autopause >= 0;
 		if (ImGui::Checkbox("Autopause enabled", &do_autopause)) {
 			m_autopause = -m_autopause;
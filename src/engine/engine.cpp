@@ -28,6 +28,11 @@ namespace Lumix
 void registerEngineAPI(lua_State* L, Engine* engine);
 
 static const u32 SERIALIZED_ENGINE_MAGIC = 0x5f4c454e; // == '_LEN'
+static const int LUA_GC_STEP_KB = 64;
+// new GC cycle starts once the heap grows this much since the end of the previous cycle
+static const float LUA_GC_PAUSE = 2.f;
+// if the heap grows this much, the cycle is finished regardless of the budget
+static const float LUA_GC_MAX_GROWTH = 4.f;
 
 
 #pragma pack(1)
@@ -102,6 +107,8 @@ public:
 
 		m_state = luaL_newstate();
 		luaL_openlibs(m_state);
+		// GC is stepped in update, so it does not kick in inside script callbacks
+		lua_gc(m_state, LUA_GCSTOP, 0);
 
 		registerEngineAPI(m_state, this);
 
@@ -317,6 +324,7 @@ public:
 		m_plugin_manager->update(dt, m_paused);
 		m_input_system->update(dt);
 		m_file_system->processCallbacks();
+		stepLuaGC();
 
 		if (m_next_frame)
 		{
@@ -326,6 +334,50 @@ public:
 	}
 
 
+	void stepLuaGC()
+	{
+		if (m_lua_gc_budget <= 0) return;
+
+		PROFILE_FUNCTION();
+		const int heap_kb = lua_gc(m_state, LUA_GCCOUNT, 0);
+		Profiler::pushInt("Lua heap (KB)", heap_kb);
+		if (!m_is_lua_gc_cycle_running && heap_kb < m_lua_gc_heap_after_cycle * LUA_GC_PAUSE) return;
+
+		m_is_lua_gc_cycle_running = true;
+		const u64 start = OS::Timer::getRawTimestamp();
+		const u64 budget = u64(m_lua_gc_budget * OS::Timer::getFrequency() / 1000);
+		int steps = 0;
+		for (;;)
+		{
+			++steps;
+			if (lua_gc(m_state, LUA_GCSTEP, LUA_GC_STEP_KB))
+			{
+				m_is_lua_gc_cycle_running = false;
+				m_lua_gc_heap_after_cycle = lua_gc(m_state, LUA_GCCOUNT, 0);
+				break;
+			}
+			if (OS::Timer::getRawTimestamp() - start > budget 
+				&& lua_gc(m_state, LUA_GCCOUNT, 0) < m_lua_gc_heap_after_cycle * LUA_GC_MAX_GROWTH)
+			{
+				break;
+			}
+		}
+		// stepping rearms the automatic collector
+		lua_gc(m_state, LUA_GCSTOP, 0);
+		Profiler::pushInt("Lua GC steps", steps);
+	}
+
+
+	void setLuaGCBudget(float ms) override
+	{
+		m_lua_gc_budget = ms;
+		lua_gc(m_state, ms > 0 ? LUA_GCSTOP : LUA_GCRESTART, 0);
+	}
+
+
+	float getLuaGCBudget() const override { return m_lua_gc_budget; }
+
+
 	void serializeSceneVersions(OutputMemoryStream& serializer, Universe& ctx)
 	{
 		serializer.write(ctx.getScenes().size());
@@ -492,6 +544,9 @@ private:
 	OS::WindowHandle m_window_handle;
 	PathManager* m_path_manager;
 	lua_State* m_state;
+	float m_lua_gc_budget = 1.f;
+	int m_lua_gc_heap_after_cycle = 0;
+	bool m_is_lua_gc_cycle_running = false;
 	OS::OutputFile m_log_file;
 	bool m_is_log_file_open = false;
 	HashMap<int, Resource*> m_lua_resources;
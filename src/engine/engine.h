@@ -65,6 +65,9 @@ public:
 	virtual void pause(bool pause) = 0;
 	virtual void nextFrame() = 0;
 	virtual lua_State* getState() = 0;
+	// time in ms spent on Lua GC each frame, 0 - Lua's automatic GC is used
+	virtual void setLuaGCBudget(float ms) = 0;
+	virtual float getLuaGCBudget() const = 0;
 
 	virtual class Resource* getLuaResource(LuaResourceHandle idx) const = 0;
 	virtual LuaResourceHandle addLuaResource(const Path& path, struct ResourceType type) = 0;
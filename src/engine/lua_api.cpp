@@ -782,9 +782,39 @@ static void LUA_logInfo(const char* text) { logInfo("Lua Script") << text; }
 static void LUA_pause(Engine* engine, bool pause) { engine->pause(pause); }
 static void LUA_nextFrame(Engine* engine) { engine->nextFrame(); }
 static void LUA_setTimeMultiplier(Engine* engine, float multiplier) { engine->setTimeMultiplier(multiplier); }
+static void LUA_setLuaGCBudget(Engine* engine, float ms) { engine->setLuaGCBudget(ms); }
 static Vec4 LUA_multMatrixVec(const Matrix& m, const Vec4& v) { return m * v; }
 static Quat LUA_multQuat(const Quat& a, const Quat& b) { return a * b; }
 
+// plain C functions called from LuaJIT FFI, see Lumix.FFI
+static const Transform* FFI_getTransforms(Universe* universe) { return universe->getTransforms(); }
+
+static void FFI_getPositions(Universe* universe, const EntityRef* entities, DVec3* positions, int count)
+{
+	for (int i = 0; i < count; ++i) positions[i] = universe->getPosition(entities[i]);
+}
+
+static void FFI_setPositions(Universe* universe, const EntityRef* entities, const DVec3* positions, int count)
+{
+	for (int i = 0; i < count; ++i) universe->setPosition(entities[i], positions[i]);
+}
+
+static void FFI_getRotations(Universe* universe, const EntityRef* entities, Quat* rotations, int count)
+{
+	for (int i = 0; i < count; ++i) rotations[i] = universe->getRotation(entities[i]);
+}
+
+static void FFI_setRotations(Universe* universe, const EntityRef* entities, const Quat* rotations, int count)
+{
+	for (int i = 0; i < count; ++i) universe->setRotation(entities[i], rotations[i]);
+}
+
+static void FFI_setTransforms(Universe* universe, const EntityRef* entities, const DVec3* positions, const Quat* rotations, int count)
+{
+	for (int i = 0; i < count; ++i) universe->setTransform(entities[i], RigidTransform(positions[i], rotations[i]));
+}
+
+
 static int LUA_loadUniverse(lua_State* L)
 {
 	auto* engine = LuaWrapper::checkArg<Engine*>(L, 1);
@@ -919,12 +949,20 @@ void registerEngineAPI(lua_State* L, Engine* engine)
 	//REGISTER_FUNCTION(setEntityLocalRotation);
 	REGISTER_FUNCTION(setEntityPosition);
 	REGISTER_FUNCTION(setEntityRotation);
+	REGISTER_FUNCTION(setLuaGCBudget);
 	//REGISTER_FUNCTION(setTimeMultiplier);
 	//REGISTER_FUNCTION(startGame);
 	REGISTER_FUNCTION(unloadResource);
 
 	LuaWrapper::createSystemFunction(L, "LumixAPI", "loadUniverse", LUA_loadUniverse);
 
+	LuaWrapper::createSystemVariable(L, "LumixFFI", "getTransforms", (void*)&FFI_getTransforms);
+	LuaWrapper::createSystemVariable(L, "LumixFFI", "getPositions", (void*)&FFI_getPositions);
+	LuaWrapper::createSystemVariable(L, "LumixFFI", "setPositions", (void*)&FFI_setPositions);
+	LuaWrapper::createSystemVariable(L, "LumixFFI", "getRotations", (void*)&FFI_getRotations);
+	LuaWrapper::createSystemVariable(L, "LumixFFI", "setRotations", (void*)&FFI_setRotations);
+	LuaWrapper::createSystemVariable(L, "LumixFFI", "setTransforms", (void*)&FFI_setTransforms);
+
 	#undef REGISTER_FUNCTION
 
 	#define REGISTER_FUNCTION(F) \
@@ -1122,6 +1160,28 @@ void registerEngineAPI(lua_State* L, Engine* engine)
 			end
 			return ent
 		end
+
+		-- bulk access through LuaJIT FFI, entities are int arrays, e.g. Lumix.FFI.newEntities(n)
+		-- the view returned by getTransforms is read-only and valid only until a new entity is created
+		local has_ffi, ffi = pcall(require, "ffi")
+		if has_ffi then
+			ffi.cdef[[
+				typedef struct { double x, y, z; } LumixDVec3;
+				typedef struct { float x, y, z, w; } LumixQuat;
+				typedef struct { LumixDVec3 pos; LumixQuat rot; float scale; } LumixTransform;
+			]]
+			Lumix.FFI = {
+				getTransforms = ffi.cast("const LumixTransform* (*)(void*)", LumixFFI.getTransforms),
+				getPositions = ffi.cast("void (*)(void*, const int*, LumixDVec3*, int)", LumixFFI.getPositions),
+				setPositions = ffi.cast("void (*)(void*, const int*, const LumixDVec3*, int)", LumixFFI.setPositions),
+				getRotations = ffi.cast("void (*)(void*, const int*, LumixQuat*, int)", LumixFFI.getRotations),
+				setRotations = ffi.cast("void (*)(void*, const int*, const LumixQuat*, int)", LumixFFI.setRotations),
+				setTransforms = ffi.cast("void (*)(void*, const int*, const LumixDVec3*, const LumixQuat*, int)", LumixFFI.setTransforms),
+				newEntities = function(count) return ffi.new("int[?]", count) end,
+				newPositions = function(count) return ffi.new("LumixDVec3[?]", count) end,
+				newRotations = function(count) return ffi.new("LumixQuat[?]", count) end
+			}
+		end
 	)#";
 
 	#define TO_STR_HELPER(x) #x
@@ -10,11 +10,13 @@
 #include "engine/fibers.h"
 #include "engine/hash_map.h"
 #include "engine/allocator.h"
+#include "engine/log.h"
 #include "engine/mt/atomic.h"
 #include "engine/mt/sync.h"
 #include "engine/mt/task.h"
 #include "engine/mt/thread.h"
 #include "engine/os.h"
+#include "engine/stream.h"
 #include "profiler.h"
 
 namespace Lumix
@@ -25,10 +27,24 @@ namespace Profiler
 {
 
 
+// x64 does not reorder stores, so it's enough to stop the compiler from doing so
+static LUMIX_FORCE_INLINE void writeBarrier()
+{
+	#ifdef _WIN32
+		_ReadWriteBarrier();
+	#else
+		asm volatile("" ::: "memory");
+	#endif
+}
+
+
+// Events are written only by the owning thread, without locks. Readers copy the ring to
+// snapshot and throw away whatever the writer overwrote while they were copying.
 struct ThreadContext
 {
 	ThreadContext(IAllocator& allocator) 
 		: buffer(allocator)
+		, snapshot(allocator)
 		, open_blocks(allocator)
 	{
 		buffer.resize(1024 * 512);
@@ -37,14 +53,21 @@ struct ThreadContext
 
 	Array<const char*> open_blocks;
 	Array<u8> buffer;
-	u32 begin = 0;
-	u32 end = 0;
+	// advanced by the writer before it overwrites old events
+	volatile u32 begin = 0;
+	// advanced by the writer after an event is complete
+	volatile u32 end = 0;
+	// reader's copy of buffer, touched only while GlobalState is alive
+	Array<u8> snapshot;
+	u32 snapshot_begin = 0;
+	u32 snapshot_end = 0;
 	u32 rows = 0;
 	bool open = false;
+	// guards name and, for global_context, writing from multiple threads
 	MT::CriticalSection mutex;
 	StaticString<64> name;
 	bool show_in_profiler = false;
-	u32 thread_id;
+	u32 thread_id = 0;
 };
 
 #ifdef _WIN32
@@ -94,6 +117,9 @@ struct ThreadContext
 	void CloseTrace(int) {}
 #endif
 
+struct CaptureTask;
+
+
 static struct Instance
 {
 	Instance()
@@ -107,6 +133,7 @@ static struct Instance
 
 	~Instance()
 	{
+		stopCapture();
 		CloseTrace(trace_task.open_handle);
 		trace_task.destroy();
 	}
@@ -157,6 +184,7 @@ static struct Instance
 			ThreadContext* new_ctx = LUMIX_NEW(allocator, ThreadContext)(allocator);
 			new_ctx->thread_id = MT::getCurrentThreadID();
 			MT::CriticalSectionLock lock(mutex);
+			MT::CriticalSectionLock contexts_lock(contexts_mutex);
 			contexts.push(new_ctx);
 			return new_ctx;
 		}();
@@ -168,6 +196,9 @@ static struct Instance
 	DefaultAllocator allocator;
 	Array<ThreadContext*> contexts;
 	MT::CriticalSection mutex;
+	// guards only contexts, readers hold mutex for a long time, capture must not wait for them
+	MT::CriticalSection contexts_mutex;
+	CaptureTask* capture = nullptr;
 	OS::Timer timer;
 	bool paused = false;
 	bool context_switches_enabled = false;
@@ -180,6 +211,54 @@ static struct Instance
 } g_instance;
 
 
+static u16 readEventSize(const u8* buf, u32 buf_size, u32 pos)
+{
+	const u32 l = pos % buf_size;
+	if (l + 1 < buf_size) {
+		u16 size;
+		memcpy(&size, buf + l, sizeof(size));
+		return size;
+	}
+	// header wraps around the end of the ring
+	return u16(buf[l] | (buf[0] << 8));
+}
+
+
+// throws away old events if there is not enough space, never touches the data
+static LUMIX_FORCE_INLINE void reserve(ThreadContext& ctx, u32 size)
+{
+	// old events are dropped in bigger chunks, so it does not happen for every new event
+	static const u32 RECLAIM_SIZE = 4096;
+
+	const u32 buf_size = ctx.buffer.size();
+	const u32 end = ctx.end;
+	u32 begin = ctx.begin;
+	if (size + end - begin <= buf_size) return;
+
+	const u8* buf = ctx.buffer.begin();
+	while (begin != end && size + RECLAIM_SIZE + end - begin > buf_size) {
+		begin += readEventSize(buf, buf_size, begin);
+	}
+	ctx.begin = begin;
+	writeBarrier();
+}
+
+
+static LUMIX_FORCE_INLINE void copyToRing(ThreadContext& ctx, u32 pos, const void* data, u32 size)
+{
+	u8* buf = ctx.buffer.begin();
+	const u32 buf_size = ctx.buffer.size();
+	const u32 l = pos % buf_size;
+	if (buf_size - l >= size) {
+		memcpy(buf + l, data, size);
+	}
+	else {
+		memcpy(buf + l, data, buf_size - l);
+		memcpy(buf, ((const u8*)data) + buf_size - l, size - (buf_size - l));
+	}
+}
+
+
 template <typename T>
 void write(ThreadContext& ctx, u64 timestamp, EventType type, const T& value)
 {
@@ -196,62 +275,18 @@ void write(ThreadContext& ctx, u64 timestamp, EventType type, const T& value)
 	v.header.time = timestamp;
 	v.value = value;
 
-	MT::CriticalSectionLock lock(ctx.mutex);
-	u8* buf = ctx.buffer.begin();
-	const int buf_size = ctx.buffer.size();
-
-	while (sizeof(v) + ctx.end - ctx.begin > buf_size) {
-		const u8 size = buf[ctx.begin % buf_size];
-		ctx.begin += size;
-	}
-
-	const u32 lend = ctx.end % buf_size;
-	if (buf_size - lend >= sizeof(v)) {
-		memcpy(buf + lend, &v, sizeof(v));
-	}
-	else {
-		memcpy(buf + lend, &v, buf_size - lend);
-		memcpy(buf, ((u8*)&v) + buf_size - lend, sizeof(v) - (buf_size - lend));
-	}
-
-	ctx.end += sizeof(v);
+	reserve(ctx, sizeof(v));
+	const u32 end = ctx.end;
+	copyToRing(ctx, end, &v, sizeof(v));
+	writeBarrier();
+	ctx.end = end + sizeof(v);
 };
 
 template <typename T>
 void write(ThreadContext& ctx, EventType type, const T& value)
 {
 	if (g_instance.paused) return;
-
-#pragma pack(1)
-	struct {
-		EventHeader header;
-		T value;
-	} v;
-#pragma pack()
-	v.header.type = type;
-	v.header.size = sizeof(v);
-	v.header.time = OS::Timer::getRawTimestamp();
-	v.value = value;
-
-	MT::CriticalSectionLock lock(ctx.mutex);
-	u8* buf = ctx.buffer.begin();
-	const int buf_size = ctx.buffer.size();
-
-	while (sizeof(v) + ctx.end - ctx.begin > buf_size) {
-		const u8 size = buf[ctx.begin % buf_size];
-		ctx.begin += size;
-	}
-
-	const u32 lend = ctx.end % buf_size;
-	if (buf_size - lend >= sizeof(v)) {
-		memcpy(buf + lend, &v, sizeof(v));
-	}
-	else {
-		memcpy(buf + lend, &v, buf_size - lend);
-		memcpy(buf, ((u8*)&v) + buf_size - lend, sizeof(v) - (buf_size - lend));
-	}
-
-	ctx.end += sizeof(v);
+	write(ctx, OS::Timer::getRawTimestamp(), type, value);
 };
 
 
@@ -265,31 +300,57 @@ void write(ThreadContext& ctx, EventType type, const u8* data, int size)
 	header.size = u16(sizeof(header) + size);
 	header.time = OS::Timer::getRawTimestamp();
 
+	reserve(ctx, header.size);
+	const u32 end = ctx.end;
+	copyToRing(ctx, end, &header, sizeof(header));
+	copyToRing(ctx, end + sizeof(header), data, size);
+	writeBarrier();
+	ctx.end = end + header.size;
+};
+
+
+// global context is shared by several threads (render, trace, main)
+template <typename T>
+void writeGlobal(EventType type, const T& value)
+{
+	ThreadContext& ctx = g_instance.global_context;
 	MT::CriticalSectionLock lock(ctx.mutex);
-	u8* buf = ctx.buffer.begin();
-	const u32 buf_size = ctx.buffer.size();
+	write(ctx, type, value);
+}
 
-	while (header.size + ctx.end - ctx.begin > buf_size) {
-		const u8 size = buf[ctx.begin % buf_size];
-		ctx.begin += size;
-	}
 
-	auto cpy = [&](const u8* ptr, u32 size) {
-		const u32 lend = ctx.end % buf_size;
-		if (buf_size - lend >= size) {
-			memcpy(buf + lend, ptr, size);
-		}
-		else {
-			memcpy(buf + lend, ptr, buf_size - lend);
-			memcpy(buf, ((u8*)ptr) + buf_size - lend, size - (buf_size - lend));
-		}
+// called by readers, copies events which are not being overwritten
+static void takeSnapshot(ThreadContext& ctx)
+{
+	const u32 end = ctx.end;
+	if (end == ctx.snapshot_end && !ctx.snapshot.empty()) return;
 
-		ctx.end += size;
-	};
+	const u32 buf_size = ctx.buffer.size();
+	if (ctx.snapshot.size() != (int)buf_size) ctx.snapshot.resize(buf_size);
+
+	MT::memoryBarrier();
+	const u32 begin = ctx.begin;
+	MT::memoryBarrier();
+
+	// copy with the same offsets, so the snapshot is parsed exactly as the ring
+	const u8* src = ctx.buffer.begin();
+	u8* dst = ctx.snapshot.begin();
+	const u32 size = end - begin;
+	const u32 l = begin % buf_size;
+	if (buf_size - l >= size) {
+		memcpy(dst + l, src + l, size);
+	}
+	else {
+		memcpy(dst + l, src + l, buf_size - l);
+		memcpy(dst, src, size - (buf_size - l));
+	}
 
-	cpy((u8*)&header, sizeof(header));
-	cpy(data, size);
-};
+	MT::memoryBarrier();
+	// anything before the current begin could have been overwritten while we were copying
+	const u32 new_begin = ctx.begin;
+	ctx.snapshot_begin = new_begin - begin > size ? end : new_begin;
+	ctx.snapshot_end = end;
+}
 
 #ifdef _WIN32
 	TraceTask::TraceTask(IAllocator& allocator)
@@ -313,6 +374,7 @@ void write(ThreadContext& ctx, EventType type, const u8* data, int size)
 		rec.new_thread_id = cs->NewThreadId;
 		rec.old_thread_id = cs->OldThreadId;
 		rec.reason = cs->OldThreadWaitReason;
+		MT::CriticalSectionLock lock(g_instance.global_context.mutex);
 		write(g_instance.global_context, rec.timestamp, Profiler::EventType::CONTEXT_SWITCH, rec);
 	};
 #endif
@@ -357,7 +419,7 @@ void beginGPUBlock(const char* name, u64 timestamp, i64 profiler_link)
 	data.timestamp = timestamp;
 	copyString(data.name, name);
 	data.profiler_link = profiler_link;
-	write(g_instance.global_context, EventType::BEGIN_GPU_BLOCK, data);
+	writeGlobal(EventType::BEGIN_GPU_BLOCK, data);
 }
 
 void gpuMemStats(u64 total, u64 current, u64 dedicated) {
@@ -365,12 +427,12 @@ void gpuMemStats(u64 total, u64 current, u64 dedicated) {
 	data.total = total;
 	data.current = current;
 	data.dedicated = dedicated;
-	write(g_instance.global_context, EventType::GPU_MEM_STATS, data);
+	writeGlobal(EventType::GPU_MEM_STATS, data);
 }
 
 void endGPUBlock(u64 timestamp)
 {
-	write(g_instance.global_context, EventType::END_GPU_BLOCK, timestamp);
+	writeGlobal(EventType::END_GPU_BLOCK, timestamp);
 }
 
 
@@ -390,8 +452,7 @@ void link(i64 link)
 
 void gpuFrame()
 {
-	write(g_instance.global_context, EventType::GPU_FRAME, (int)0);
-
+	writeGlobal(EventType::GPU_FRAME, (int)0);
 }
 
 
@@ -487,7 +548,7 @@ void frame()
 		g_instance.last_frame_duration = n - g_instance.last_frame_time;
 	}
 	g_instance.last_frame_time = n;
-	write(g_instance.global_context, EventType::FRAME, 0);
+	writeGlobal(EventType::FRAME, 0);
 }
 
 
@@ -543,12 +604,13 @@ ThreadState::ThreadState(GlobalState& reader, int thread_idx)
 	++reader.local_readers_count;
 	ThreadContext& ctx = thread_idx >= 0 ? *g_instance.contexts[thread_idx] : g_instance.global_context;
 
-	ctx.mutex.enter();
-	buffer = ctx.buffer.begin();
-	buffer_size = ctx.buffer.size();
-	begin = ctx.begin;
-	end = ctx.end;
+	takeSnapshot(ctx);
+	buffer = ctx.snapshot.begin();
+	buffer_size = ctx.snapshot.size();
+	begin = ctx.snapshot_begin;
+	end = ctx.snapshot_end;
 	thread_id = ctx.thread_id;
+	MT::CriticalSectionLock lock(ctx.mutex);
 	name = ctx.name;
 	show = ctx.show_in_profiler;
 }
@@ -557,12 +619,352 @@ ThreadState::ThreadState(GlobalState& reader, int thread_idx)
 ThreadState::~ThreadState()
 {
 	ThreadContext& ctx = thread_idx >= 0 ? *g_instance.contexts[thread_idx] : g_instance.global_context;
+	MT::CriticalSectionLock lock(ctx.mutex);
 	ctx.show_in_profiler = show;
-	ctx.mutex.exit();
 	--reader.local_readers_count;
 }
 
 
+// Continuously drains all rings into a Chrome trace event json file, so traces longer
+// than what fits in the rings can be inspected in chrome://tracing or ui.perfetto.dev
+struct CaptureTask : MT::Task
+{
+	// GPU blocks go to their own track, with CPU time of when their results were read
+	static const u32 GPU_TID = 0;
+	static const u32 FLUSH_SIZE = 64 * 1024;
+
+	struct Source
+	{
+		ThreadContext* ctx;
+		u32 pos;
+		bool named;
+	};
+
+	CaptureTask(IAllocator& allocator)
+		: MT::Task(allocator)
+		, sources(allocator)
+		, scratch(allocator)
+		, out(allocator)
+	{}
+
+
+	bool open(const char* path)
+	{
+		if (!file.open(path)) return false;
+
+		start_time = OS::Timer::getRawTimestamp();
+		sources.push({&g_instance.global_context, g_instance.global_context.end, true});
+		MT::CriticalSectionLock lock(g_instance.contexts_mutex);
+		for (ThreadContext* ctx : g_instance.contexts) {
+			// skip what is already in the ring, it's from before the capture started
+			sources.push({ctx, ctx->end, false});
+		}
+		out << "{\"traceEvents\":[\n";
+		out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":" << GPU_TID << ",\"args\":{\"name\":\"GPU\"}}";
+		return true;
+	}
+
+
+	void addNewSources()
+	{
+		MT::CriticalSectionLock lock(g_instance.contexts_mutex);
+		for (int i = sources.size() - 1; i < g_instance.contexts.size(); ++i) {
+			// new thread, everything in its ring is from after the capture started
+			sources.push({g_instance.contexts[i], 0, false});
+		}
+	}
+
+
+	void writeString(const char* str)
+	{
+		out << "\"";
+		for (const char* c = str; *c; ++c) {
+			if (*c == '"' || *c == '\\') {
+				out.write('\\');
+				out.write(*c);
+			}
+			else if ((u8)*c < 0x20) {
+				out.write(' ');
+			}
+			else {
+				out.write(*c);
+			}
+		}
+		out << "\"";
+	}
+
+
+	// opens json object of the event, caller writes args if any and closes it
+	void beginEvent(const char* ph, u32 tid, u64 time)
+	{
+		const double ts = double(time - start_time) * 1e6 / frequency();
+		char tmp[40];
+		toCString(ts, Span(tmp), 3);
+		out << ",\n{\"ph\":\"" << ph << "\",\"pid\":0,\"tid\":" << tid << ",\"ts\":" << tmp;
+	}
+
+
+	void writeEvent(ThreadContext& ctx, const EventHeader& header, const u8* data)
+	{
+		const u32 tid = ctx.thread_id;
+		switch (header.type) {
+			case EventType::BEGIN_BLOCK: {
+				const char* name;
+				memcpy(&name, data, sizeof(name));
+				beginEvent("B", tid, header.time);
+				out << ",\"name\":";
+				writeString(name);
+				out << "}";
+				break;
+			}
+			case EventType::END_BLOCK:
+				beginEvent("E", tid, header.time);
+				out << "}";
+				break;
+			case EventType::FRAME:
+				beginEvent("i", tid, header.time);
+				out << ",\"s\":\"g\",\"name\":\"frame\"}";
+				break;
+			case EventType::STRING:
+				beginEvent("i", tid, header.time);
+				out << ",\"s\":\"t\",\"name\":\"string\",\"args\":{\"value\":";
+				writeString((const char*)data);
+				out << "}}";
+				break;
+			case EventType::INT: {
+				IntRecord r;
+				memcpy(&r, data, sizeof(r));
+				beginEvent("C", tid, header.time);
+				out << ",\"name\":";
+				writeString(r.key);
+				out << ",\"args\":{\"value\":" << r.value << "}}";
+				break;
+			}
+			case EventType::BEGIN_FIBER_WAIT:
+			case EventType::END_FIBER_WAIT: {
+				FiberWaitRecord r;
+				memcpy(&r, data, sizeof(r));
+				beginEvent(header.type == EventType::BEGIN_FIBER_WAIT ? "b" : "e", tid, header.time);
+				out << ",\"cat\":\"fiber\",\"name\":\"fiber wait\",\"id\":" << r.id
+					<< ",\"args\":{\"signal\":" << r.job_system_signal << "}}";
+				break;
+			}
+			case EventType::CONTEXT_SWITCH: {
+				ContextSwitchRecord r;
+				memcpy(&r, data, sizeof(r));
+				beginEvent("i", r.new_thread_id, header.time);
+				out << ",\"s\":\"t\",\"name\":\"context switch\",\"args\":{\"old_thread\":" << r.old_thread_id
+					<< ",\"reason\":" << (i32)r.reason << "}}";
+				break;
+			}
+			case EventType::JOB_INFO: {
+				JobRecord r;
+				memcpy(&r, data, sizeof(r));
+				beginEvent("i", tid, header.time);
+				out << ",\"s\":\"t\",\"name\":\"job\",\"args\":{\"signal_on_finish\":" << r.signal_on_finish
+					<< ",\"precondition\":" << r.precondition << "}}";
+				break;
+			}
+			case EventType::LINK: {
+				i64 link;
+				memcpy(&link, data, sizeof(link));
+				beginEvent("i", tid, header.time);
+				out << ",\"s\":\"t\",\"name\":\"link\",\"args\":{\"id\":" << link << "}}";
+				break;
+			}
+			case EventType::BEGIN_GPU_BLOCK: {
+				GPUBlock r;
+				memcpy(&r, data, sizeof(r));
+				beginEvent("B", GPU_TID, header.time);
+				out << ",\"name\":";
+				writeString(r.name);
+				out << ",\"args\":{\"gpu_timestamp\":" << r.timestamp << ",\"link\":" << r.profiler_link << "}}";
+				break;
+			}
+			case EventType::END_GPU_BLOCK:
+				beginEvent("E", GPU_TID, header.time);
+				out << "}";
+				break;
+			case EventType::GPU_FRAME:
+				beginEvent("i", GPU_TID, header.time);
+				out << ",\"s\":\"t\",\"name\":\"gpu frame\"}";
+				break;
+			case EventType::GPU_MEM_STATS: {
+				GPUMemStatsBlock r;
+				memcpy(&r, data, sizeof(r));
+				beginEvent("C", GPU_TID, header.time);
+				out << ",\"name\":\"GPU memory\",\"args\":{\"total\":" << r.total << ",\"current\":" << r.current
+					<< ",\"dedicated\":" << r.dedicated << "}}";
+				break;
+			}
+			// chrome trace has only a fixed palette
+			case EventType::BLOCK_COLOR: break;
+		}
+	}
+
+
+	// same as takeSnapshot, but from where the previous drain ended
+	void drain(Source& src)
+	{
+		ThreadContext& ctx = *src.ctx;
+		if (!src.named) {
+			MT::CriticalSectionLock lock(ctx.mutex);
+			if (ctx.name.data[0]) {
+				out << ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":" << ctx.thread_id << ",\"args\":{\"name\":";
+				writeString(ctx.name);
+				out << "}}";
+				src.named = true;
+			}
+		}
+
+		const u32 end = ctx.end;
+		MT::memoryBarrier();
+		const u32 begin = ctx.begin;
+		MT::memoryBarrier();
+		if (src.pos - begin > end - begin) {
+			// writer was faster than us
+			dropped += begin - src.pos;
+			src.pos = begin;
+		}
+		const u32 size = end - src.pos;
+		if (size == 0) return;
+
+		const u32 buf_size = ctx.buffer.size();
+		scratch.resize(size);
+		const u8* buf = ctx.buffer.begin();
+		const u32 l = src.pos % buf_size;
+		if (buf_size - l >= size) {
+			memcpy(scratch.begin(), buf + l, size);
+		}
+		else {
+			memcpy(scratch.begin(), buf + l, buf_size - l);
+			memcpy(scratch.begin() + buf_size - l, buf, size - (buf_size - l));
+		}
+		MT::memoryBarrier();
+		u32 offset = 0;
+		const u32 new_begin = ctx.begin;
+		if (new_begin - src.pos <= size && new_begin != src.pos) {
+			offset = new_begin - src.pos;
+			dropped += offset;
+		}
+		else if (new_begin - src.pos > size) {
+			dropped += size;
+			offset = size;
+		}
+		src.pos = end;
+
+		while (offset < size) {
+			EventHeader header;
+			memcpy(&header, scratch.begin() + offset, sizeof(header));
+			if (header.size == 0) break;
+			if (header.time >= start_time) writeEvent(ctx, header, scratch.begin() + offset + sizeof(header));
+			offset += header.size;
+		}
+	}
+
+
+	void flush()
+	{
+		if (out.empty()) return;
+		file.write(out.getData(), out.getPos());
+		out.clear();
+	}
+
+
+	int task() override
+	{
+		for (;;) {
+			const bool is_last = finished;
+			MT::memoryBarrier();
+			addNewSources();
+			for (Source& src : sources) {
+				drain(src);
+				if (out.getPos() > FLUSH_SIZE) flush();
+			}
+			flush();
+			if (is_last) break;
+			MT::sleep(5);
+		}
+		out << "\n]}\n";
+		flush();
+		file.close();
+		if (dropped > 0) {
+			logWarning("Engine") << "Profiler capture dropped " << dropped << " bytes of events, rings were overwritten before they were drained.";
+		}
+		return 0;
+	}
+
+
+	Array<Source> sources;
+	Array<u8> scratch;
+	OutputMemoryStream out;
+	OS::OutputFile file;
+	u64 start_time = 0;
+	u64 dropped = 0;
+	volatile bool finished = false;
+};
+
+
+bool startCapture(const char* path)
+{
+	if (g_instance.capture) return false;
+
+	CaptureTask* capture = LUMIX_NEW(g_instance.allocator, CaptureTask)(g_instance.allocator);
+	if (!capture->open(path)) {
+		logError("Engine") << "Failed to create " << path;
+		LUMIX_DELETE(g_instance.allocator, capture);
+		return false;
+	}
+	if (!capture->create("Profiler capture", true)) {
+		capture->file.close();
+		LUMIX_DELETE(g_instance.allocator, capture);
+		return false;
+	}
+	g_instance.capture = capture;
+	return true;
+}
+
+
+void stopCapture()
+{
+	CaptureTask* capture = g_instance.capture;
+	if (!capture) return;
+
+	capture->finished = true;
+	capture->destroy();
+	LUMIX_DELETE(g_instance.allocator, capture);
+	g_instance.capture = nullptr;
+}
+
+
+bool isCapturing()
+{
+	return g_instance.capture != nullptr;
+}
+
+
+float getEventOverhead()
+{
+	static float overhead = -1;
+	if (overhead >= 0 || g_instance.paused) return overhead;
+
+	// same path as beginBlock/endBlock, but into a scratch context, so the real ones are not spammed
+	static const int PAIRS_COUNT = 1 << 16;
+	ThreadContext ctx(g_instance.allocator);
+	const char* name = "overhead";
+	const u64 start = OS::Timer::getRawTimestamp();
+	for (int i = 0; i < PAIRS_COUNT; ++i) {
+		ctx.open_blocks.push(name);
+		write(ctx, EventType::BEGIN_BLOCK, name);
+		ctx.open_blocks.pop();
+		write(ctx, EventType::END_BLOCK, 0);
+	}
+	const u64 duration = OS::Timer::getRawTimestamp() - start;
+	overhead = float(duration * 1e9 / frequency() / (PAIRS_COUNT * 2));
+	return overhead;
+}
+
+
 void pause(bool paused)
 {
 	g_instance.paused = paused;
@@ -44,6 +44,12 @@ LUMIX_ENGINE_API FiberSwitchData beginFiberWait(u32 job_system_signal);
 LUMIX_ENGINE_API void endFiberWait(u32 job_system_signal, const FiberSwitchData& switch_data);
 LUMIX_ENGINE_API float getLastFrameDuration();
 
+// Streams everything recorded to a Chrome trace event json file until stopCapture,
+// so long captures are not limited by the size of per-thread buffers.
+LUMIX_ENGINE_API bool startCapture(const char* path);
+LUMIX_ENGINE_API void stopCapture();
+LUMIX_ENGINE_API bool isCapturing();
+
 struct Scope
 {
 	explicit Scope(const char* name_literal) { beginBlock(name_literal); }
@@ -55,6 +61,8 @@ struct Scope
 
 LUMIX_ENGINE_API bool contextSwitchesEnabled();
 LUMIX_ENGINE_API u64 frequency();
+// average cost of writing one event in nanoseconds, measured on the first call, -1 if paused
+LUMIX_ENGINE_API float getEventOverhead();
 
 struct ContextSwitchRecord
 {
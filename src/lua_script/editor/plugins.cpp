@@ -245,6 +245,80 @@ struct PropertyGridPlugin final : public PropertyGrid::IPlugin
 	};
 
 
+	struct SetLowPriorityCommand final : public IEditorCommand
+	{
+		SetLowPriorityCommand(LuaScriptScene* scene, EntityRef entity, int scr_index, bool low_priority)
+			: scene(scene)
+			, entity(entity)
+			, scr_index(scr_index)
+			, low_priority(low_priority)
+		{
+		}
+
+
+		bool execute() override
+		{
+			scene->setScriptLowPriority(entity, scr_index, low_priority);
+			return true;
+		}
+
+
+		void undo() override
+		{
+			scene->setScriptLowPriority(entity, scr_index, !low_priority);
+		}
+
+
+		const char* getType() override { return "set_script_low_priority"; }
+
+
+		bool merge(IEditorCommand& command) override { return false; }
+
+
+		LuaScriptScene* scene;
+		EntityRef entity;
+		int scr_index;
+		bool low_priority;
+	};
+
+
+	struct SetIsolatedCommand final : public IEditorCommand
+	{
+		SetIsolatedCommand(LuaScriptScene* scene, EntityRef entity, int scr_index, bool isolated)
+			: scene(scene)
+			, entity(entity)
+			, scr_index(scr_index)
+			, isolated(isolated)
+		{
+		}
+
+
+		bool execute() override
+		{
+			scene->setScriptIsolated(entity, scr_index, isolated);
+			return true;
+		}
+
+
+		void undo() override
+		{
+			scene->setScriptIsolated(entity, scr_index, !isolated);
+		}
+
+
+		const char* getType() override { return "set_script_isolated"; }
+
+
+		bool merge(IEditorCommand& command) override { return false; }
+
+
+		LuaScriptScene* scene;
+		EntityRef entity;
+		int scr_index;
+		bool isolated;
+	};
+
+
 	explicit PropertyGridPlugin(StudioApp& app)
 		: m_app(app)
 	{
@@ -351,6 +425,20 @@ struct PropertyGridPlugin final : public PropertyGrid::IPlugin
 					editor.executeCommand(cmd);
 				}
 
+				bool low_priority = scene->isScriptLowPriority(entity, j);
+				if (ImGui::Checkbox("Low priority", &low_priority))
+				{
+					auto* cmd = LUMIX_NEW(allocator, SetLowPriorityCommand)(scene, entity, j, low_priority);
+					editor.executeCommand(cmd);
+				}
+
+				bool isolated = scene->isScriptIsolated(entity, j);
+				if (ImGui::Checkbox("Isolated", &isolated))
+				{
+					auto* cmd = LUMIX_NEW(allocator, SetIsolatedCommand)(scene, entity, j, isolated);
+					editor.executeCommand(cmd);
+				}
+
 				Array<SortedProperty> sorted_props(allocator);
 				getSortedProperties(sorted_props, *scene, entity, j);
 
@@ -766,6 +854,103 @@ struct ConsolePlugin final : public StudioApp::GUIPlugin
 };
 
 
+struct ScriptProfilerPlugin final : public StudioApp::GUIPlugin
+{
+	explicit ScriptProfilerPlugin(StudioApp& app)
+		: m_app(app)
+		, m_profiles(app.getAllocator())
+	{
+		Action* action = LUMIX_NEW(app.getAllocator(), Action)("Script Profiler", "Toggle script profiler", "script_profiler");
+		action->func.bind<&ScriptProfilerPlugin::toggleOpen>(this);
+		action->is_selected.bind<&ScriptProfilerPlugin::isOpen>(this);
+		app.addWindowAction(action);
+	}
+
+	void onSettingsLoaded() override {
+		m_open = m_app.getSettings().getValue("is_script_profiler_open", false);
+	}
+
+	void onBeforeSettingsSaved() override {
+		m_app.getSettings().setValue("is_script_profiler_open", m_open);
+	}
+
+	const char* getName() const override { return "script_profiler"; }
+
+	bool isOpen() const { return m_open; }
+	void toggleOpen() { m_open = !m_open; }
+
+	static int compareProfiles(const void* a, const void* b) {
+		const float a_ms = (*(const LuaScriptScene::ScriptProfile**)a)->avg_ms;
+		const float b_ms = (*(const LuaScriptScene::ScriptProfile**)b)->avg_ms;
+		return a_ms < b_ms ? 1 : (a_ms > b_ms ? -1 : 0);
+	}
+
+	void onWindowGUI() override
+	{
+		if (!m_open) return;
+		if (ImGui::Begin("Script profiler", &m_open))
+		{
+			Universe* universe = m_app.getWorldEditor().getUniverse();
+			auto* scene = universe ? (LuaScriptScene*)universe->getScene(crc32("lua_script")) : nullptr;
+			if (scene) 
+			{
+				float budget = scene->getUpdateBudget();
+				if (ImGui::DragFloat("Update budget (ms)", &budget, 0.1f, 0, FLT_MAX)) scene->setUpdateBudget(budget);
+				float limit = scene->getScriptTimeLimit();
+				if (ImGui::DragFloat("Script time limit (ms)", &limit, 0.1f, 0, FLT_MAX)) scene->setScriptTimeLimit(limit);
+				float timer_budget = scene->getTimerBudget();
+				if (ImGui::DragFloat("Timer budget (ms)", &timer_budget, 0.1f, 0, FLT_MAX)) scene->setTimerBudget(timer_budget);
+
+				m_profiles.clear();
+				for (int i = 0, c = scene->getScriptProfilesCount(); i < c; ++i) 
+				{
+					m_profiles.push(&scene->getScriptProfile(i));
+				}
+				if (!m_profiles.empty()) qsort(m_profiles.begin(), m_profiles.size(), sizeof(m_profiles[0]), &compareProfiles);
+
+				ImGui::Columns(6, "scrprofc");
+				ImGui::Text("Script");
+				ImGui::NextColumn();
+				ImGui::Text("Entity");
+				ImGui::NextColumn();
+				ImGui::Text("Average (ms)");
+				ImGui::NextColumn();
+				ImGui::Text("Last (ms)");
+				ImGui::NextColumn();
+				ImGui::Text("Max (ms)");
+				ImGui::NextColumn();
+				ImGui::Text("Over limit");
+				ImGui::NextColumn();
+				ImGui::Separator();
+				for (const LuaScriptScene::ScriptProfile* profile : m_profiles)
+				{
+					ImGui::Text("%s%s", profile->script->getPath().c_str(), profile->is_low_priority ? " (low priority)" : "");
+					ImGui::NextColumn();
+					const char* name = universe->getEntityName(profile->entity);
+					if (name && name[0]) ImGui::Text("%s", name);
+					else ImGui::Text("%d", profile->entity.index);
+					ImGui::NextColumn();
+					ImGui::Text("%.3f", profile->avg_ms);
+					ImGui::NextColumn();
+					ImGui::Text("%.3f", profile->last_ms);
+					ImGui::NextColumn();
+					ImGui::Text("%.3f", profile->max_ms);
+					ImGui::NextColumn();
+					ImGui::Text("%u", profile->over_limit_count);
+					ImGui::NextColumn();
+				}
+				ImGui::Columns(1);
+			}
+		}
+		ImGui::End();
+	}
+
+	StudioApp& m_app;
+	Array<const LuaScriptScene::ScriptProfile*> m_profiles;
+	bool m_open = false;
+};
+
+
 struct AddComponentPlugin final : public StudioApp::IAddComponentPlugin
 {
 	explicit AddComponentPlugin(StudioApp& _app)
@@ -909,6 +1094,9 @@ struct StudioAppPlugin : StudioApp::IPlugin
 
 		m_console_plugin = LUMIX_NEW(allocator, ConsolePlugin)(m_app);
 		m_app.addPlugin(*m_console_plugin);
+
+		m_profiler_plugin = LUMIX_NEW(allocator, ScriptProfilerPlugin)(m_app);
+		m_app.addPlugin(*m_profiler_plugin);
 	}
 
 
@@ -928,6 +1116,9 @@ struct StudioAppPlugin : StudioApp::IPlugin
 
 		m_app.removePlugin(*m_console_plugin);
 		LUMIX_DELETE(allocator, m_console_plugin);
+
+		m_app.removePlugin(*m_profiler_plugin);
+		LUMIX_DELETE(allocator, m_profiler_plugin);
 	}
 
 
@@ -937,6 +1128,7 @@ struct StudioAppPlugin : StudioApp::IPlugin
 	PropertyGridPlugin* m_prop_grid_plugin;
 	AssetPlugin* m_asset_plugin;
 	ConsolePlugin* m_console_plugin;
+	ScriptProfilerPlugin* m_profiler_plugin;
 };
 
 
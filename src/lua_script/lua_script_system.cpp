@@ -12,6 +12,9 @@
 #include "engine/iplugin.h"
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
+#include "engine/mt/atomic.h"
+#include "engine/job_system.h"
+#include "engine/os.h"
 #include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
@@ -27,6 +30,14 @@ namespace Lumix
 
 
 	static const ComponentType LUA_SCRIPT_TYPE = Reflection::getComponentType("lua_script");
+	// low priority updates are not deferred longer than this, in seconds
+	static const float MAX_DEFERRED_TIME = 0.5f;
+#ifdef LUMIX_DEBUG
+	// the count hook stops LuaJIT trace recording, so running updates are aborted only in debug builds
+	static const int TIME_LIMIT_HOOK_INSTRUCTIONS = 1000;
+	// raw timestamp after which the running update is aborted, see setScriptTimeLimit
+	static u64 s_update_deadline = 0;
+#endif
 
 
 	enum class LuaSceneVersion : int
@@ -58,6 +69,142 @@ namespace Lumix
 	};
 
 
+	static void convertPropertyToLuaName(const char* src, Span<char> out)
+	{
+		const u32 max_size = out.length();
+		ASSERT(max_size > 0);
+		bool to_upper = true;
+		char* dest = out.begin();
+		while (*src && dest - out.begin() < max_size - 1)
+		{
+			if (isLetter(*src))
+			{
+				*dest = to_upper && !isUpperCase(*src) ? *src - 'a' + 'A' : *src;
+				to_upper = false;
+				++dest;
+			}
+			else if (isNumeric(*src))
+			{
+				*dest = *src;
+				++dest;
+			}
+			else
+			{
+				to_upper = true;
+			}
+			++src;
+		}
+		*dest = 0;
+	}
+
+
+	// property of a component type resolved by its lua name, so scripts do not visit all properties on every access
+	struct PropertyAccessor
+	{
+		explicit PropertyAccessor(IAllocator& allocator) : prop_name(allocator) {}
+
+		ComponentType cmp_type;
+		// full name as used by scripts, names of any length must hit the cache
+		String prop_name;
+		// accessors with the same cache key
+		PropertyAccessor* next = nullptr;
+		const Reflection::PropertyBase* prop = nullptr;
+		void (*push)(lua_State* L, const Reflection::PropertyBase& prop, ComponentUID cmp);
+		void (*set)(lua_State* L, int value_idx, const Reflection::PropertyBase& prop, ComponentUID cmp);
+	};
+
+
+	template <typename T>
+	static void pushPropertyValue(lua_State* L, const Reflection::PropertyBase& prop, ComponentUID cmp)
+	{
+		T val;
+		OutputMemoryStream blob(&val, sizeof(val));
+		prop.getValue(cmp, -1, blob);
+		LuaWrapper::push(L, val);
+	}
+
+
+	template <int MAX_SIZE>
+	static void pushPropertyString(lua_State* L, const Reflection::PropertyBase& prop, ComponentUID cmp)
+	{
+		char tmp[MAX_SIZE];
+		OutputMemoryStream blob(tmp, sizeof(tmp));
+		prop.getValue(cmp, -1, blob);
+		LuaWrapper::push(L, (const char*)tmp);
+	}
+
+
+	template <typename T>
+	static void setPropertyValue(lua_State* L, int value_idx, const Reflection::PropertyBase& prop, ComponentUID cmp)
+	{
+		const T val = LuaWrapper::toType<T>(L, value_idx);
+		InputMemoryStream blob(&val, sizeof(val));
+		prop.setValue(cmp, -1, blob);
+	}
+
+
+	static void setPropertyString(lua_State* L, int value_idx, const Reflection::PropertyBase& prop, ComponentUID cmp)
+	{
+		const char* val = LuaWrapper::toType<const char*>(L, value_idx);
+		InputMemoryStream blob(val, 1 + stringLength(val));
+		prop.setValue(cmp, -1, blob);
+	}
+
+
+	struct PropertyAccessorResolver : Reflection::IPropertyVisitor
+	{
+		explicit PropertyAccessorResolver(IAllocator& allocator) : accessor(allocator) {}
+
+		bool isSameProperty(const char* name) const
+		{
+			char tmp[50];
+			convertPropertyToLuaName(name, Span(tmp));
+			return equalStrings(tmp, prop_name);
+		}
+
+		template <typename T>
+		void resolve(const Reflection::Property<T>& prop)
+		{
+			if (!isSameProperty(prop.name)) return;
+			accessor.prop = &prop;
+			accessor.push = &pushPropertyValue<T>;
+			accessor.set = &setPropertyValue<T>;
+		}
+
+		void visit(const Reflection::Property<float>& prop) override { resolve(prop); }
+		void visit(const Reflection::Property<int>& prop) override { resolve(prop); }
+		void visit(const Reflection::Property<u32>& prop) override { resolve(prop); }
+		void visit(const Reflection::Property<EntityPtr>& prop) override { resolve(prop); }
+		void visit(const Reflection::Property<Vec2>& prop) override { resolve(prop); }
+		void visit(const Reflection::Property<Vec3>& prop) override { resolve(prop); }
+		void visit(const Reflection::Property<IVec3>& prop) override { resolve(prop); }
+		void visit(const Reflection::Property<Vec4>& prop) override { resolve(prop); }
+		void visit(const Reflection::Property<bool>& prop) override { resolve(prop); }
+
+		void visit(const Reflection::Property<Path>& prop) override {
+			if (!isSameProperty(prop.name)) return;
+			accessor.prop = &prop;
+			accessor.push = &pushPropertyString<MAX_PATH_LENGTH>;
+			accessor.set = &setPropertyString;
+		}
+
+		void visit(const Reflection::Property<const char*>& prop) override { 
+			if (!isSameProperty(prop.name)) return;
+			accessor.prop = &prop;
+			accessor.push = &pushPropertyString<1024>;
+			accessor.set = &setPropertyString;
+		}
+
+		void visit(const Reflection::IArrayProperty& prop) override {}
+		void visit(const Reflection::IEnumProperty& prop) override {}
+		void visit(const Reflection::IBlobProperty& prop) override {}
+		void visit(const Reflection::ISampledFuncProperty& prop) override {}
+
+		const char* prop_name;
+		PropertyAccessor accessor;
+	};
+
+
 	class LuaScriptSystemImpl final : public IPlugin
 	{
 	public:
@@ -69,26 +216,368 @@ namespace Lumix
 		const char* getName() const override { return "lua_script"; }
 		LuaScriptManager& getScriptManager() { return m_script_manager; }
 
+		PropertyAccessor* getPropertyAccessor(ComponentType cmp_type, const char* prop_name)
+		{
+			const u64 key = ((u64)cmp_type.index << 32) | crc32(prop_name);
+			auto iter = m_property_accessors.find(key);
+			PropertyAccessor* head = iter.isValid() ? iter.value() : nullptr;
+			for (PropertyAccessor* a = head; a; a = a->next) {
+				if (a->cmp_type == cmp_type && a->prop_name == prop_name) return a;
+			}
+
+			const Reflection::ComponentBase* cmp = Reflection::getComponent(cmp_type);
+			if (!cmp) return nullptr;
+
+			PropertyAccessorResolver resolver(m_allocator);
+			resolver.prop_name = prop_name;
+			resolver.accessor.cmp_type = cmp_type;
+			resolver.accessor.prop_name = prop_name;
+			cmp->visit(resolver);
+			if (!resolver.accessor.prop) return nullptr;
+
+			PropertyAccessor* accessor = LUMIX_NEW(m_allocator, PropertyAccessor)(resolver.accessor);
+			accessor->next = head;
+			if (iter.isValid()) iter.value() = accessor;
+			else m_property_accessors.insert(key, accessor);
+			return accessor;
+		}
+
 		Engine& m_engine;
 		IAllocator& m_allocator;
 		LuaScriptManager m_script_manager;
+		HashMap<u64, PropertyAccessor*> m_property_accessors;
 	};
 
 
-	struct LuaScriptSceneImpl final : public LuaScriptScene
+	// Hierarchical timing wheel. Timers live in a pool and are linked into slots of the level
+	// matching their remaining time, so adding and cancelling is O(1) and a frame only touches
+	// the slots it advances over. Expired timers are queued, the queue is drained by the scene.
+	struct TimerWheel
 	{
-		struct TimerData
+		static constexpr u32 SLOT_BITS = 8;
+		static constexpr u32 SLOTS = 1 << SLOT_BITS;
+		static constexpr u32 LEVELS = 4;
+		static constexpr u32 INVALID = 0xffFFffFF;
+		static constexpr u32 INDEX_BITS = 20;
+		static constexpr u32 INDEX_MASK = (1 << INDEX_BITS) - 1;
+		// handles are returned to lua as int, so generation uses only the remaining 11 bits
+		static constexpr u32 GENERATION_MASK = (1 << 11) - 1;
+		static constexpr float TICKS_PER_SECOND = 1000;
+		static constexpr u64 MAX_TICKS = (u64(1) << (SLOT_BITS * LEVELS)) - 1;
+
+		enum class Status : u8
+		{
+			FREE,
+			SCHEDULED,
+			EXPIRED,
+			CANCELLED
+		};
+
+		struct Timer
+		{
+			u64 expiration;
+			lua_State* state;
+			int func;
+			u32 prev;
+			u32 next;
+			u32 generation;
+			u32 slot;
+			Status status;
+		};
+
+		struct Expired
 		{
-			float time;
 			lua_State* state;
 			int func;
 		};
 
+		explicit TimerWheel(IAllocator& allocator)
+			: m_timers(allocator)
+			, m_expired(allocator)
+		{
+			for (u32& head : m_slots) head = INVALID;
+		}
+
+
+		// takes ownership of func, returns handle or -1 if the pool is full
+		int add(float delay, lua_State* state, int func)
+		{
+			u32 idx = m_free;
+			if (idx != INVALID)
+			{
+				m_free = m_timers[idx].next;
+			}
+			else
+			{
+				if ((u32)m_timers.size() > INDEX_MASK) return -1;
+				idx = m_timers.size();
+				m_timers.emplace().generation = 0;
+			}
+
+			Timer& timer = m_timers[idx];
+			const u64 ticks = delay > 0 ? u64(delay * TICKS_PER_SECOND) : 0;
+			timer.expiration = m_now + minimum(ticks, MAX_TICKS);
+			timer.state = state;
+			timer.func = func;
+			schedule(idx);
+			return int((timer.generation << INDEX_BITS) | idx);
+		}
+
+
+		bool cancel(int handle)
+		{
+			const u32 idx = u32(handle) & INDEX_MASK;
+			if (handle < 0 || idx >= (u32)m_timers.size()) return false;
+			Timer& timer = m_timers[idx];
+			if (timer.generation != u32(handle) >> INDEX_BITS) return false;
+
+			switch (timer.status)
+			{
+				case Status::SCHEDULED:
+					unlink(idx);
+					luaL_unref(timer.state, LUA_REGISTRYINDEX, timer.func);
+					release(idx);
+					return true;
+				case Status::EXPIRED:
+					// still referenced from the expired queue, released when popped
+					luaL_unref(timer.state, LUA_REGISTRYINDEX, timer.func);
+					timer.status = Status::CANCELLED;
+					return true;
+				default: return false;
+			}
+		}
+
+
+		void cancelAll(lua_State* state)
+		{
+			for (u32 i = 0, c = m_timers.size(); i < c; ++i)
+			{
+				const Timer& timer = m_timers[i];
+				if (timer.state != state) continue;
+				if (timer.status != Status::SCHEDULED && timer.status != Status::EXPIRED) continue;
+				cancel(int((timer.generation << INDEX_BITS) | i));
+			}
+		}
+
+
+		void clear()
+		{
+			for (const Timer& timer : m_timers)
+			{
+				if (timer.status == Status::SCHEDULED || timer.status == Status::EXPIRED)
+				{
+					luaL_unref(timer.state, LUA_REGISTRYINDEX, timer.func);
+				}
+			}
+			m_timers.clear();
+			m_expired.clear();
+			m_expired_head = 0;
+			m_free = INVALID;
+			m_scheduled_count = 0;
+			for (u32& head : m_slots) head = INVALID;
+		}
+
+
+		void advance(float time_delta)
+		{
+			m_accumulator += time_delta * TICKS_PER_SECOND;
+			const u64 ticks = u64(m_accumulator);
+			m_accumulator -= ticks;
+
+			if (m_scheduled_count == 0)
+			{
+				m_now += ticks;
+				return;
+			}
+
+			for (u64 i = 0; i < ticks; ++i)
+			{
+				++m_now;
+				for (u32 level = 1; level < LEVELS; ++level)
+				{
+					if ((m_now & ((u64(1) << (SLOT_BITS * level)) - 1)) != 0) break;
+					cascade(level * SLOTS + u32((m_now >> (SLOT_BITS * level)) & (SLOTS - 1)));
+				}
+
+				u32 idx = m_slots[m_now & (SLOTS - 1)];
+				m_slots[m_now & (SLOTS - 1)] = INVALID;
+				while (idx != INVALID)
+				{
+					const u32 next = m_timers[idx].next;
+					m_timers[idx].status = Status::EXPIRED;
+					m_expired.push(idx);
+					--m_scheduled_count;
+					idx = next;
+				}
+				if (m_scheduled_count == 0)
+				{
+					m_now += ticks - i - 1;
+					break;
+				}
+			}
+		}
+
+
+		u32 getExpiredCount() const { return m_expired.size() - m_expired_head; }
+
+
+		// caller owns the returned func and must unref it
+		bool popExpired(Expired& out)
+		{
+			while (m_expired_head < (u32)m_expired.size())
+			{
+				const u32 idx = m_expired[m_expired_head];
+				++m_expired_head;
+				if (m_expired_head == (u32)m_expired.size())
+				{
+					m_expired.clear();
+					m_expired_head = 0;
+				}
+
+				const Timer& timer = m_timers[idx];
+				const bool cancelled = timer.status == Status::CANCELLED;
+				out.state = timer.state;
+				out.func = timer.func;
+				release(idx);
+				if (!cancelled) return true;
+			}
+			return false;
+		}
+
+	private:
+		void schedule(u32 idx)
+		{
+			Timer& timer = m_timers[idx];
+			if (timer.expiration <= m_now)
+			{
+				timer.status = Status::EXPIRED;
+				m_expired.push(idx);
+				return;
+			}
+
+			const u64 delta = timer.expiration - m_now;
+			u32 level = 0;
+			while (level < LEVELS - 1 && delta >= (u64(1) << (SLOT_BITS * (level + 1)))) ++level;
+			const u32 slot = level * SLOTS + u32((timer.expiration >> (SLOT_BITS * level)) & (SLOTS - 1));
+
+			timer.status = Status::SCHEDULED;
+			timer.slot = slot;
+			timer.prev = INVALID;
+			timer.next = m_slots[slot];
+			if (timer.next != INVALID) m_timers[timer.next].prev = idx;
+			m_slots[slot] = idx;
+			++m_scheduled_count;
+		}
+
+
+		void unlink(u32 idx)
+		{
+			Timer& timer = m_timers[idx];
+			if (timer.prev != INVALID) m_timers[timer.prev].next = timer.next;
+			else m_slots[timer.slot] = timer.next;
+			if (timer.next != INVALID) m_timers[timer.next].prev = timer.prev;
+			--m_scheduled_count;
+		}
+
+
+		void cascade(u32 slot)
+		{
+			u32 idx = m_slots[slot];
+			m_slots[slot] = INVALID;
+			while (idx != INVALID)
+			{
+				const u32 next = m_timers[idx].next;
+				--m_scheduled_count;
+				schedule(idx);
+				idx = next;
+			}
+		}
+
+
+		void release(u32 idx)
+		{
+			Timer& timer = m_timers[idx];
+			timer.status = Status::FREE;
+			timer.generation = (timer.generation + 1) & GENERATION_MASK;
+			timer.next = m_free;
+			m_free = idx;
+		}
+
+
+		Array<Timer> m_timers;
+		Array<u32> m_expired;
+		u32 m_expired_head = 0;
+		u32 m_slots[SLOTS * LEVELS];
+		u32 m_free = INVALID;
+		u32 m_scheduled_count = 0;
+		u64 m_now = 0;
+		float m_accumulator = 0;
+	};
+
+
+	struct LuaScriptSceneImpl final : public LuaScriptScene
+	{
 		struct CallbackData
 		{
 			LuaScript* script;
 			lua_State* state;
 			int environment;
+			// registry reference to the callback, resolved when script is started or reloaded
+			int function;
+			ScriptProfile profile;
+			// time of skipped low priority updates, added to the next update's time delta
+			float deferred_time;
+		};
+
+
+		// Engine write recorded by an isolated script, applied on the main thread after all
+		// isolated updates finished, in the order scripts were started and then in the order of recording.
+		struct IsolatedCommand
+		{
+			enum Type : u8
+			{
+				SET_POSITION,
+				SET_ROTATION,
+				SET_SCALE
+			};
+
+			Type type;
+			u32 order; // start sequence of the recording script
+			u32 index; // position in the worker's commands, set when gathered
+			EntityRef entity;
+			DVec3 position;
+			Quat rotation;
+			float scale;
+		};
+
+
+		struct IsolatedUpdate
+		{
+			lua_State* owner; // main thread state of the script instance
+			u32 order;
+			EntityRef entity;
+			int environment;
+			int function;
+		};
+
+
+		// Separate lua state for scripts flagged ISOLATED. Scripts are assigned to workers in the
+		// order they are started, commands are tagged with that order, so the result does not depend
+		// on scheduling nor on the number of workers. Scripts only see the Isolated API and their own state.
+		struct IsolatedWorker
+		{
+			IsolatedWorker(Universe& universe, IAllocator& allocator)
+				: universe(universe)
+				, updates(allocator)
+				, commands(allocator)
+			{
+			}
+
+			Universe& universe;
+			lua_State* state = nullptr;
+			u32 current_order = 0; // order of the script being run, see IsolatedCommand
+			Array<IsolatedUpdate> updates;
+			Array<IsolatedCommand> commands;
 		};
 
 
@@ -96,7 +585,10 @@ namespace Lumix
 		{
 			enum Flags : u32
 			{
-				ENABLED = 1 << 0
+				ENABLED = 1 << 0,
+				LOW_PRIORITY = 1 << 1,
+				// update runs in parallel in a worker lua state, see IsolatedWorker
+				ISOLATED = 1 << 2
 			};
 
 			explicit ScriptInstance(IAllocator& allocator)
@@ -256,29 +748,38 @@ namespace Lumix
 						ASSERT(lua_type(script.m_state, -1) == LUA_TTABLE);
 					}
 
-					bool errors = luaL_loadbuffer(script.m_state,
-						script.m_script->getSourceCode(),
-						stringLength(script.m_script->getSourceCode()),
-						script.m_script->getPath().c_str()) != 0; // [env, func]
-
-					if (errors)
+					const bool is_isolated = script.m_flags.isSet(ScriptInstance::ISOLATED);
+					if (is_isolated)
 					{
-						logError("Lua Script") << script.m_script->getPath() << ": "
-							<< lua_tostring(script.m_state, -1);
-						lua_pop(script.m_state, 1);
-						continue;
+						// top-level code runs only in isolated states, main environment gets just the defaults
+						m_scene.copyIsolatedDefaults(m_entity, script);
 					}
+					else
+					{
+						bool errors = luaL_loadbuffer(script.m_state,
+							script.m_script->getSourceCode(),
+							stringLength(script.m_script->getSourceCode()),
+							script.m_script->getPath().c_str()) != 0; // [env, func]
 
-					lua_pushvalue(script.m_state, -2); // [env, func, env]
-					lua_setfenv(script.m_state, -2);
+						if (errors)
+						{
+							logError("Lua Script") << script.m_script->getPath() << ": "
+								<< lua_tostring(script.m_state, -1);
+							lua_pop(script.m_state, 1);
+							continue;
+						}
 
-					m_scene.m_current_script_instance = &script;
-					errors = errors || lua_pcall(script.m_state, 0, 0, 0) != 0; // [env]
-					if (errors)
-					{
-						logError("Lua Script") << script.m_script->getPath() << ": "
-							<< lua_tostring(script.m_state, -1);
-						lua_pop(script.m_state, 1);
+						lua_pushvalue(script.m_state, -2); // [env, func, env]
+						lua_setfenv(script.m_state, -2);
+
+						m_scene.m_current_script_instance = &script;
+						errors = errors || lua_pcall(script.m_state, 0, 0, 0) != 0; // [env]
+						if (errors)
+						{
+							logError("Lua Script") << script.m_script->getPath() << ": "
+								<< lua_tostring(script.m_state, -1);
+							lua_pop(script.m_state, 1);
+						}
 					}
 					lua_pop(script.m_state, 1); // []
 
@@ -287,6 +788,13 @@ namespace Lumix
 					bool enabled = script.m_flags.isSet(ScriptInstance::ENABLED);
 					m_scene.setEnableProperty(m_entity, scr_index, script, enabled);
 
+					if (is_isolated)
+					{
+						// awake is called in the isolated state, see startIsolatedScript
+						if (m_scene.m_is_game_running) m_scene.startScript(m_entity, script, is_reload);
+						continue;
+					}
+
 					lua_rawgeti(script.m_state, LUA_REGISTRYINDEX, script.m_environment);
 					lua_getfield(script.m_state, -1, "awake");
 					if (lua_type(script.m_state, -1) != LUA_TFUNCTION)
@@ -301,7 +809,7 @@ namespace Lumix
 					}
 					lua_pop(script.m_state, 1);
 
-					if (m_scene.m_is_game_running) m_scene.startScript(script, is_reload);
+					if (m_scene.m_is_game_running) m_scene.startScript(m_entity, script, is_reload);
 				}
 			}
 
@@ -365,7 +873,10 @@ namespace Lumix
 			, m_scripts(system.m_allocator)
 			, m_updates(system.m_allocator)
 			, m_input_handlers(system.m_allocator)
+			, m_batched_input_handlers(system.m_allocator)
 			, m_timers(system.m_allocator)
+			, m_isolated_workers(system.m_allocator)
+			, m_isolated_commands(system.m_allocator)
 			, m_property_names(system.m_allocator)
 			, m_is_game_running(false)
 			, m_is_api_registered(false)
@@ -529,6 +1040,7 @@ namespace Lumix
 				LUMIX_DELETE(m_system.m_allocator, script_cmp);
 			}
 			m_scripts.clear();
+			destroyIsolatedWorkers();
 		}
 
 
@@ -623,155 +1135,24 @@ namespace Lumix
 			return 1;
 		}
 		
-		static void convertPropertyToLuaName(const char* src, Span<char> out)
+		static PropertyAccessor* checkPropertyAccessor(lua_State* L, LuaScriptSystemImpl& system, ComponentType cmp_type, const char* prop_name)
 		{
-			const u32 max_size = out.length();
-			ASSERT(max_size > 0);
-			bool to_upper = true;
-			char* dest = out.begin();
-			while (*src && dest - out.begin() < max_size - 1)
-			{
-				if (isLetter(*src))
-				{
-					*dest = to_upper && !isUpperCase(*src) ? *src - 'a' + 'A' : *src;
-					to_upper = false;
-					++dest;
-				}
-				else if (isNumeric(*src))
-				{
-					*dest = *src;
-					++dest;
-				}
-				else
-				{
-					to_upper = true;
-				}
-				++src;
-			}
-			*dest = 0;
+			PropertyAccessor* accessor = system.getPropertyAccessor(cmp_type, prop_name);
+			if (!accessor) luaL_error(L, "Property `%s` does not exist", prop_name);
+			return accessor;
 		}
 
-		struct LuaPropGetterVisitor  : Reflection::IPropertyVisitor
-		{
-			static bool isSameProperty(const char* name, const char* lua_name) {
-				char tmp[50];
-				convertPropertyToLuaName(name, Span(tmp));
-				return equalStrings(tmp, lua_name);
-			}
-
-			template <typename T>
-			void get(const Reflection::Property<T>& prop)
-			{
-				if (!isSameProperty(prop.name, prop_name)) return;
-				
-				T val;
-				OutputMemoryStream blob(&val, sizeof(val));
-				prop.getValue(cmp, idx, blob);
-				count = 1;
-				LuaWrapper::push(L, val);
-			}
-
-			void visit(const Reflection::Property<float>& prop) override { get(prop); }
-			void visit(const Reflection::Property<int>& prop) override { get(prop); }
-			void visit(const Reflection::Property<u32>& prop) override { get(prop); }
-			void visit(const Reflection::Property<EntityPtr>& prop) override { get(prop); }
-			void visit(const Reflection::Property<Vec2>& prop) override { get(prop); }
-			void visit(const Reflection::Property<Vec3>& prop) override { get(prop); }
-			void visit(const Reflection::Property<IVec3>& prop) override { get(prop); }
-			void visit(const Reflection::Property<Vec4>& prop) override { get(prop); }
-			void visit(const Reflection::Property<bool>& prop) override { get(prop); }
-
-			void visit(const Reflection::Property<Path>& prop) override { 
-				if (!isSameProperty(prop.name, prop_name)) return;
-				
-				char tmp[MAX_PATH_LENGTH];
-				OutputMemoryStream blob(tmp, sizeof(tmp));
-				prop.getValue(cmp, idx, blob);
-				count = 1;
-				LuaWrapper::push(L, tmp);
-			}
-
-			void visit(const Reflection::Property<const char*>& prop) override { 
-				if (!isSameProperty(prop.name, prop_name)) return;
-				
-				char tmp[1024];
-				OutputMemoryStream blob(tmp, sizeof(tmp));
-				prop.getValue(cmp, idx, blob);
-				count = 1;
-				LuaWrapper::push(L, tmp);
-			}
-
-			void visit(const Reflection::IArrayProperty& prop) override {}
-			void visit(const Reflection::IEnumProperty& prop) override {}
-			void visit(const Reflection::IBlobProperty& prop) override {}
-			void visit(const Reflection::ISampledFuncProperty& prop) override {}
-
-			ComponentUID cmp;
-			const char* prop_name;
-			int idx;
-			u32 count = 0;
-			lua_State* L;
-		};
-		
-		struct LuaPropSetterVisitor  : Reflection::IPropertyVisitor
+		static ComponentUID getComponentUID(lua_State* L, ComponentType cmp_type)
 		{
-			bool isSameProperty(const char* name, const char* lua_name) {
-				char tmp[50];
-				convertPropertyToLuaName(name, Span(tmp));
-				if (equalStrings(tmp, lua_name)) {
-					found = true;
-					return true;
-				}
-				return false;
-			}
-
-			template <typename T>
-			void set(const Reflection::Property<T>& prop)
-			{
-				if (!isSameProperty(prop.name, prop_name)) return;
-				
-				const T val = LuaWrapper::toType<T>(L, 3);
-				InputMemoryStream blob(&val, sizeof(val));
-				prop.setValue(cmp, idx, blob);
-			}
-
-			void visit(const Reflection::Property<float>& prop) override { set(prop); }
-			void visit(const Reflection::Property<int>& prop) override { set(prop); }
-			void visit(const Reflection::Property<u32>& prop) override { set(prop); }
-			void visit(const Reflection::Property<EntityPtr>& prop) override { set(prop); }
-			void visit(const Reflection::Property<Vec2>& prop) override { set(prop); }
-			void visit(const Reflection::Property<Vec3>& prop) override { set(prop); }
-			void visit(const Reflection::Property<IVec3>& prop) override { set(prop); }
-			void visit(const Reflection::Property<Vec4>& prop) override { set(prop); }
-			void visit(const Reflection::Property<bool>& prop) override { set(prop); }
-
-			void visit(const Reflection::Property<Path>& prop) override {
-				if (!isSameProperty(prop.name, prop_name)) return;
-				
-				const char* val = LuaWrapper::toType<const char*>(L, 3);
-				InputMemoryStream blob(val, 1 + stringLength(val));
-				prop.setValue(cmp, idx, blob);
-			}
-
-			void visit(const Reflection::Property<const char*>& prop) override { 
-				if (!isSameProperty(prop.name, prop_name)) return;
-				
-				const char* val = LuaWrapper::toType<const char*>(L, 3);
-				InputMemoryStream blob(val, 1 + stringLength(val));
-				prop.setValue(cmp, idx, blob);
-			}
-
-			void visit(const Reflection::IArrayProperty& prop) override {}
-			void visit(const Reflection::IEnumProperty& prop) override {}
-			void visit(const Reflection::IBlobProperty& prop) override {}
-			void visit(const Reflection::ISampledFuncProperty& prop) override {}
-
 			ComponentUID cmp;
-			const char* prop_name;
-			int idx;
-			lua_State* L;
-			bool found = false;
-		};
+			cmp.type = cmp_type;
+			lua_getfield(L, 1, "scene");
+			cmp.scene = LuaWrapper::toType<IScene*>(L, -1);
+			lua_getfield(L, 1, "entity");
+			cmp.entity = LuaWrapper::toType<EntityRef>(L, -1);
+			lua_pop(L, 2);
+			return cmp;
+		}
 
 		static int lua_new_cmp(lua_State* L) {
 			LuaWrapper::DebugGuard guard(L, 1);
@@ -794,51 +1175,115 @@ namespace Lumix
 
 		static int lua_prop_getter(lua_State* L) {
 			LuaWrapper::checkTableArg(L, 1); // self
+			const char* prop_name = LuaWrapper::checkArg<const char*>(L, 2);
+			const ComponentType cmp_type = LuaWrapper::toType<ComponentType>(L, lua_upvalueindex(1));
+			auto* system = LuaWrapper::toType<LuaScriptSystemImpl*>(L, lua_upvalueindex(2));
 
-			LuaPropGetterVisitor v;
-			v.prop_name = LuaWrapper::checkArg<const char*>(L, 2);
-			v.L = L;
-			v.idx = -1;
-			v.cmp.type = LuaWrapper::toType<ComponentType>(L, lua_upvalueindex(1));
-			const Reflection::ComponentBase* cmp = Reflection::getComponent(v.cmp.type);
+			const PropertyAccessor* accessor = checkPropertyAccessor(L, *system, cmp_type, prop_name);
+			accessor->push(L, *accessor->prop, getComponentUID(L, cmp_type));
+			return 1;
+		}
 
-			lua_getfield(L, 1, "scene");
-			v.cmp.scene = LuaWrapper::toType<IScene*>(L, -1);
-			lua_getfield(L, 1, "entity");
-			v.cmp.entity = LuaWrapper::toType<EntityRef>(L, -1);
-			lua_pop(L, 2);
+		static int lua_prop_setter(lua_State* L) {
+			LuaWrapper::checkTableArg(L, 1); // self
+			const char* prop_name = LuaWrapper::checkArg<const char*>(L, 2);
+			const ComponentType cmp_type = LuaWrapper::toType<ComponentType>(L, lua_upvalueindex(1));
+			auto* system = LuaWrapper::toType<LuaScriptSystemImpl*>(L, lua_upvalueindex(2));
 
-			cmp->visit(v);
+			const PropertyAccessor* accessor = checkPropertyAccessor(L, *system, cmp_type, prop_name);
+			accessor->set(L, 3, *accessor->prop, getComponentUID(L, cmp_type));
+			return 0;
+		}
 
-			if (v.count == 0) {
-				luaL_error(L, "Property `%s` does not exist", v.prop_name);
-			}
+		// LuaScript.getPropertyAccessor(cmp_type_name, prop_name) -> accessor, bind once and reuse
+		static int lua_get_property_accessor(lua_State* L) {
+			auto* system = LuaWrapper::toType<LuaScriptSystemImpl*>(L, lua_upvalueindex(1));
+			const char* cmp_name = LuaWrapper::checkArg<const char*>(L, 1);
+			const char* prop_name = LuaWrapper::checkArg<const char*>(L, 2);
+			const ComponentType cmp_type = Reflection::getComponentType(cmp_name);
+			LuaWrapper::push(L, (void*)checkPropertyAccessor(L, *system, cmp_type, prop_name));
+			return 1;
+		}
 
-			return v.count;
+		static IScene* checkScene(lua_State* L, Universe& universe, ComponentType cmp_type)
+		{
+			IScene* scene = universe.getScene(cmp_type);
+			if (!scene) luaL_error(L, "Universe has no scene for component `%s`", Reflection::getComponentTypeID(cmp_type.index));
+			return scene;
 		}
 
-		static int lua_prop_setter(lua_State* L) {
-			LuaWrapper::checkTableArg(L, 1); // self
+		static int lua_bound_property(lua_State* L) {
+			const auto* accessor = LuaWrapper::toType<PropertyAccessor*>(L, lua_upvalueindex(1));
+			ComponentUID cmp;
+			cmp.type = accessor->cmp_type;
+			cmp.scene = LuaWrapper::toType<IScene*>(L, lua_upvalueindex(2));
+			cmp.entity = LuaWrapper::toType<EntityRef>(L, lua_upvalueindex(3));
+			if (lua_gettop(L) == 0) {
+				accessor->push(L, *accessor->prop, cmp);
+				return 1;
+			}
+			accessor->set(L, 1, *accessor->prop, cmp);
+			return 0;
+		}
 
-			LuaPropSetterVisitor v;
-			v.prop_name = LuaWrapper::checkArg<const char*>(L, 2);
-			v.L = L;
-			v.idx = -1;
-			v.cmp.type = LuaWrapper::toType<ComponentType>(L, lua_upvalueindex(1));
-			const Reflection::ComponentBase* cmp = Reflection::getComponent(v.cmp.type);
+		// LuaScript.bindProperty(accessor, universe, entity) -> fn, fn() gets the value, fn(value) sets it
+		static int lua_bind_property(lua_State* L) {
+			auto* accessor = LuaWrapper::checkArg<PropertyAccessor*>(L, 1);
+			auto* universe = LuaWrapper::checkArg<Universe*>(L, 2);
+			const EntityRef entity = LuaWrapper::checkArg<EntityRef>(L, 3);
+			IScene* scene = checkScene(L, *universe, accessor->cmp_type);
 
-			lua_getfield(L, 1, "scene");
-			v.cmp.scene = LuaWrapper::toType<IScene*>(L, -1);
-			lua_getfield(L, 1, "entity");
-			v.cmp.entity = LuaWrapper::toType<EntityRef>(L, -1);
-			lua_pop(L, 2);
+			LuaWrapper::push(L, (void*)accessor);
+			LuaWrapper::push(L, scene);
+			LuaWrapper::push(L, entity);
+			lua_pushcclosure(L, lua_bound_property, 3);
+			return 1;
+		}
 
-			cmp->visit(v);
+		// LuaScript.getProperties(accessor, universe, entities) -> values
+		static int lua_get_properties(lua_State* L) {
+			const auto* accessor = LuaWrapper::checkArg<PropertyAccessor*>(L, 1);
+			auto* universe = LuaWrapper::checkArg<Universe*>(L, 2);
+			LuaWrapper::checkTableArg(L, 3);
 
-			if (!v.found) {
-				luaL_error(L, "Property `%s` does not exist", v.prop_name);
+			ComponentUID cmp;
+			cmp.type = accessor->cmp_type;
+			cmp.scene = checkScene(L, *universe, accessor->cmp_type);
+			const int count = (int)lua_objlen(L, 3);
+			lua_createtable(L, count, 0);
+			for (int i = 1; i <= count; ++i) {
+				lua_rawgeti(L, 3, i);
+				cmp.entity = LuaWrapper::toType<EntityRef>(L, -1);
+				lua_pop(L, 1);
+				accessor->push(L, *accessor->prop, cmp);
+				lua_rawseti(L, -2, i);
 			}
+			return 1;
+		}
+
+		// LuaScript.setProperties(accessor, universe, entities, values), values can be a single value shared by all entities
+		static int lua_set_properties(lua_State* L) {
+			const auto* accessor = LuaWrapper::checkArg<PropertyAccessor*>(L, 1);
+			auto* universe = LuaWrapper::checkArg<Universe*>(L, 2);
+			LuaWrapper::checkTableArg(L, 3);
+			const bool is_shared_value = !lua_istable(L, 4) || lua_objlen(L, 4) == 0;
 
+			ComponentUID cmp;
+			cmp.type = accessor->cmp_type;
+			cmp.scene = checkScene(L, *universe, accessor->cmp_type);
+			for (int i = 1, c = (int)lua_objlen(L, 3); i <= c; ++i) {
+				lua_rawgeti(L, 3, i);
+				cmp.entity = LuaWrapper::toType<EntityRef>(L, -1);
+				lua_pop(L, 1);
+				if (is_shared_value) {
+					accessor->set(L, 4, *accessor->prop, cmp);
+				}
+				else {
+					lua_rawgeti(L, 4, i);
+					accessor->set(L, lua_gettop(L), *accessor->prop, cmp);
+					lua_pop(L, 1);
+				}
+			}
 			return 0;
 		}
 
@@ -863,27 +1308,22 @@ namespace Lumix
 				LuaWrapper::setField(L, -1, "cmp_type", cmp_type.index);
 
 				LuaWrapper::push(L, cmp_type); // [ cmp, cmp_type ]
-				lua_pushcclosure(L, lua_prop_getter, 1); // [ cmp, fn_prop_getter ]
+				lua_pushlightuserdata(L, &m_system); // [ cmp, cmp_type, system ]
+				lua_pushcclosure(L, lua_prop_getter, 2); // [ cmp, fn_prop_getter ]
 				lua_setfield(L, -2, "__index"); // [ cmp ]
 				
 				LuaWrapper::push(L, cmp_type); // [ cmp, cmp_type ]
-				lua_pushcclosure(L, lua_prop_setter, 1); // [ cmp, fn_prop_setter ]
+				lua_pushlightuserdata(L, &m_system); // [ cmp, cmp_type, system ]
+				lua_pushcclosure(L, lua_prop_setter, 2); // [ cmp, fn_prop_setter ]
 				lua_setfield(L, -2, "__newindex"); // [ cmp ]
 
 				lua_pop(L, 1);
 			}
 		}
 
-		void cancelTimer(int timer_func)
+		void cancelTimer(int timer)
 		{
-			for (int i = 0, c = m_timers.size(); i < c; ++i)
-			{
-				if (m_timers[i].func == timer_func)
-				{
-					m_timers.swapAndPop(i);
-					break;
-				}
-			}
+			m_timers.cancel(timer);
 		}
 
 
@@ -892,13 +1332,15 @@ namespace Lumix
 			auto* scene = LuaWrapper::checkArg<LuaScriptSceneImpl*>(L, 1);
 			float time = LuaWrapper::checkArg<float>(L, 2);
 			if (!lua_isfunction(L, 3)) LuaWrapper::argError(L, 3, "function");
-			TimerData& timer = scene->m_timers.emplace();
-			timer.time = time;
-			timer.state = L;
 			lua_pushvalue(L, 3);
-			timer.func = luaL_ref(L, LUA_REGISTRYINDEX);
-			lua_pop(L, 1);
-			LuaWrapper::push(L, timer.func);
+			const int func = luaL_ref(L, LUA_REGISTRYINDEX);
+			const int timer = scene->m_timers.add(time, L, func);
+			if (timer < 0)
+			{
+				luaL_unref(L, LUA_REGISTRYINDEX, func);
+				luaL_error(L, "Too many lua timers");
+			}
+			LuaWrapper::push(L, timer);
 			return 1;
 		}
 
@@ -932,10 +1374,19 @@ namespace Lumix
 			REGISTER_FUNCTION(getScriptCount);
 			REGISTER_FUNCTION(setScriptSource);
 			REGISTER_FUNCTION(cancelTimer);
+			REGISTER_FUNCTION(setScriptLowPriority);
+			REGISTER_FUNCTION(setScriptIsolated);
+			REGISTER_FUNCTION(setUpdateBudget);
+			REGISTER_FUNCTION(setScriptTimeLimit);
+			REGISTER_FUNCTION(setTimerBudget);
 
 			#undef REGISTER_FUNCTION
 
 			LuaWrapper::createSystemFunction(engine_state, "LuaScript", "setTimer", &LuaScriptSceneImpl::setTimer);
+			LuaWrapper::createSystemClosure(engine_state, "LuaScript", &m_system, "getPropertyAccessor", &LuaScriptSceneImpl::lua_get_property_accessor);
+			LuaWrapper::createSystemFunction(engine_state, "LuaScript", "bindProperty", &LuaScriptSceneImpl::lua_bind_property);
+			LuaWrapper::createSystemFunction(engine_state, "LuaScript", "getProperties", &LuaScriptSceneImpl::lua_get_properties);
+			LuaWrapper::createSystemFunction(engine_state, "LuaScript", "setProperties", &LuaScriptSceneImpl::lua_set_properties);
 		}
 
 
@@ -953,142 +1404,510 @@ namespace Lumix
 		}
 
 
-		void applyResourceProperty(ScriptInstance& script, const char* name, Property& prop, const char* value)
+		void applyResourceProperty(ScriptInstance& script, const char* name, Property& prop, const char* value)
+		{
+			lua_rawgeti(script.m_state, LUA_REGISTRYINDEX, script.m_environment);
+			ASSERT(lua_type(script.m_state, -1));
+			lua_getfield(script.m_state, -1, name);
+			int res_idx = LuaWrapper::toType<int>(script.m_state, -1);
+			m_system.m_engine.unloadLuaResource(res_idx);
+			lua_pop(script.m_state, 1);
+
+			int new_res = value[0] ? m_system.m_engine.addLuaResource(Path(value), prop.resource_type) : -1;
+			lua_pushinteger(script.m_state, new_res);
+			lua_setfield(script.m_state, -2, name);
+			lua_pop(script.m_state, 1);
+		}
+
+
+		void applyProperty(ScriptInstance& script, Property& prop, const char* value)
+		{
+			if (!value) return;
+			lua_State* state = script.m_state;
+			if (!state) return;
+			const char* name = getPropertyName(prop.name_hash);
+			if (!name) return;
+
+			if (prop.type == Property::RESOURCE)
+			{
+				applyResourceProperty(script, name, prop, value);
+				return;
+			}
+
+			StaticString<1024> tmp(name, " = ");
+			if (prop.type == Property::STRING) tmp << "\"" << value << "\"";
+			else tmp << value;
+
+			bool errors = luaL_loadbuffer(state, tmp, stringLength(tmp), nullptr) != 0;
+			if (errors)
+			{
+				logError("Lua Script") << script.m_script->getPath() << ": " << lua_tostring(state, -1);
+				lua_pop(state, 1);
+				return;
+			}
+
+			lua_rawgeti(script.m_state, LUA_REGISTRYINDEX, script.m_environment);
+			ASSERT(lua_type(script.m_state, -1) == LUA_TTABLE);
+			lua_setfenv(script.m_state, -2);
+
+			errors = errors || lua_pcall(state, 0, 0, 0) != 0;
+
+			if (errors)
+			{
+				logError("Lua Script") << script.m_script->getPath() << ": " << lua_tostring(state, -1);
+				lua_pop(state, 1);
+			}
+		}
+
+
+		void setPropertyValue(EntityRef entity,
+			int scr_index,
+			const char* name,
+			const char* value) override
+		{
+			auto* script_cmp = m_scripts[entity];
+			if (!script_cmp) return;
+			Property& prop = getScriptProperty(entity, scr_index, name);
+			if (!script_cmp->m_scripts[scr_index].m_state)
+			{
+				prop.stored_value = value;
+				return;
+			}
+
+			applyProperty(script_cmp->m_scripts[scr_index], prop, value);
+		}
+
+
+		const char* getPropertyName(EntityRef entity, int scr_index, int index) const
+		{
+			auto& script = m_scripts[entity]->m_scripts[scr_index];
+
+			return getPropertyName(script.m_properties[index].name_hash);
+		}
+
+
+		int getPropertyCount(EntityRef entity, int scr_index) const
+		{
+			auto& script = m_scripts[entity]->m_scripts[scr_index];
+
+			return script.m_properties.size();
+		}
+
+
+		static void* luaAllocator(void* ud, void* ptr, size_t osize, size_t nsize)
+		{
+			auto& allocator = *static_cast<IAllocator*>(ud);
+			if (nsize == 0)
+			{
+				allocator.deallocate(ptr);
+				return nullptr;
+			}
+			if (ptr == nullptr) return allocator.allocate(nsize);
+
+			void* new_mem = allocator.allocate(nsize);
+			memcpy(new_mem, ptr, minimum(osize, nsize));
+			allocator.deallocate(ptr);
+			return new_mem;
+		}
+
+
+		static IsolatedWorker& getIsolatedWorker(lua_State* L)
+		{
+			return *(IsolatedWorker*)lua_touserdata(L, lua_upvalueindex(1));
+		}
+
+
+		static EntityRef checkIsolatedEntity(lua_State* L, const IsolatedWorker& worker)
+		{
+			const EntityRef entity = {LuaWrapper::checkArg<i32>(L, 1)};
+			if (entity.index < 0 || !worker.universe.hasEntity(entity)) luaL_argerror(L, 1, "invalid entity");
+			return entity;
+		}
+
+
+		static int isolated_getPosition(lua_State* L)
+		{
+			const IsolatedWorker& worker = getIsolatedWorker(L);
+			LuaWrapper::push(L, worker.universe.getPosition(checkIsolatedEntity(L, worker)));
+			return 1;
+		}
+
+
+		static int isolated_getRotation(lua_State* L)
+		{
+			const IsolatedWorker& worker = getIsolatedWorker(L);
+			LuaWrapper::push(L, worker.universe.getRotation(checkIsolatedEntity(L, worker)));
+			return 1;
+		}
+
+
+		static int isolated_getScale(lua_State* L)
+		{
+			const IsolatedWorker& worker = getIsolatedWorker(L);
+			LuaWrapper::push(L, worker.universe.getScale(checkIsolatedEntity(L, worker)));
+			return 1;
+		}
+
+
+		static int isolated_setPosition(lua_State* L)
+		{
+			IsolatedWorker& worker = getIsolatedWorker(L);
+			const EntityRef entity = checkIsolatedEntity(L, worker);
+			const auto value = LuaWrapper::checkArg<DVec3>(L, 2);
+			IsolatedCommand& cmd = worker.commands.emplace();
+			cmd.type = IsolatedCommand::SET_POSITION;
+			cmd.order = worker.current_order;
+			cmd.entity = entity;
+			cmd.position = value;
+			return 0;
+		}
+
+
+		static int isolated_setRotation(lua_State* L)
+		{
+			IsolatedWorker& worker = getIsolatedWorker(L);
+			const EntityRef entity = checkIsolatedEntity(L, worker);
+			const auto value = LuaWrapper::checkArg<Quat>(L, 2);
+			IsolatedCommand& cmd = worker.commands.emplace();
+			cmd.type = IsolatedCommand::SET_ROTATION;
+			cmd.order = worker.current_order;
+			cmd.entity = entity;
+			cmd.rotation = value;
+			return 0;
+		}
+
+
+		static int isolated_setScale(lua_State* L)
+		{
+			IsolatedWorker& worker = getIsolatedWorker(L);
+			const EntityRef entity = checkIsolatedEntity(L, worker);
+			const auto value = LuaWrapper::checkArg<float>(L, 2);
+			IsolatedCommand& cmd = worker.commands.emplace();
+			cmd.type = IsolatedCommand::SET_SCALE;
+			cmd.order = worker.current_order;
+			cmd.entity = entity;
+			cmd.scale = value;
+			return 0;
+		}
+
+
+		void createIsolatedWorkers()
+		{
+			const int count = maximum(1, (int)JobSystem::getWorkersCount());
+			m_isolated_workers.reserve(count);
+			for (int i = 0; i < count; ++i)
+			{
+				IsolatedWorker* worker = LUMIX_NEW(m_system.m_allocator, IsolatedWorker)(m_universe, m_system.m_allocator);
+				m_isolated_workers.push(worker);
+				lua_State* L = lua_newstate(luaAllocator, &m_system.m_allocator);
+				worker->state = L;
+				luaL_openlibs(L);
+
+				lua_newtable(L); // [Isolated]
+				auto reg = [&](const char* name, lua_CFunction f) {
+					lua_pushlightuserdata(L, worker); // [Isolated, worker]
+					lua_pushcclosure(L, f, 1); // [Isolated, f]
+					lua_setfield(L, -2, name); // [Isolated]
+				};
+				reg("getPosition", &LuaScriptSceneImpl::isolated_getPosition);
+				reg("getRotation", &LuaScriptSceneImpl::isolated_getRotation);
+				reg("getScale", &LuaScriptSceneImpl::isolated_getScale);
+				reg("setPosition", &LuaScriptSceneImpl::isolated_setPosition);
+				reg("setRotation", &LuaScriptSceneImpl::isolated_setRotation);
+				reg("setScale", &LuaScriptSceneImpl::isolated_setScale);
+				lua_setglobal(L, "Isolated"); // []
+			}
+		}
+
+
+		void destroyIsolatedWorkers()
+		{
+			for (IsolatedWorker* worker : m_isolated_workers)
+			{
+				lua_close(worker->state);
+				LUMIX_DELETE(m_system.m_allocator, worker);
+			}
+			m_isolated_workers.clear();
+			m_isolated_scripts_count = 0;
+		}
+
+
+		// creates an environment in a worker state and runs the script's top-level code in it,
+		// leaves the environment on the stack on success
+		bool loadIsolatedChunk(lua_State* L, EntityRef entity, ScriptInstance& instance)
+		{
+			lua_newtable(L); // [env]
+			lua_pushvalue(L, -1); // [env, env]
+			lua_setmetatable(L, -2); // [env]
+			lua_pushvalue(L, LUA_GLOBALSINDEX); // [env, _G]
+			lua_setfield(L, -2, "__index"); // [env]
+			LuaWrapper::push(L, entity.index); // [env, this]
+			lua_setfield(L, -2, "this"); // [env]
+
+			const char* src = instance.m_script->getSourceCode();
+			if (luaL_loadbuffer(L, src, stringLength(src), instance.m_script->getPath().c_str()) != 0) // [env, func]
+			{
+				logError("Lua Script") << instance.m_script->getPath() << ": " << lua_tostring(L, -1);
+				lua_pop(L, 2);
+				return false;
+			}
+			lua_pushvalue(L, -2); // [env, func, env]
+			lua_setfenv(L, -2); // [env, func]
+			if (lua_pcall(L, 0, 0, 0) != 0) // [env]
+			{
+				logError("Lua Script") << instance.m_script->getPath() << ": " << lua_tostring(L, -1);
+				lua_pop(L, 2);
+				return false;
+			}
+			return true;
+		}
+
+
+		// runs the top-level code of an isolated script in a worker state and copies the number, boolean
+		// and string globals it defines to the main environment on top of the main stack,
+		// so properties can be detected and edited without running the script in the main state
+		void copyIsolatedDefaults(EntityRef entity, ScriptInstance& instance)
 		{
-			lua_rawgeti(script.m_state, LUA_REGISTRYINDEX, script.m_environment);
-			ASSERT(lua_type(script.m_state, -1));
-			lua_getfield(script.m_state, -1, name);
-			int res_idx = LuaWrapper::toType<int>(script.m_state, -1);
-			m_system.m_engine.unloadLuaResource(res_idx);
-			lua_pop(script.m_state, 1);
+			if (m_isolated_workers.empty()) createIsolatedWorkers();
+			IsolatedWorker& worker = *m_isolated_workers[0];
+			lua_State* L = worker.state;
+			lua_State* main_state = instance.m_state;
+			LuaWrapper::DebugGuard guard(L);
+			const int commands_count = worker.commands.size();
+			if (!loadIsolatedChunk(L, entity, instance)) return;
+			// top-level code must not move entities
+			worker.commands.resize(commands_count);
 
-			int new_res = value[0] ? m_system.m_engine.addLuaResource(Path(value), prop.resource_type) : -1;
-			lua_pushinteger(script.m_state, new_res);
-			lua_setfield(script.m_state, -2, name);
-			lua_pop(script.m_state, 1);
+			lua_pushnil(L); // [env, nil]
+			while (lua_next(L, -2)) // [env, key, value] | [env]
+			{
+				if (lua_type(L, -2) == LUA_TSTRING && !equalStrings(lua_tostring(L, -2), "this"))
+				{
+					bool copy = true;
+					switch (lua_type(L, -1))
+					{
+						case LUA_TNUMBER: lua_pushnumber(main_state, lua_tonumber(L, -1)); break;
+						case LUA_TBOOLEAN: lua_pushboolean(main_state, lua_toboolean(L, -1)); break;
+						case LUA_TSTRING: lua_pushstring(main_state, lua_tostring(L, -1)); break;
+						default: copy = false; break;
+					}
+					if (copy) lua_setfield(main_state, -2, lua_tostring(L, -2));
+				}
+				lua_pop(L, 1); // [env, key]
+			}
+			lua_pop(L, 1); // []
 		}
 
 
-		void applyProperty(ScriptInstance& script, Property& prop, const char* value)
+		// loads the script into a worker state, `this` is the entity index; number, boolean
+		// and string properties are copied from the main environment after the top-level code ran,
+		// so they override the script's defaults
+		void startIsolatedScript(EntityRef entity, ScriptInstance& instance, bool is_restart)
 		{
-			if (!value) return;
-			lua_State* state = script.m_state;
-			if (!state) return;
-			const char* name = getPropertyName(prop.name_hash);
-			if (!name) return;
+			if (m_isolated_workers.empty()) createIsolatedWorkers();
+			const u32 order = m_isolated_scripts_count;
+			IsolatedWorker& worker = *m_isolated_workers[order % m_isolated_workers.size()];
+			++m_isolated_scripts_count;
+			worker.current_order = order;
 
-			if (prop.type == Property::RESOURCE)
+			lua_State* L = worker.state;
+			LuaWrapper::DebugGuard guard(L);
+			if (!loadIsolatedChunk(L, entity, instance)) return; // [env]
+
+			lua_State* main_state = instance.m_state;
+			lua_rawgeti(main_state, LUA_REGISTRYINDEX, instance.m_environment); // [main_env]
+			for (const Property& prop : instance.m_properties)
 			{
-				applyResourceProperty(script, name, prop, value);
-				return;
+				const char* name = getPropertyName(prop.name_hash);
+				if (!name) continue;
+				lua_getfield(main_state, -1, name); // [main_env, value]
+				switch (lua_type(main_state, -1))
+				{
+					case LUA_TNUMBER: lua_pushnumber(L, lua_tonumber(main_state, -1)); break;
+					case LUA_TBOOLEAN: lua_pushboolean(L, lua_toboolean(main_state, -1)); break;
+					case LUA_TSTRING: lua_pushstring(L, lua_tostring(main_state, -1)); break;
+					default: lua_pushnil(L); break;
+				}
+				lua_setfield(L, -2, name); // [env]
+				lua_pop(main_state, 1); // [main_env]
 			}
+			lua_pop(main_state, 1); // []
 
-			StaticString<1024> tmp(name, " = ");
-			if (prop.type == Property::STRING) tmp << "\"" << value << "\"";
-			else tmp << value;
+			if (!is_restart)
+			{
+				static const char* const init_functions[] = { "awake", "start" };
+				for (const char* fn_name : init_functions)
+				{
+					lua_getfield(L, -1, fn_name); // [env, fn]
+					if (lua_type(L, -1) != LUA_TFUNCTION)
+					{
+						lua_pop(L, 1); // [env]
+						continue;
+					}
+					if (lua_pcall(L, 0, 0, 0) != 0) // [env]
+					{
+						logError("Lua Script") << lua_tostring(L, -1);
+						lua_pop(L, 1);
+					}
+				}
+			}
 
-			bool errors = luaL_loadbuffer(state, tmp, stringLength(tmp), nullptr) != 0;
-			if (errors)
+			lua_getfield(L, -1, "update"); // [env, update]
+			if (lua_type(L, -1) != LUA_TFUNCTION)
 			{
-				logError("Lua Script") << script.m_script->getPath() << ": " << lua_tostring(state, -1);
-				lua_pop(state, 1);
+				lua_pop(L, 2);
 				return;
 			}
+			IsolatedUpdate& update = worker.updates.emplace();
+			update.owner = instance.m_state;
+			update.order = order;
+			update.entity = entity;
+			update.function = luaL_ref(L, LUA_REGISTRYINDEX); // [env]
+			update.environment = luaL_ref(L, LUA_REGISTRYINDEX); // []
+		}
 
-			lua_rawgeti(script.m_state, LUA_REGISTRYINDEX, script.m_environment);
-			ASSERT(lua_type(script.m_state, -1) == LUA_TTABLE);
-			lua_setfenv(script.m_state, -2);
-
-			errors = errors || lua_pcall(state, 0, 0, 0) != 0;
 
-			if (errors)
+		void removeIsolatedUpdates(lua_State* owner)
+		{
+			for (IsolatedWorker* worker : m_isolated_workers)
 			{
-				logError("Lua Script") << script.m_script->getPath() << ": " << lua_tostring(state, -1);
-				lua_pop(state, 1);
+				for (int i = worker->updates.size() - 1; i >= 0; --i)
+				{
+					const IsolatedUpdate& update = worker->updates[i];
+					if (update.owner != owner) continue;
+					luaL_unref(worker->state, LUA_REGISTRYINDEX, update.function);
+					luaL_unref(worker->state, LUA_REGISTRYINDEX, update.environment);
+					// keep the order, it defines the order of commands
+					worker->updates.erase(i);
+				}
 			}
 		}
 
 
-		void setPropertyValue(EntityRef entity,
-			int scr_index,
-			const char* name,
-			const char* value) override
+		void updateIsolatedScripts(float time_delta)
 		{
-			auto* script_cmp = m_scripts[entity];
-			if (!script_cmp) return;
-			Property& prop = getScriptProperty(entity, scr_index, name);
-			if (!script_cmp->m_scripts[scr_index].m_state)
+			if (m_isolated_workers.empty()) return;
+
+			PROFILE_FUNCTION();
+			JobSystem::forEach(m_isolated_workers.size(), [&](int idx) {
+				PROFILE_BLOCK("isolated lua scripts");
+				IsolatedWorker& worker = *m_isolated_workers[idx];
+				lua_State* L = worker.state;
+				for (const IsolatedUpdate& update : worker.updates)
+				{
+					worker.current_order = update.order;
+					lua_rawgeti(L, LUA_REGISTRYINDEX, update.function); // [update]
+					LuaWrapper::push(L, time_delta); // [update, time_delta]
+					if (lua_pcall(L, 1, 0, 0) != 0) // []
+					{
+						logError("Lua Script") << lua_tostring(L, -1);
+						lua_pop(L, 1);
+					}
+				}
+			});
+
+			// a script's commands are all in one worker, so (order, index) is a total order
+			m_isolated_commands.clear();
+			for (IsolatedWorker* worker : m_isolated_workers)
 			{
-				prop.stored_value = value;
-				return;
+				for (u32 i = 0, c = worker->commands.size(); i < c; ++i)
+				{
+					IsolatedCommand& cmd = m_isolated_commands.emplace(worker->commands[i]);
+					cmd.index = i;
+				}
+				worker->commands.clear();
 			}
+			qsort(m_isolated_commands.begin(), m_isolated_commands.size(), sizeof(m_isolated_commands[0]), [](const void* a, const void* b) -> int {
+				const IsolatedCommand* cmd_a = (const IsolatedCommand*)a;
+				const IsolatedCommand* cmd_b = (const IsolatedCommand*)b;
+				if (cmd_a->order != cmd_b->order) return cmd_a->order < cmd_b->order ? -1 : 1;
+				if (cmd_a->index != cmd_b->index) return cmd_a->index < cmd_b->index ? -1 : 1;
+				return 0;
+			});
 
-			applyProperty(script_cmp->m_scripts[scr_index], prop, value);
+			for (const IsolatedCommand& cmd : m_isolated_commands)
+			{
+				if (!m_universe.hasEntity(cmd.entity)) continue;
+				switch (cmd.type)
+				{
+					case IsolatedCommand::SET_POSITION: m_universe.setPosition(cmd.entity, cmd.position); break;
+					case IsolatedCommand::SET_ROTATION: m_universe.setRotation(cmd.entity, cmd.rotation); break;
+					case IsolatedCommand::SET_SCALE: m_universe.setScale(cmd.entity, cmd.scale); break;
+				}
+			}
 		}
 
 
-		const char* getPropertyName(EntityRef entity, int scr_index, int index) const
+		void setScriptIsolated(EntityRef entity, int scr_index, bool isolated) override
 		{
-			auto& script = m_scripts[entity]->m_scripts[scr_index];
-
-			return getPropertyName(script.m_properties[index].name_hash);
+			m_scripts[entity]->m_scripts[scr_index].m_flags.set(ScriptInstance::ISOLATED, isolated);
 		}
 
 
-		int getPropertyCount(EntityRef entity, int scr_index) const
+		bool isScriptIsolated(EntityRef entity, int scr_index) const override
 		{
-			auto& script = m_scripts[entity]->m_scripts[scr_index];
-
-			return script.m_properties.size();
+			return m_scripts[entity]->m_scripts[scr_index].m_flags.isSet(ScriptInstance::ISOLATED);
 		}
 
 
-		static void* luaAllocator(void* ud, void* ptr, size_t osize, size_t nsize)
+		void disableScript(ScriptInstance& inst)
 		{
-			auto& allocator = *static_cast<IAllocator*>(ud);
-			if (nsize == 0)
-			{
-				allocator.deallocate(ptr);
-				return nullptr;
-			}
-			if (ptr == nullptr) return allocator.allocate(nsize);
+			m_timers.cancelAll(inst.m_state);
 
-			void* new_mem = allocator.allocate(nsize);
-			memcpy(new_mem, ptr, minimum(osize, nsize));
-			allocator.deallocate(ptr);
-			return new_mem;
+			removeCallback(m_updates, inst.m_state);
+			removeCallback(m_input_handlers, inst.m_state);
+			removeCallback(m_batched_input_handlers, inst.m_state);
+			removeIsolatedUpdates(inst.m_state);
 		}
 
 
-		void disableScript(ScriptInstance& inst)
+		static void removeCallback(Array<CallbackData>& callbacks, lua_State* state)
 		{
-			for (int i = 0; i < m_timers.size(); ++i)
+			for (int i = 0; i < callbacks.size(); ++i)
 			{
-				if (m_timers[i].state == inst.m_state)
+				if (callbacks[i].state == state)
 				{
-					luaL_unref(m_timers[i].state, LUA_REGISTRYINDEX, m_timers[i].func);
-					m_timers.swapAndPop(i);
-					--i;
+					luaL_unref(state, LUA_REGISTRYINDEX, callbacks[i].function);
+					callbacks.swapAndPop(i);
+					break;
 				}
 			}
+		}
 
-			for (int i = 0; i < m_updates.size(); ++i)
+
+		static void clearCallbacks(Array<CallbackData>& callbacks)
+		{
+			for (const CallbackData& cb : callbacks)
 			{
-				if (m_updates[i].state == inst.m_state)
-				{
-					m_updates.swapAndPop(i);
-					break;
-				}
+				luaL_unref(cb.state, LUA_REGISTRYINDEX, cb.function);
 			}
+			callbacks.clear();
+		}
+
 
-			for (int i = 0; i < m_input_handlers.size(); ++i)
+		// expects environment on the top of the stack, leaves the stack untouched
+		static void addCallback(Array<CallbackData>& callbacks, EntityRef entity, ScriptInstance& instance, const char* name)
+		{
+			lua_getfield(instance.m_state, -1, name);
+			if (lua_type(instance.m_state, -1) != LUA_TFUNCTION)
 			{
-				if (m_input_handlers[i].state == inst.m_state)
-				{
-					m_input_handlers.swapAndPop(i);
-					break;
-				}
+				lua_pop(instance.m_state, 1);
+				return;
 			}
+
+			auto& callback = callbacks.emplace();
+			callback.script = instance.m_script;
+			callback.state = instance.m_state;
+			callback.environment = instance.m_environment;
+			callback.function = luaL_ref(instance.m_state, LUA_REGISTRYINDEX);
+			callback.deferred_time = 0;
+			callback.profile.entity = entity;
+			callback.profile.script = instance.m_script;
+			callback.profile.last_ms = 0;
+			callback.profile.avg_ms = 0;
+			callback.profile.max_ms = 0;
+			callback.profile.over_limit_count = 0;
+			callback.profile.is_low_priority = instance.m_flags.isSet(ScriptInstance::LOW_PRIORITY);
 		}
 
 
@@ -1140,7 +1959,7 @@ namespace Lumix
 		}
 
 
-		void startScript(ScriptInstance& instance, bool is_restart)
+		void startScript(EntityRef entity, ScriptInstance& instance, bool is_restart)
 		{
 			if (!instance.m_flags.isSet(ScriptInstance::ENABLED)) return;
 			if (!instance.m_state) return;
@@ -1154,24 +1973,15 @@ namespace Lumix
 				lua_pop(instance.m_state, 1);
 				return;
 			}
-			lua_getfield(instance.m_state, -1, "update");
-			if (lua_type(instance.m_state, -1) == LUA_TFUNCTION)
-			{
-				auto& update_data = m_updates.emplace();
-				update_data.script = instance.m_script;
-				update_data.state = instance.m_state;
-				update_data.environment = instance.m_environment;
-			}
-			lua_pop(instance.m_state, 1);
-			lua_getfield(instance.m_state, -1, "onInputEvent");
-			if (lua_type(instance.m_state, -1) == LUA_TFUNCTION)
+			if (instance.m_flags.isSet(ScriptInstance::ISOLATED))
 			{
-				auto& callback = m_input_handlers.emplace();
-				callback.script = instance.m_script;
-				callback.state = instance.m_state;
-				callback.environment = instance.m_environment;
+				lua_pop(instance.m_state, 1);
+				startIsolatedScript(entity, instance, is_restart);
+				return;
 			}
-			lua_pop(instance.m_state, 1);
+			addCallback(m_updates, entity, instance, "update");
+			addCallback(m_input_handlers, entity, instance, "onInputEvent");
+			addCallback(m_batched_input_handlers, entity, instance, "onInputEvents");
 
 			if (!is_restart)
 			{
@@ -1234,8 +2044,16 @@ namespace Lumix
 			m_gui_scene = nullptr;
 			m_scripts_start_called = false;
 			m_is_game_running = false;
-			m_updates.clear();
-			m_input_handlers.clear();
+			clearCallbacks(m_updates);
+			clearCallbacks(m_input_handlers);
+			clearCallbacks(m_batched_input_handlers);
+			lua_State* L = m_system.m_engine.getState();
+			luaL_unref(L, LUA_REGISTRYINDEX, m_input_event_pool);
+			luaL_unref(L, LUA_REGISTRYINDEX, m_input_events);
+			m_input_event_pool = LUA_NOREF;
+			m_input_events = LUA_NOREF;
+			m_input_events_count = 0;
+			destroyIsolatedWorkers();
 			m_timers.clear();
 			m_animation_scene = nullptr;
 		}
@@ -1451,7 +2269,7 @@ namespace Lumix
 					if (!instance.m_script->isReady()) continue;
 					if (!instance.m_flags.isSet(ScriptInstance::ENABLED)) continue;
 
-					startScript(instance, false);
+					startScript(scr->m_entity, instance, false);
 				}
 			}
 			m_scripts_start_called = true;
@@ -1460,167 +2278,301 @@ namespace Lumix
 
 		void updateTimers(float time_delta)
 		{
-			int timers_to_remove[1024];
-			u32 timers_to_remove_count = 0;
-			for (int i = 0, c = m_timers.size(); i < c; ++i)
+			PROFILE_FUNCTION();
+			m_timers.advance(time_delta);
+
+			// timers expired or set by callbacks during this call are fired in the next frame
+			const u64 budget = u64(m_timer_budget * OS::Timer::getFrequency() / 1000);
+			const u64 start = OS::Timer::getRawTimestamp();
+			for (u32 count = m_timers.getExpiredCount(); count > 0; --count)
 			{
-				auto& timer = m_timers[i];
-				timer.time -= time_delta;
-				if (timer.time < 0)
-				{
-					lua_rawgeti(timer.state, LUA_REGISTRYINDEX, timer.func);
-					if (lua_type(timer.state, -1) != LUA_TFUNCTION)
-					{
-						ASSERT(false);
-					}
+				if (budget > 0 && OS::Timer::getRawTimestamp() - start > budget) break;
 
-					if (lua_pcall(timer.state, 0, 0, 0) != 0)
-					{
-						logError("Lua Script") << lua_tostring(timer.state, -1);
-						lua_pop(timer.state, 1);
-					}
-					timers_to_remove[timers_to_remove_count] = i;
-					++timers_to_remove_count;
-					if (timers_to_remove_count >= lengthOf(timers_to_remove))
-					{
-						logError("Lua Script") << "Too many lua timers in one frame, some are not executed";
-						break;
-					}
+				TimerWheel::Expired timer;
+				if (!m_timers.popExpired(timer)) break;
+
+				lua_rawgeti(timer.state, LUA_REGISTRYINDEX, timer.func);
+				ASSERT(lua_type(timer.state, -1) == LUA_TFUNCTION);
+				if (lua_pcall(timer.state, 0, 0, 0) != 0)
+				{
+					logError("Lua Script") << lua_tostring(timer.state, -1);
+					lua_pop(timer.state, 1);
 				}
-			}
-			for (u32 i = timers_to_remove_count - 1; i != 0xffFFffFF; --i)
-			{
-				auto& timer = m_timers[timers_to_remove[i]];
 				luaL_unref(timer.state, LUA_REGISTRYINDEX, timer.func);
-				m_timers.swapAndPop(timers_to_remove[i]);
 			}
+			Profiler::pushInt("deferred timers", m_timers.getExpiredCount());
 		}
 
 
-		void processInputEvent(const CallbackData& callback, const InputSystem::Event& event)
+		static void setInputEventField(lua_State* L, const char* name, bool is_set, float value)
+		{
+			if (is_set) LuaWrapper::push(L, value);
+			else lua_pushnil(L);
+			lua_setfield(L, -2, name);
+		}
+
+
+		// fills pooled table at the top of the stack, fields of other event types are cleared
+		static void fillInputEvent(lua_State* L, const InputSystem::Event& event)
 		{
-			lua_State* L = callback.state;
-			lua_newtable(L); // [lua_event]
 			LuaWrapper::push(L, (u32)event.type); // [lua_event, event.type]
 			lua_setfield(L, -2, "type"); // [lua_event]
 
-			lua_newtable(L); // [lua_event, lua_device]
+			lua_getfield(L, -1, "device"); // [lua_event, lua_device]
 			LuaWrapper::push(L, (u32)event.device->type); // [lua_event, lua_device, device.type]
 			lua_setfield(L, -2, "type"); // [lua_event, lua_device]
 			LuaWrapper::push(L, event.device->index); // [lua_event, lua_device, device.index]
 			lua_setfield(L, -2, "index"); // [lua_event, lua_device]
+			lua_pop(L, 1); // [lua_event]
+
+			const bool is_button = event.type == InputSystem::Event::BUTTON;
+			const bool is_axis = event.type == InputSystem::Event::AXIS;
+			if (is_button)
+			{
+				LuaWrapper::push(L, (u32)event.data.button.state); // [lua_event, button.state]
+				lua_setfield(L, -2, "state"); // [lua_event]
+				LuaWrapper::push(L, event.data.button.key_id); // [lua_event, button.key_id]
+				lua_setfield(L, -2, "key_id"); // [lua_event]
+			}
+			else
+			{
+				lua_pushnil(L);
+				lua_setfield(L, -2, "state");
+				lua_pushnil(L);
+				lua_setfield(L, -2, "key_id");
+			}
+			setInputEventField(L, "x", is_axis, is_axis ? event.data.axis.x : 0);
+			setInputEventField(L, "y", is_axis, is_axis ? event.data.axis.y : 0);
+			const float x_abs = is_axis ? event.data.axis.x_abs : is_button ? event.data.button.x_abs : 0;
+			const float y_abs = is_axis ? event.data.axis.y_abs : is_button ? event.data.button.y_abs : 0;
+			setInputEventField(L, "x_abs", is_axis || is_button, x_abs);
+			setInputEventField(L, "y_abs", is_axis || is_button, y_abs);
+
+			if (event.type == InputSystem::Event::TEXT_INPUT) LuaWrapper::push(L, event.data.text.utf32);
+			else lua_pushnil(L);
+			lua_setfield(L, -2, "text"); // [lua_event]
+		}
 
-			lua_setfield(L, -2, "device"); // [lua_event]
 
-			switch(event.type)
+		// Marshals this frame's events into tables pooled across frames, so dispatching does not
+		// allocate. Scripts must not keep references to the event tables after the callback returns.
+		void marshalInputEvents(const InputSystem::Event* events, int count)
+		{
+			lua_State* L = m_system.m_engine.getState();
+			if (m_input_event_pool == LUA_NOREF)
 			{
-				case InputSystem::Event::DEVICE_ADDED:
-					break;
-				case InputSystem::Event::DEVICE_REMOVED:
-					break;
-				case InputSystem::Event::BUTTON:
-					LuaWrapper::push(L, (u32)event.data.button.state); // [lua_event, button.state]
-					lua_setfield(L, -2, "state"); // [lua_event]
-					LuaWrapper::push(L, event.data.button.key_id); // [lua_event, button.x_abs]
-					lua_setfield(L, -2, "key_id"); // [lua_event]
-					LuaWrapper::push(L, event.data.button.x_abs); // [lua_event, button.x_abs]
-					lua_setfield(L, -2, "x_abs"); // [lua_event]
-					LuaWrapper::push(L, event.data.button.y_abs); // [lua_event, button.y_abs]
-					lua_setfield(L, -2, "y_abs"); // [lua_event]
-					break;
-				case InputSystem::Event::AXIS:
-					LuaWrapper::push(L, event.data.axis.x); // [lua_event, axis.x]
-					lua_setfield(L, -2, "x"); // [lua_event]
-					LuaWrapper::push(L, event.data.axis.y); // [lua_event, axis.y]
-					lua_setfield(L, -2, "y"); // [lua_event]
-					LuaWrapper::push(L, event.data.axis.x_abs); // [lua_event, axis.x_abs]
-					lua_setfield(L, -2, "x_abs"); // [lua_event]
-					LuaWrapper::push(L, event.data.axis.y_abs); // [lua_event, axis.y_abs]
-					lua_setfield(L, -2, "y_abs"); // [lua_event]
-					break;
-				case InputSystem::Event::TEXT_INPUT:
-					LuaWrapper::push(L, event.data.text.utf32); // [lua_event, utf32]
-					lua_setfield(L, -2, "text"); // [lua_event]
-					break;
-				default:
-					ASSERT(false);
-					break;
+				lua_newtable(L);
+				m_input_event_pool = luaL_ref(L, LUA_REGISTRYINDEX);
+				lua_newtable(L);
+				m_input_events = luaL_ref(L, LUA_REGISTRYINDEX);
+			}
+
+			lua_rawgeti(L, LUA_REGISTRYINDEX, m_input_event_pool); // [pool]
+			lua_rawgeti(L, LUA_REGISTRYINDEX, m_input_events); // [pool, events]
+			for (int i = 0; i < count; ++i)
+			{
+				lua_rawgeti(L, -2, i + 1); // [pool, events, lua_event]
+				if (lua_type(L, -1) != LUA_TTABLE)
+				{
+					lua_pop(L, 1); // [pool, events]
+					lua_createtable(L, 0, 10); // [pool, events, lua_event]
+					lua_createtable(L, 0, 2); // [pool, events, lua_event, lua_device]
+					lua_setfield(L, -2, "device"); // [pool, events, lua_event]
+					lua_pushvalue(L, -1); // [pool, events, lua_event, lua_event]
+					lua_rawseti(L, -4, i + 1); // [pool, events, lua_event]
+				}
+				fillInputEvent(L, events[i]);
+				lua_rawseti(L, -2, i + 1); // [pool, events]
+			}
+			for (int i = count; i < m_input_events_count; ++i)
+			{
+				lua_pushnil(L); // [pool, events, nil]
+				lua_rawseti(L, -2, i + 1); // [pool, events]
 			}
+			m_input_events_count = count;
+			lua_pop(L, 2); // []
+		}
 
 
-			lua_rawgeti(L, LUA_REGISTRYINDEX, callback.environment);
-			if (lua_type(L, -1) != LUA_TTABLE) // [lua_event, environment]
+		static void callInputHandler(const CallbackData& callback, int table_ref, int index, int count)
+		{
+			lua_State* L = callback.state;
+			lua_rawgeti(L, LUA_REGISTRYINDEX, callback.function); // [func]
+			ASSERT(lua_type(L, -1) == LUA_TFUNCTION);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, table_ref); // [func, table]
+			if (index > 0)
 			{
-				ASSERT(false);
+				lua_rawgeti(L, -1, index); // [func, events, lua_event]
+				lua_remove(L, -2); // [func, lua_event]
 			}
-			lua_getfield(L, -1, "onInputEvent");
-			if (lua_type(L, -1) != LUA_TFUNCTION)  // [lua_event, environment, func]
+			else
 			{
-				lua_pop(L, 3); // []
-				return;
+				LuaWrapper::push(L, count); // [func, events, count]
 			}
 
-			lua_pushvalue(L, -3); // [lua_event, environment, func, lua_event]
-			
-			if (lua_pcall(L, 1, 0, 0) != 0)// [lua_event, environment]
+			if (lua_pcall(L, index > 0 ? 1 : 2, 0, 0) != 0) // []
 			{
 				logError("Lua Script") << lua_tostring(L, -1);
-				lua_pop(L, 1); // []
+				lua_pop(L, 1);
 			}
-			lua_pop(L, 2); // []
 		}
 
 
 		void processInputEvents()
 		{
-			if (m_input_handlers.empty()) return;
+			if (m_input_handlers.empty() && m_batched_input_handlers.empty()) return;
 			InputSystem& input_system = m_system.m_engine.getInputSystem();
-			const InputSystem::Event* events = input_system.getEvents();
-			for (int i = 0, c = input_system.getEventsCount(); i < c; ++i)
+			const int count = input_system.getEventsCount();
+			if (count == 0) return;
+
+			PROFILE_FUNCTION();
+			marshalInputEvents(input_system.getEvents(), count);
+
+			// onInputEvents(events, count) gets all events in one call
+			for (const CallbackData& cb : m_batched_input_handlers)
+			{
+				callInputHandler(cb, m_input_events, 0, count);
+			}
+			// legacy onInputEvent(event) is called per event, but with the pooled tables
+			for (int i = 0; i < count; ++i)
 			{
 				for (const CallbackData& cb : m_input_handlers)
 				{
-					processInputEvent(cb, events[i]);
+					callInputHandler(cb, m_input_events, i + 1, count);
 				}
 			}
 		}
 
 
-		void update(float time_delta, bool paused) override
+#ifdef LUMIX_DEBUG
+		static void timeLimitHook(lua_State* L, lua_Debug*)
 		{
-			PROFILE_FUNCTION();
+			if (OS::Timer::getRawTimestamp() > s_update_deadline) luaL_error(L, "Script exceeded time limit");
+		}
+#endif
 
-			if (!m_is_game_running) return;
-			if (!m_scripts_start_called) startScripts();
 
-			if (paused) return;
+		void callUpdate(int idx, float time_delta)
+		{
+			CallbackData update_item = m_updates[idx];
+			Profiler::beginBlock("lua_update");
+			Profiler::pushString(update_item.script->getPath().c_str());
+			const u64 start = OS::Timer::getRawTimestamp();
+			#ifdef LUMIX_DEBUG
+				s_update_deadline = start + u64(m_script_time_limit * OS::Timer::getFrequency() / 1000);
+			#endif
 
-			processInputEvents();
-			updateTimers(time_delta);
+			lua_rawgeti(update_item.state, LUA_REGISTRYINDEX, update_item.function);
+			ASSERT(lua_type(update_item.state, -1) == LUA_TFUNCTION);
+
+			lua_pushnumber(update_item.state, time_delta + update_item.deferred_time);
+			if (lua_pcall(update_item.state, 1, 0, 0) != 0)
+			{
+				logError("Lua Script") << lua_tostring(update_item.state, -1);
+				lua_pop(update_item.state, 1);
+			}
+
+			const float ms = float(double(OS::Timer::getRawTimestamp() - start) * 1000 / OS::Timer::getFrequency());
+			Profiler::endBlock();
+
+			// update can add or remove scripts
+			if (idx >= m_updates.size() || m_updates[idx].state != update_item.state) return;
+
+			CallbackData& cb = m_updates[idx];
+			cb.deferred_time = 0;
+			cb.profile.last_ms = ms;
+			cb.profile.avg_ms = cb.profile.avg_ms * 0.95f + ms * 0.05f;
+			cb.profile.max_ms = maximum(cb.profile.max_ms, ms);
+			if (m_script_time_limit > 0 && ms > m_script_time_limit) ++cb.profile.over_limit_count;
+		}
+
+
+		void updateScripts(float time_delta)
+		{
+			PROFILE_FUNCTION();
+			#ifdef LUMIX_DEBUG
+				lua_State* L = m_system.m_engine.getState();
+				const bool use_hook = m_script_time_limit > 0 && !lua_gethook(L);
+				if (use_hook) lua_sethook(L, &timeLimitHook, LUA_MASKCOUNT, TIME_LIMIT_HOOK_INSTRUCTIONS);
+			#endif
 
+			const u64 start = OS::Timer::getRawTimestamp();
 			for (int i = 0; i < m_updates.size(); ++i)
 			{
-				CallbackData update_item = m_updates[i];
-				lua_rawgeti(update_item.state, LUA_REGISTRYINDEX, update_item.environment);
-				if (lua_type(update_item.state, -1) != LUA_TTABLE)
-				{
-					ASSERT(false);
-				}
-				lua_getfield(update_item.state, -1, "update");
-				if (lua_type(update_item.state, -1) != LUA_TFUNCTION)
+				if (!m_updates[i].profile.is_low_priority) callUpdate(i, time_delta);
+			}
+
+			// low priority updates are processed round robin, so deferred ones run first in the next frame
+			// at least one runs each frame and updates deferred for too long run regardless of the budget
+			const u64 budget = u64(m_update_budget * OS::Timer::getFrequency() / 1000);
+			int deferred_count = 0;
+			bool any_called = false;
+			for (int j = 0, c = m_updates.size(); j < c && j < m_updates.size(); ++j)
+			{
+				const int i = (m_low_priority_cursor + j) % m_updates.size();
+				if (!m_updates[i].profile.is_low_priority) continue;
+
+				const bool over_budget = budget > 0 && OS::Timer::getRawTimestamp() - start > budget;
+				if (over_budget && any_called && m_updates[i].deferred_time < MAX_DEFERRED_TIME)
 				{
-					lua_pop(update_item.state, 2);
+					if (deferred_count == 0) m_low_priority_cursor = i;
+					m_updates[i].deferred_time = minimum(m_updates[i].deferred_time + time_delta, MAX_DEFERRED_TIME);
+					++deferred_count;
 					continue;
 				}
+				any_called = true;
+				callUpdate(i, time_delta);
+			}
+			if (deferred_count == 0) m_low_priority_cursor = 0;
+			Profiler::pushInt("deferred updates", deferred_count);
 
-				lua_pushnumber(update_item.state, time_delta);
-				if (lua_pcall(update_item.state, 1, 0, 0) != 0)
-				{
-					logError("Lua Script") << lua_tostring(update_item.state, -1);
-					lua_pop(update_item.state, 1);
-				}
-				lua_pop(update_item.state, 1);
+			#ifdef LUMIX_DEBUG
+				if (use_hook) lua_sethook(L, nullptr, 0, 0);
+			#endif
+		}
+
+
+		void setScriptLowPriority(EntityRef entity, int scr_index, bool low_priority) override
+		{
+			ScriptInstance& inst = m_scripts[entity]->m_scripts[scr_index];
+			inst.m_flags.set(ScriptInstance::LOW_PRIORITY, low_priority);
+			for (CallbackData& cb : m_updates)
+			{
+				if (cb.state == inst.m_state) cb.profile.is_low_priority = low_priority;
 			}
+		}
+
+
+		bool isScriptLowPriority(EntityRef entity, int scr_index) const override
+		{
+			return m_scripts[entity]->m_scripts[scr_index].m_flags.isSet(ScriptInstance::LOW_PRIORITY);
+		}
+
+
+		void setUpdateBudget(float ms) override { m_update_budget = ms; }
+		float getUpdateBudget() const override { return m_update_budget; }
+		void setScriptTimeLimit(float ms) override { m_script_time_limit = ms; }
+		float getScriptTimeLimit() const override { return m_script_time_limit; }
+		void setTimerBudget(float ms) override { m_timer_budget = ms; }
+		float getTimerBudget() const override { return m_timer_budget; }
+		int getScriptProfilesCount() const override { return m_updates.size(); }
+		const ScriptProfile& getScriptProfile(int idx) const override { return m_updates[idx].profile; }
+
+
+		void update(float time_delta, bool paused) override
+		{
+			PROFILE_FUNCTION();
+
+			if (!m_is_game_running) return;
+			if (!m_scripts_start_called) startScripts();
+
+			if (paused) return;
+
+			processInputEvents();
+			updateTimers(time_delta);
+
+			updateScripts(time_delta);
+			updateIsolatedScripts(time_delta);
 
 			processAnimationEvents();
 		}
@@ -1759,7 +2711,7 @@ namespace Lumix
 
 			if(enable)
 			{
-				startScript(inst, false);
+				startScript(entity, inst, false);
 			}
 			else
 			{
@@ -1832,12 +2784,23 @@ namespace Lumix
 		HashMap<EntityRef, ScriptComponent*> m_scripts;
 		AssociativeArray<u32, String> m_property_names;
 		Array<CallbackData> m_input_handlers;
+		Array<CallbackData> m_batched_input_handlers;
+		int m_input_event_pool = LUA_NOREF;
+		int m_input_events = LUA_NOREF;
+		int m_input_events_count = 0;
 		Universe& m_universe;
 		Array<CallbackData> m_updates;
-		Array<TimerData> m_timers;
+		TimerWheel m_timers;
+		Array<IsolatedWorker*> m_isolated_workers;
+		Array<IsolatedCommand> m_isolated_commands;
+		u32 m_isolated_scripts_count = 0;
 		FunctionCall m_function_call;
 		ScriptInstance* m_current_script_instance;
 		bool m_scripts_start_called = false;
+		int m_low_priority_cursor = 0;
+		float m_update_budget = 0;
+		float m_script_time_limit = 0;
+		float m_timer_budget = 0;
 		bool m_is_api_registered = false;
 		bool m_is_game_running = false;
 		GUIScene* m_gui_scene = nullptr;
@@ -1849,6 +2812,7 @@ namespace Lumix
 		: m_engine(engine)
 		, m_allocator(engine.getAllocator())
 		, m_script_manager(m_allocator)
+		, m_property_accessors(m_allocator)
 	{
 		m_script_manager.create(LuaScript::TYPE, engine.getResourceManager());
 
@@ -1864,6 +2828,13 @@ namespace Lumix
 
 	LuaScriptSystemImpl::~LuaScriptSystemImpl()
 	{
+		for (PropertyAccessor* accessor : m_property_accessors) {
+			while (accessor) {
+				PropertyAccessor* next = accessor->next;
+				LUMIX_DELETE(m_allocator, accessor);
+				accessor = next;
+			}
+		}
 		m_script_manager.destroy();
 	}
 
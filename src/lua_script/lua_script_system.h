@@ -45,6 +45,20 @@ public:
 	};
 
 
+	// timing of a script instance's update, in milliseconds
+	struct ScriptProfile
+	{
+		EntityRef entity;
+		LuaScript* script;
+		float last_ms;
+		float avg_ms;
+		float max_ms;
+		// number of updates which took longer than the script time limit
+		u32 over_limit_count;
+		bool is_low_priority;
+	};
+
+
 	struct IFunctionCall
 	{
 		virtual ~IFunctionCall() {}
@@ -82,6 +96,25 @@ public:
 	virtual ResourceType getPropertyResourceType(EntityRef entity, int scr_index, int prop_index) = 0;
 	virtual void getScriptData(EntityRef entity, OutputMemoryStream& blob) = 0;
 	virtual void setScriptData(EntityRef entity, InputMemoryStream& blob) = 0;
+	virtual void setScriptLowPriority(EntityRef entity, int scr_index, bool low_priority) = 0;
+	virtual bool isScriptLowPriority(EntityRef entity, int scr_index) const = 0;
+	// isolated scripts run update in parallel in separate lua states, their top-level code, awake and start
+	// do not run in the main state; takes effect on next load or start
+	virtual void setScriptIsolated(EntityRef entity, int scr_index, bool isolated) = 0;
+	virtual bool isScriptIsolated(EntityRef entity, int scr_index) const = 0;
+	// 0 - unlimited, otherwise low priority updates are deferred to next frames once the budget is spent,
+	// at least one low priority update runs each frame and none is deferred for more than half a second
+	virtual void setUpdateBudget(float ms) = 0;
+	virtual float getUpdateBudget() const = 0;
+	// 0 - unlimited, otherwise updates over this time are counted in ScriptProfile::over_limit_count,
+	// debug builds also abort such updates with an error
+	virtual void setScriptTimeLimit(float ms) = 0;
+	virtual float getScriptTimeLimit() const = 0;
+	// 0 - unlimited, otherwise expired timers over the budget are fired in next frames
+	virtual void setTimerBudget(float ms) = 0;
+	virtual float getTimerBudget() const = 0;
+	virtual int getScriptProfilesCount() const = 0;
+	virtual const ScriptProfile& getScriptProfile(int idx) const = 0;
 };
 
 
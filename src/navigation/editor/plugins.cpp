@@ -60,6 +60,13 @@ struct PropertyGridPlugin : PropertyGrid::IPlugin {
 
 		if (cmp.type != NAVMESH_ZONE_TYPE) return;
 		
+		const float progress = scene->getNavmeshBuildProgress((EntityRef)cmp.entity);
+		if (progress < 1) {
+			ImGui::ProgressBar(progress, ImVec2(-1, 0), "Generating...");
+			if (ImGui::Button("Cancel")) scene->cancelNavmeshBuild((EntityRef)cmp.entity);
+			return;
+		}
+
 		if (ImGui::Button("Generate")) {
 			scene->generateNavmesh((EntityRef)cmp.entity);
 		}
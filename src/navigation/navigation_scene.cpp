@@ -7,9 +7,13 @@
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
 #include "engine/lumix.h"
+#include "engine/mt/atomic.h"
+#include "engine/job_system.h"
 #include "engine/os.h"
 #include "engine/profiler.h"
 #include "engine/reflection.h"
+#include "engine/resource_manager.h"
+#include "engine/simd.h"
 #include "engine/universe/universe.h"
 #include "lua_script/lua_script_system.h"
 #include "renderer/material.h"
@@ -42,20 +46,95 @@ static const ComponentType NAVMESH_AGENT_TYPE = Reflection::getComponentType("na
 static const ComponentType ANIMATOR_TYPE = Reflection::getComponentType("animator");
 static const int CELLS_PER_TILE_SIDE = 256;
 static const float CELL_SIZE = 0.3f;
+static const int TERRAIN_CHUNK_SIZE = 16;
+static const float DIRTY_TILES_BUDGET_MS = 1.f;
+// tiles built by one job of a full navmesh build
+static const i32 TILES_PER_JOB = 1;
+// geometry chunks transformed by one job of a full navmesh build
+static const i32 CHUNKS_PER_JOB = 16;
+static const int PATH_QUERY_ITERATIONS = 512;
+static const int MAX_PATH_POLYS = 256;
+static const u32 NAVMESH_FILE_MAGIC = 0x56414e4c; // 'LNAV'
+static const u32 NAVMESH_FILE_VERSION = 0;
+static const u32 NAVMESH_FILE_ALIGN = 16;
+// loaded tiles are kept until they are this much farther than the streaming radius
+static const float STREAM_OUT_FACTOR = 1.5f;
+
+
+// file layout: header, tiles_x * tiles_z tile table, tile blobs aligned to NAVMESH_FILE_ALIGN
+struct NavmeshFileHeader {
+	u32 magic = NAVMESH_FILE_MAGIC;
+	u32 version = NAVMESH_FILE_VERSION;
+	i32 tiles_x;
+	i32 tiles_z;
+	dtNavMeshParams params;
+};
+
+
+struct NavmeshFileTile {
+	u32 offset;
+	u32 size; // 0 if there is no tile
+};
+
+
+// load-ready navmesh, tiles are added to Detour in place without DT_TILE_FREE_DATA
+struct NavmeshFile {
+	NavmeshFile(IAllocator& allocator)
+		: allocator(allocator)
+		, needed_ranges(allocator)
+		, keep_ranges(allocator)
+		, prev_needed_ranges(allocator)
+		, prev_keep_ranges(allocator)
+	{}
+
+	~NavmeshFile() { allocator.deallocate_aligned(data); }
+
+	const NavmeshFileHeader& getHeader() const { return *(const NavmeshFileHeader*)data; }
+	const NavmeshFileTile* getTiles() const { return (const NavmeshFileTile*)(data + sizeof(NavmeshFileHeader)); }
+
+	IAllocator& allocator;
+	u8* data = nullptr;
+	u64 size = 0;
+	// tile ranges (from_x, from_z, to_x, to_z) around streaming sources in this and the previous frame
+	Array<IVec4> needed_ranges;
+	Array<IVec4> keep_ranges;
+	Array<IVec4> prev_needed_ranges;
+	Array<IVec4> prev_keep_ranges;
+	// all tiles must be checked, e.g. after streaming was enabled
+	bool stream_rescan = true;
+};
 
 
 struct RecastZone {
+	RecastZone(IAllocator& allocator)
+		: agents(allocator)
+		, moves(allocator)
+		, finished(allocator)
+	{}
+
+	// new transform of an agent, computed on a worker and written back on the main thread
+	struct AgentMove {
+		EntityRef entity;
+		RigidTransform tr;
+	};
+
 	EntityRef entity;
 	NavmeshZone zone;
 
 	dtNavMeshQuery* navquery = nullptr;
-	rcPolyMeshDetail* detail_mesh = nullptr;
-	rcPolyMesh* polymesh = nullptr;
 	dtNavMesh* navmesh = nullptr;
 	rcCompactHeightfield* debug_compact_heightfield = nullptr;
 	rcHeightfield* debug_heightfield = nullptr;
 	rcContourSet* debug_contours = nullptr;
 	dtCrowd* crowd = nullptr;
+	// set if the navmesh was loaded from a file, detour tiles can point to its data
+	struct NavmeshFile* file = nullptr;
+	// 0 - all tiles are loaded, otherwise only tiles around agents and active camera are loaded
+	float streaming_radius = 0;
+	// agents assigned to this zone, so crowd updates do not have to scan all agents
+	Array<EntityRef> agents;
+	Array<AgentMove> moves;
+	Array<EntityRef> finished;
 };
 
 
@@ -81,6 +160,211 @@ struct Agent
 };
 
 
+// input geometry of a build, snapshotted on the main thread so tiles can be rasterized on workers
+// model triangles are transformed to zone space once and shared by all tiles they overlap
+struct NavmeshGeometry {
+	// a model instance or a block of terrain quads
+	struct Chunk {
+		AABB aabb;
+		Matrix mtx;
+		Model* model = nullptr;
+		u32 first_triangle = 0;
+		u32 triangle_count = 0;
+		u32 terrain = 0;
+		IVec2 from;
+		IVec2 to;
+	};
+
+	struct Terrain {
+		IVec2 resolution;
+		float xz_scale;
+		// only heights in [heights_from, heights_from + heights_size) are sampled
+		IVec2 heights_from;
+		IVec2 heights_size;
+		u32 heights_offset;
+	};
+
+	explicit NavmeshGeometry(IAllocator& allocator)
+		: allocator(allocator)
+		, chunks(allocator)
+		, terrains(allocator)
+		, heights(allocator)
+		, vertices(allocator)
+		, areas(allocator)
+		, tile_offsets(allocator)
+		, tile_chunks(allocator)
+	{}
+
+	~NavmeshGeometry() {
+		for (Chunk& chunk : chunks) {
+			if (chunk.model) chunk.model->getResourceManager().unload(*chunk.model);
+		}
+	}
+
+	u32 getTileIndex(int x, int z) const { return x - tile_from.x + (z - tile_from.y) * tile_count.x; }
+
+	IAllocator& allocator;
+	Array<Chunk> chunks;
+	Array<Terrain> terrains;
+	Array<float> heights;
+	// 3 vertices and 1 area per triangle
+	Array<Vec3> vertices;
+	Array<u8> areas;
+	// chunks overlapping tile i are tile_chunks[tile_offsets[i]] .. tile_chunks[tile_offsets[i + 1] - 1]
+	Array<u32> tile_offsets;
+	Array<u32> tile_chunks;
+	IVec2 tile_from;
+	IVec2 tile_count;
+	u32 no_navigation_flag = 0;
+	u32 nonwalkable_flag = 0;
+};
+
+
+// dynamic obstacle, everything is in zone space
+struct NavmeshObstacle {
+	enum class Type : u8 {
+		BOX,
+		CYLINDER,
+		CONVEX
+	};
+
+	static constexpr int MAX_VERTS = 8;
+
+	EntityRef zone;
+	Type type;
+	Vec3 pos;
+	float yaw = 0;
+	Vec3 half_extents;
+	float radius = 0;
+	float height = 0;
+	// convex hull relative to pos
+	Vec2 verts[MAX_VERTS];
+	int verts_count = 0;
+	AABB aabb;
+};
+
+
+// compact heightfield of a tile, cached so the tile can be rebuilt without rasterizing it again
+struct NavmeshTileLayer {
+	explicit NavmeshTileLayer(IAllocator& allocator) : areas(allocator) {}
+	~NavmeshTileLayer() { rcFreeCompactHeightfield(chf); }
+
+	rcCompactHeightfield* chf = nullptr;
+	// chf->areas without any obstacles
+	Array<u8> areas;
+};
+
+
+struct NavmeshTileRebuild {
+	NavmeshTileRebuild(EntityRef zone, IAllocator& allocator)
+		: zone(zone)
+		, geometry(allocator)
+		, obstacles(allocator)
+	{}
+
+	EntityRef zone;
+	int x;
+	int z;
+	rcConfig base_config;
+	rcConfig config;
+	Vec3 min;
+	NavmeshTileLayer* layer;
+	// only used if the layer is not cached yet
+	NavmeshGeometry geometry;
+	Array<NavmeshObstacle> obstacles;
+	u8* data = nullptr;
+	int data_size = 0;
+	const char* error = nullptr;
+	volatile i32 is_done = 0;
+	JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
+};
+
+
+struct NavmeshBuild {
+	struct Tile {
+		int x;
+		int z;
+		u8* data = nullptr;
+		int data_size = 0;
+		const char* error = nullptr;
+		volatile i32 is_built = 0;
+		bool is_finalized = false;
+	};
+
+	// range processed by one job, jobs are small so workers return to the queue between them
+	struct Job {
+		NavmeshBuild* build;
+		i32 from;
+		i32 to;
+	};
+
+	NavmeshBuild(EntityRef zone, IAllocator& allocator)
+		: zone(zone)
+		, geometry(allocator)
+		, obstacles(allocator)
+		, tiles(allocator)
+		, chunk_jobs(allocator)
+		, tile_jobs(allocator)
+	{}
+
+	EntityRef zone;
+	rcConfig config;
+	Vec3 min;
+	Vec3 max;
+	NavmeshGeometry geometry;
+	Array<NavmeshObstacle> obstacles;
+	Array<Tile> tiles;
+	Array<Job> chunk_jobs;
+	Array<Job> tile_jobs;
+	volatile i32 is_canceled = 0;
+	u32 finalized_count = 0;
+	JobSystem::SignalHandle prepare_signal = JobSystem::INVALID_HANDLE;
+	JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
+};
+
+
+struct NavQuery {
+	enum class Type : u8 {
+		PATH,
+		RAYCAST,
+		NEAREST_POLY
+	};
+
+	static constexpr int MAX_POINTS = 64;
+
+	Type type;
+	EntityRef zone;
+	Transform zone_tr;
+	// zone space
+	Vec3 from;
+	Vec3 to;
+	NavQueryStatus status = NavQueryStatus::PENDING;
+	struct NavQuerySlot* slot = nullptr;
+	// world space results
+	DVec3 points[MAX_POINTS];
+	int points_count = 0;
+	bool is_hit = false;
+};
+
+
+// owns a dtNavMeshQuery, processed by a single job at a time; sliced path queries can span several frames
+struct NavQuerySlot {
+	NavQuerySlot(EntityRef zone, IAllocator& allocator)
+		: zone(zone)
+		, queue(allocator)
+	{}
+
+	~NavQuerySlot() { dtFreeNavMeshQuery(navquery); }
+
+	EntityRef zone;
+	dtNavMeshQuery* navquery = nullptr;
+	dtQueryFilter filter;
+	Array<NavQuery*> queue;
+	NavQuery* current = nullptr;
+	dtPolyRef current_end_poly = 0;
+};
+
+
 struct NavigationSceneImpl final : public NavigationScene
 {
 	NavigationSceneImpl(Engine& engine, IPlugin& system, Universe& universe, IAllocator& allocator)
@@ -92,6 +376,14 @@ struct NavigationSceneImpl final : public NavigationScene
 		, m_num_tiles_z(0)
 		, m_agents(m_allocator)
 		, m_zones(m_allocator)
+		, m_builds(m_allocator)
+		, m_obstacles(m_allocator)
+		, m_tile_layers(m_allocator)
+		, m_dirty_tiles(m_allocator)
+		, m_tile_rebuilds(m_allocator)
+		, m_queries(m_allocator)
+		, m_pending_queries(m_allocator)
+		, m_query_slots(m_allocator)
 		, m_script_scene(nullptr)
 		, m_on_update(m_allocator)
 	{
@@ -111,14 +403,26 @@ struct NavigationSceneImpl final : public NavigationScene
 	~NavigationSceneImpl()
 	{
 		m_universe.entityTransformed().unbind<&NavigationSceneImpl::onEntityMoved>(this);
+		while (!m_builds.empty()) cancelNavmeshBuild(m_builds.back()->zone);
 		for(RecastZone& zone : m_zones) {
+			clearTileLayers(zone.entity);
 			clearNavmesh(zone);
 		}
+		for (NavQuery* query : m_queries) LUMIX_DELETE(m_allocator, query);
 	}
 
 
 	void clear() override
 	{
+		while (!m_builds.empty()) cancelNavmeshBuild(m_builds.back()->zone);
+		for (RecastZone& zone : m_zones) {
+			clearTileLayers(zone.entity);
+			clearQuerySlots(zone.entity);
+		}
+		for (NavQuery* query : m_queries) LUMIX_DELETE(m_allocator, query);
+		m_queries.clear();
+		m_pending_queries.clear();
+		m_obstacles.clear();
 		m_agents.clear();
 		m_zones.clear();
 	}
@@ -149,16 +453,17 @@ struct NavigationSceneImpl final : public NavigationScene
 
 
 	void clearNavmesh(RecastZone& zone) {
+		clearQuerySlots(zone.entity);
 		dtFreeNavMeshQuery(zone.navquery);
-		rcFreePolyMeshDetail(zone.detail_mesh);
-		rcFreePolyMesh(zone.polymesh);
 		dtFreeNavMesh(zone.navmesh);
 		rcFreeCompactHeightfield(zone.debug_compact_heightfield);
 		rcFreeHeightField(zone.debug_heightfield);
 		rcFreeContourSet(zone.debug_contours);
 		dtFreeCrowd(zone.crowd);
-		zone.detail_mesh = nullptr;
-		zone.polymesh = nullptr;
+		// after dtFreeNavMesh, tiles can point to file's data
+		if (zone.file) LUMIX_DELETE(m_allocator, zone.file);
+		for (EntityRef entity : zone.agents) m_agents[entity].agent = -1;
+		zone.file = nullptr;
 		zone.navquery = nullptr;
 		zone.navmesh = nullptr;
 		zone.debug_compact_heightfield = nullptr;
@@ -168,141 +473,333 @@ struct NavigationSceneImpl final : public NavigationScene
 	}
 
 
-	void rasterizeGeometry(const Transform& zone_tr, const AABB& aabb, rcContext& ctx, rcConfig& cfg, rcHeightfield& solid)
-	{
-		rasterizeMeshes(zone_tr, aabb, ctx, cfg, solid);
-		rasterizeTerrains(zone_tr, aabb, ctx, cfg, solid);
+	static Matrix toMatrix(const Transform& tr) {
+		Matrix mtx = tr.rot.toMatrix();
+		mtx.setTranslation(tr.pos.toFloat());
+		mtx.multiply3x3(tr.scale);
+		return mtx;
 	}
 
 
-	void rasterizeTerrains(const Transform& zone_tr, const AABB& aabb, rcContext& ctx, rcConfig& cfg, rcHeightfield& solid)
+	// main thread part, snapshots model instances overlapping the tiles' padded AABB and terrain heights under it
+	void gatherGeometry(const Transform& zone_tr
+		, const rcConfig& cfg
+		, const Vec3& min
+		, const Vec3& max
+		, const IVec2& tile_from
+		, const IVec2& tile_count
+		, NavmeshGeometry& geometry)
 	{
 		PROFILE_FUNCTION();
-		const float walkable_threshold = cosf(degreesToRadians(60));
+		geometry.tile_from = tile_from;
+		geometry.tile_count = tile_count;
+		AABB aabb = getTileAABB(cfg, min, max, tile_from.x, tile_from.y);
+		aabb.merge(getTileAABB(cfg, min, max, tile_from.x + tile_count.x - 1, tile_from.y + tile_count.y - 1));
 
 		auto render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
-		if (!render_scene) return;
+		if (render_scene) {
+			const Transform inv_zone_tr = zone_tr.inverted();
+
+			EntityPtr terrain_ptr = render_scene->getFirstTerrain();
+			while (terrain_ptr.isValid()) {
+				const EntityRef entity = (EntityRef)terrain_ptr;
+				gatherTerrain(*render_scene, entity, toMatrix(inv_zone_tr * m_universe.getTransform(entity)), aabb, geometry);
+				terrain_ptr = render_scene->getNextTerrain(entity);
+			}
 
-		EntityPtr entity_ptr = render_scene->getFirstTerrain();
-		while (entity_ptr.isValid()) {
-			const EntityRef entity = (EntityRef)entity_ptr;
-			const Transform terrain_tr = m_universe.getTransform(entity);
-			const Transform to_zone = zone_tr.inverted() * terrain_tr;
-			const IVec2 res = render_scene->getTerrainResolution(entity);
-			float scaleXZ = render_scene->getTerrainXZScale(entity);
-			for (int j = 0; j < res.y; ++j) {
-				for (int i = 0; i < res.x; ++i) {
-					float x = i * scaleXZ;
-					float z = j * scaleXZ;
-
-					const float h0 = render_scene->getTerrainHeightAt(entity, x, z);
-					const Vec3 p0 = to_zone.transform(Vec3(x, h0, z)).toFloat();
-
-					x = (i + 1) * scaleXZ;
-					z = j * scaleXZ;
-					const float h1 = render_scene->getTerrainHeightAt(entity, x, z);
-					const Vec3 p1 = to_zone.transform(Vec3(x, h1, z)).toFloat();
-
-					x = (i + 1) * scaleXZ;
-					z = (j + 1) * scaleXZ;
-					const float h2 = render_scene->getTerrainHeightAt(entity, x, z);
-					const Vec3 p2 = to_zone.transform(Vec3(x, h2, z)).toFloat();
-
-					x = i * scaleXZ;
-					z = (j + 1) * scaleXZ;
-					const float h3 = render_scene->getTerrainHeightAt(entity, x, z);
-					const Vec3 p3 = to_zone.transform(Vec3(x, h3, z)).toFloat();
-
-					Vec3 n = crossProduct(p1 - p0, p0 - p2).normalized();
-					u8 area = n.y > walkable_threshold ? RC_WALKABLE_AREA : 0;
-					rcRasterizeTriangle(&ctx, &p0.x, &p1.x, &p2.x, area, solid);
-
-					n = crossProduct(p2 - p0, p0 - p3).normalized();
-					area = n.y > walkable_threshold ? RC_WALKABLE_AREA : 0;
-					rcRasterizeTriangle(&ctx, &p0.x, &p2.x, &p3.x, area, solid);
-				}
+			geometry.no_navigation_flag = Material::getCustomFlag("no_navigation");
+			geometry.nonwalkable_flag = Material::getCustomFlag("nonwalkable");
+			ResourceManagerHub& rm = m_engine.getResourceManager();
+			for (EntityPtr model_instance = render_scene->getFirstModelInstance(); 
+				model_instance.isValid();
+				model_instance = render_scene->getNextModelInstance(model_instance))
+			{
+				const EntityRef entity = (EntityRef)model_instance;
+				auto* model = render_scene->getModelInstanceModel(entity);
+				if (!model || !model->isReady()) continue;
+
+				const Matrix mtx = toMatrix(inv_zone_tr * m_universe.getTransform(entity));
+				AABB model_aabb = model->getAABB();
+				model_aabb.transform(mtx);
+				if (!model_aabb.overlaps(aabb)) continue;
+
+				// keep the model alive until the build is done
+				rm.load<Model>(model->getPath());
+				NavmeshGeometry::Chunk& chunk = geometry.chunks.emplace();
+				chunk.aabb = model_aabb;
+				chunk.mtx = mtx;
+				chunk.model = model;
 			}
-			entity_ptr = render_scene->getNextTerrain(entity);
 		}
 	}
 
 
-	void rasterizeMeshes(const Transform& zone_tr, const AABB& aabb, rcContext& ctx, rcConfig& cfg, rcHeightfield& solid)
-	{
+	// second half of gatherGeometry, touches only the snapshot, so it can run on a worker
+	static void finishGeometry(const rcConfig& cfg, const Vec3& min, NavmeshGeometry& geometry) {
 		PROFILE_FUNCTION();
-		const float walkable_threshold = cosf(degreesToRadians(45));
+		u32 triangle_count = 0;
+		for (NavmeshGeometry::Chunk& chunk : geometry.chunks) {
+			if (!chunk.model) continue;
 
-		const Transform inv_zone_tr = zone_tr.inverted();
+			chunk.first_triangle = triangle_count;
+			chunk.triangle_count = 0;
+			auto lod = chunk.model->getLODMeshIndices(0);
+			for (int mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx) {
+				const Mesh& mesh = chunk.model->getMesh(mesh_idx);
+				if (mesh.material->isCustomFlag(geometry.no_navigation_flag)) continue;
+				chunk.triangle_count += mesh.indices.size() / (mesh.areIndices16() ? 2 : 4) / 3;
+			}
+			triangle_count += chunk.triangle_count;
+		}
+		geometry.vertices.resize(triangle_count * 3);
+		geometry.areas.resize(triangle_count);
 
-		auto render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
-		if (!render_scene) return;
+		bucketChunks(cfg, min, geometry);
+	}
 
-		u32 no_navigation_flag = Material::getCustomFlag("no_navigation");
-		u32 nonwalkable_flag = Material::getCustomFlag("nonwalkable");
-		for (EntityPtr model_instance = render_scene->getFirstModelInstance(); 
-			model_instance.isValid();
-			model_instance = render_scene->getNextModelInstance(model_instance))
-		{
-			const EntityRef entity = (EntityRef)model_instance;
-			auto* model = render_scene->getModelInstanceModel(entity);
-			if (!model) return;
-			ASSERT(model->isReady());
-
-			const Transform tr = m_universe.getTransform(entity);
-			AABB model_aabb = model->getAABB();
-			const Transform rel_tr = inv_zone_tr * tr;
-			Matrix mtx = rel_tr.rot.toMatrix();
-			mtx.setTranslation(rel_tr.pos.toFloat());
-			mtx.multiply3x3(rel_tr.scale);
-			model_aabb.transform(mtx);
-			if (!model_aabb.overlaps(aabb)) continue;
-
-			auto lod = model->getLODMeshIndices(0);
-			for (int mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx) {
-				Mesh& mesh = model->getMesh(mesh_idx);
-				bool is16 = mesh.areIndices16();
-
-				if (mesh.material->isCustomFlag(no_navigation_flag)) continue;
-				bool is_walkable = !mesh.material->isCustomFlag(nonwalkable_flag);
-				auto* vertices = &mesh.vertices[0];
-				if (is16) {
-					const u16* indices16 = (const u16*)&mesh.indices[0];
-					for (int i = 0; i < mesh.indices.size() / 2; i += 3) {
-						Vec3 a = mtx.transformPoint(vertices[indices16[i]]);
-						Vec3 b = mtx.transformPoint(vertices[indices16[i + 1]]);
-						Vec3 c = mtx.transformPoint(vertices[indices16[i + 2]]);
-
-						Vec3 n = crossProduct(a - b, a - c).normalized();
-						u8 area = n.y > walkable_threshold && is_walkable ? RC_WALKABLE_AREA : 0;
-						rcRasterizeTriangle(&ctx, &a.x, &b.x, &c.x, area, solid);
+
+	static void gatherTerrain(RenderScene& render_scene, EntityRef entity, const Matrix& mtx, const AABB& aabb, NavmeshGeometry& geometry) {
+		static const int CHUNK_SIZE = TERRAIN_CHUNK_SIZE;
+
+		const IVec2 resolution = render_scene.getTerrainResolution(entity);
+		const float s = render_scene.getTerrainXZScale(entity);
+
+		// sample only the part of the heightmap under aabb, so the cost does not depend on terrain size
+		AABB local_aabb = aabb;
+		local_aabb.transform(mtx.inverted());
+		const int from_x = clamp(int(floorf(local_aabb.min.x / s)), 0, resolution.x) / CHUNK_SIZE * CHUNK_SIZE;
+		const int from_z = clamp(int(floorf(local_aabb.min.z / s)), 0, resolution.y) / CHUNK_SIZE * CHUNK_SIZE;
+		const int to_x = clamp(int(ceilf(local_aabb.max.x / s)), 0, resolution.x);
+		const int to_z = clamp(int(ceilf(local_aabb.max.z / s)), 0, resolution.y);
+		if (from_x >= to_x || from_z >= to_z) return;
+
+		const u32 terrain_idx = geometry.terrains.size();
+		NavmeshGeometry::Terrain& terrain = geometry.terrains.emplace();
+		terrain.resolution = resolution;
+		terrain.xz_scale = s;
+		terrain.heights_offset = geometry.heights.size();
+		terrain.heights_from = IVec2(from_x, from_z);
+		terrain.heights_size = IVec2(to_x - from_x + 1, to_z - from_z + 1);
+		const int w = terrain.heights_size.x;
+		const int h = terrain.heights_size.y;
+		geometry.heights.resize(terrain.heights_offset + w * h);
+		float* heights = &geometry.heights[terrain.heights_offset];
+		for (int j = 0; j < h; ++j) {
+			for (int i = 0; i < w; ++i) {
+				heights[i + j * w] = render_scene.getTerrainHeightAt(entity, (from_x + i) * s, (from_z + j) * s);
+			}
+		}
+
+		for (int j = from_z; j < to_z; j += CHUNK_SIZE) {
+			for (int i = from_x; i < to_x; i += CHUNK_SIZE) {
+				const IVec2 from(i, j);
+				const IVec2 to(minimum(i + CHUNK_SIZE, to_x), minimum(j + CHUNK_SIZE, to_z));
+				float min_h = heights[(i - from_x) + (j - from_z) * w];
+				float max_h = min_h;
+				for (int y = from.y; y <= to.y; ++y) {
+					for (int x = from.x; x <= to.x; ++x) {
+						const float height = heights[(x - from_x) + (y - from_z) * w];
+						min_h = minimum(min_h, height);
+						max_h = maximum(max_h, height);
 					}
 				}
-				else {
-					const u32* indices32 = (const u32*)&mesh.indices[0];
-					for (int i = 0; i < mesh.indices.size() / 4; i += 3) {
-						Vec3 a = mtx.transformPoint(vertices[indices32[i]]);
-						Vec3 b = mtx.transformPoint(vertices[indices32[i + 1]]);
-						Vec3 c = mtx.transformPoint(vertices[indices32[i + 2]]);
-
-						Vec3 n = crossProduct(a - b, a - c).normalized();
-						u8 area = n.y > walkable_threshold && is_walkable ? RC_WALKABLE_AREA : 0;
-						rcRasterizeTriangle(&ctx, &a.x, &b.x, &c.x, area, solid);
-					}
+				AABB chunk_aabb(Vec3(from.x * s, min_h, from.y * s), Vec3(to.x * s, max_h, to.y * s));
+				chunk_aabb.transform(mtx);
+				if (!chunk_aabb.overlaps(aabb)) continue;
+
+				NavmeshGeometry::Chunk& chunk = geometry.chunks.emplace();
+				chunk.aabb = chunk_aabb;
+				chunk.mtx = mtx;
+				chunk.terrain = terrain_idx;
+				chunk.from = from;
+				chunk.to = to;
+			}
+		}
+	}
+
+
+	static void bucketChunks(const rcConfig& cfg, const Vec3& min, NavmeshGeometry& geometry) {
+		const float tile_size = CELLS_PER_TILE_SIDE * CELL_SIZE;
+		const float border = (1 + cfg.borderSize) * cfg.cs;
+		const IVec2 from = geometry.tile_from;
+		const IVec2 count = geometry.tile_count;
+		auto getRange = [&](const AABB& aabb, IVec2& range_min, IVec2& range_max) {
+			range_min.x = maximum(from.x, int(floorf((aabb.min.x - min.x - border) / tile_size)));
+			range_min.y = maximum(from.y, int(floorf((aabb.min.z - min.z - border) / tile_size)));
+			range_max.x = minimum(from.x + count.x - 1, int(floorf((aabb.max.x - min.x + border) / tile_size)));
+			range_max.y = minimum(from.y + count.y - 1, int(floorf((aabb.max.z - min.z + border) / tile_size)));
+		};
+
+		geometry.tile_offsets.resize(count.x * count.y + 1);
+		for (u32& offset : geometry.tile_offsets) offset = 0;
+		for (const NavmeshGeometry::Chunk& chunk : geometry.chunks) {
+			IVec2 range_min, range_max;
+			getRange(chunk.aabb, range_min, range_max);
+			for (int z = range_min.y; z <= range_max.y; ++z) {
+				for (int x = range_min.x; x <= range_max.x; ++x) {
+					++geometry.tile_offsets[geometry.getTileIndex(x, z) + 1];
+				}
+			}
+		}
+		for (int i = 1; i < geometry.tile_offsets.size(); ++i) {
+			geometry.tile_offsets[i] += geometry.tile_offsets[i - 1];
+		}
+
+		geometry.tile_chunks.resize(geometry.tile_offsets.back());
+		Array<u32> fill(geometry.allocator);
+		fill.resize(count.x * count.y);
+		for (u32& f : fill) f = 0;
+		for (int i = 0; i < geometry.chunks.size(); ++i) {
+			IVec2 range_min, range_max;
+			getRange(geometry.chunks[i].aabb, range_min, range_max);
+			for (int z = range_min.y; z <= range_max.y; ++z) {
+				for (int x = range_min.x; x <= range_max.x; ++x) {
+					const u32 tile = geometry.getTileIndex(x, z);
+					geometry.tile_chunks[geometry.tile_offsets[tile] + fill[tile]] = i;
+					++fill[tile];
+				}
+			}
+		}
+	}
+
+
+	static void transformVertices(const Matrix& mtx, const Vec3* src, u32 count, float4* dst) {
+		const float4 c0 = f4LoadUnaligned(&mtx.m11);
+		const float4 c1 = f4LoadUnaligned(&mtx.m21);
+		const float4 c2 = f4LoadUnaligned(&mtx.m31);
+		const float4 c3 = f4LoadUnaligned(&mtx.m41);
+		for (u32 i = 0; i < count; ++i) {
+			const Vec3& v = src[i];
+			float4 r = f4Add(f4Mul(c0, f4Splat(v.x)), c3);
+			r = f4Add(r, f4Mul(c1, f4Splat(v.y)));
+			dst[i] = f4Add(r, f4Mul(c2, f4Splat(v.z)));
+		}
+	}
+
+
+	// can run on any thread, each chunk writes only its own range of triangles
+	static void prepareChunk(NavmeshGeometry& geometry, u32 chunk_idx, Array<float4>& tmp) {
+		const NavmeshGeometry::Chunk& chunk = geometry.chunks[chunk_idx];
+		if (!chunk.model) return;
+
+		const float walkable_threshold = cosf(degreesToRadians(45));
+		Vec3* out = &geometry.vertices[chunk.first_triangle * 3];
+		u8* areas = &geometry.areas[chunk.first_triangle];
+		auto lod = chunk.model->getLODMeshIndices(0);
+		for (int mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx) {
+			const Mesh& mesh = chunk.model->getMesh(mesh_idx);
+			if (mesh.material->isCustomFlag(geometry.no_navigation_flag)) continue;
+
+			const bool is_walkable = !mesh.material->isCustomFlag(geometry.nonwalkable_flag);
+			tmp.resize(mesh.vertices.size());
+			transformVertices(chunk.mtx, mesh.vertices.begin(), mesh.vertices.size(), tmp.begin());
+			const float* vertices = (const float*)tmp.begin();
+
+			auto addTriangle = [&](u32 ia, u32 ib, u32 ic) {
+				const Vec3 a(vertices[ia * 4], vertices[ia * 4 + 1], vertices[ia * 4 + 2]);
+				const Vec3 b(vertices[ib * 4], vertices[ib * 4 + 1], vertices[ib * 4 + 2]);
+				const Vec3 c(vertices[ic * 4], vertices[ic * 4 + 1], vertices[ic * 4 + 2]);
+				const Vec3 n = crossProduct(a - b, a - c).normalized();
+				*areas = n.y > walkable_threshold && is_walkable ? RC_WALKABLE_AREA : 0;
+				out[0] = a;
+				out[1] = b;
+				out[2] = c;
+				out += 3;
+				++areas;
+			};
+
+			if (mesh.areIndices16()) {
+				const u16* indices16 = (const u16*)&mesh.indices[0];
+				for (int i = 0, c = mesh.indices.size() / 2 / 3; i < c; ++i) {
+					addTriangle(indices16[i * 3], indices16[i * 3 + 1], indices16[i * 3 + 2]);
+				}
+			}
+			else {
+				const u32* indices32 = (const u32*)&mesh.indices[0];
+				for (int i = 0, c = mesh.indices.size() / 4 / 3; i < c; ++i) {
+					addTriangle(indices32[i * 3], indices32[i * 3 + 1], indices32[i * 3 + 2]);
 				}
 			}
 		}
 	}
 
 
-	void onPathFinished(const Agent& agent)
+	static void rasterizeGeometry(const NavmeshGeometry& geometry, u32 tile_idx, const AABB& aabb, rcContext& ctx, rcHeightfield& solid)
+	{
+		PROFILE_FUNCTION();
+		for (u32 i = geometry.tile_offsets[tile_idx], end = geometry.tile_offsets[tile_idx + 1]; i < end; ++i) {
+			const NavmeshGeometry::Chunk& chunk = geometry.chunks[geometry.tile_chunks[i]];
+			if (!chunk.aabb.overlaps(aabb)) continue;
+
+			if (chunk.model) {
+				if (chunk.triangle_count == 0) continue;
+				const float* vertices = &geometry.vertices[chunk.first_triangle * 3].x;
+				rcRasterizeTriangles(&ctx, vertices, &geometry.areas[chunk.first_triangle], chunk.triangle_count, solid);
+			}
+			else {
+				rasterizeTerrainChunk(geometry, chunk, ctx, solid);
+			}
+		}
+	}
+
+
+	static void rasterizeTerrainChunk(const NavmeshGeometry& geometry, const NavmeshGeometry::Chunk& chunk, rcContext& ctx, rcHeightfield& solid)
+	{
+		static const int CHUNK_SIZE = TERRAIN_CHUNK_SIZE;
+		const float walkable_threshold = cosf(degreesToRadians(60));
+
+		const NavmeshGeometry::Terrain& terrain = geometry.terrains[chunk.terrain];
+		const float s = terrain.xz_scale;
+		const int w = terrain.heights_size.x;
+		const IVec2 heights_from = terrain.heights_from;
+		const float* heights = &geometry.heights[terrain.heights_offset];
+		const int cw = chunk.to.x - chunk.from.x + 1;
+		const int ch = chunk.to.y - chunk.from.y + 1;
+
+		Vec3 local[(CHUNK_SIZE + 1) * (CHUNK_SIZE + 1)];
+		float4 transformed[(CHUNK_SIZE + 1) * (CHUNK_SIZE + 1)];
+		for (int j = 0; j < ch; ++j) {
+			for (int i = 0; i < cw; ++i) {
+				const int x = chunk.from.x + i;
+				const int z = chunk.from.y + j;
+				local[i + j * cw] = Vec3(x * s, heights[(x - heights_from.x) + (z - heights_from.y) * w], z * s);
+			}
+		}
+		transformVertices(chunk.mtx, local, cw * ch, transformed);
+
+		const float* v = (const float*)transformed;
+		for (int j = 0; j < ch - 1; ++j) {
+			for (int i = 0; i < cw - 1; ++i) {
+				const float* p0 = &v[(i + j * cw) * 4];
+				const float* p1 = &v[(i + 1 + j * cw) * 4];
+				const float* p2 = &v[(i + 1 + (j + 1) * cw) * 4];
+				const float* p3 = &v[(i + (j + 1) * cw) * 4];
+				const Vec3 v0(p0[0], p0[1], p0[2]);
+				const Vec3 v1(p1[0], p1[1], p1[2]);
+				const Vec3 v2(p2[0], p2[1], p2[2]);
+				const Vec3 v3(p3[0], p3[1], p3[2]);
+
+				Vec3 n = crossProduct(v1 - v0, v0 - v2).normalized();
+				u8 area = n.y > walkable_threshold ? RC_WALKABLE_AREA : 0;
+				rcRasterizeTriangle(&ctx, p0, p1, p2, area, solid);
+
+				n = crossProduct(v2 - v0, v0 - v3).normalized();
+				area = n.y > walkable_threshold ? RC_WALKABLE_AREA : 0;
+				rcRasterizeTriangle(&ctx, p0, p2, p3, area, solid);
+			}
+		}
+	}
+
+
+	void onPathFinished(EntityRef entity)
 	{
 		if (!m_script_scene) return;
 		
-		if (!m_universe.hasComponent(agent.entity, LUA_SCRIPT_TYPE)) return;
+		if (!m_universe.hasComponent(entity, LUA_SCRIPT_TYPE)) return;
 
-		for (int i = 0, c = m_script_scene->getScriptCount(agent.entity); i < c; ++i)
+		for (int i = 0, c = m_script_scene->getScriptCount(entity); i < c; ++i)
 		{
-			auto* call = m_script_scene->beginFunctionCall(agent.entity, i, "onPathFinished");
+			auto* call = m_script_scene->beginFunctionCall(entity, i, "onPathFinished");
 			if (!call) continue;
 
 			m_script_scene->endFunctionCall();
@@ -333,15 +830,16 @@ struct NavigationSceneImpl final : public NavigationScene
 		m_agents[entity].root_motion = root_motion;
 	}
 
+	// runs on a worker, zones do not share any state
 	void update(RecastZone& zone, float time_delta) {
-		if (!zone.crowd) return;
+		PROFILE_FUNCTION();
 		zone.crowd->update(time_delta, nullptr);
 
 		const Transform inv_tr = m_universe.getTransform(zone.entity).inverted();
 
-		for (auto& agent : m_agents) {
+		for (EntityRef entity : zone.agents) {
+			Agent& agent = m_agents[entity];
 			if (agent.agent < 0) continue;
-			if (agent.zone != zone.entity) continue;
 			
 			const dtCrowdAgent* dt_agent = zone.crowd->getAgent(agent.agent);
 			//if (dt_agent->paused) continue;
@@ -361,27 +859,36 @@ struct NavigationSceneImpl final : public NavigationScene
 		}
 	}
 
+	void getActiveZones(Array<RecastZone*>& zones) {
+		for (RecastZone& zone : m_zones) {
+			if (zone.crowd && !zone.agents.empty()) zones.push(&zone);
+		}
+	}
+
 	void update(float time_delta, bool paused) override {
 		PROFILE_FUNCTION();
+		finalizeBuilds();
+		updateStreaming();
+		updateDirtyTiles();
+		updateQueries();
 		if (paused) return;
 		
-		for (RecastZone& zone : m_zones) {
-			update(zone, time_delta);
-		}
+		Array<RecastZone*> zones(m_allocator);
+		getActiveZones(zones);
+		JobSystem::forEach(zones.size(), [&](int idx){
+			update(*zones[idx], time_delta);
+		});
 	}
 
-	void lateUpdate(RecastZone& zone, float time_delta) {
-		if (!zone.crowd) return;
-		
+	// runs on a worker, universe is only read here, results are written back in lateUpdate
+	void lateUpdate(RecastZone& zone, float time_delta, AnimationScene* anim_scene) {
+		PROFILE_FUNCTION();
 		const Transform zone_tr = m_universe.getTransform(zone.entity);
 		const Transform inv_zone_tr = zone_tr.inverted();
 
-		static const u32 ANIMATION_HASH = crc32("animation");
-		auto* anim_scene = (AnimationScene*)m_universe.getScene(ANIMATION_HASH);
-
-		for (Agent& agent : m_agents) {
+		for (EntityRef entity : zone.agents) {
+			Agent& agent = m_agents[entity];
 			if (agent.agent < 0) continue;
-			if (agent.zone != zone.entity) continue;
 
 			const dtCrowdAgent* dt_agent = zone.crowd->getAgent(agent.agent);
 			//if (dt_agent->paused) continue;
@@ -403,15 +910,19 @@ struct NavigationSceneImpl final : public NavigationScene
 
 		zone.crowd->doMove(time_delta);
 
-		for (auto& agent : m_agents) {
+		zone.moves.clear();
+		zone.finished.clear();
+		for (EntityRef entity : zone.agents) {
+			Agent& agent = m_agents[entity];
 			if (agent.agent < 0) continue;
-			if (agent.zone != zone.entity) continue;
 
 			const dtCrowdAgent* dt_agent = zone.crowd->getAgent(agent.agent);
 			//if (dt_agent->paused) continue;
 
-			m_moving_agent = agent.entity;
-			m_universe.setPosition(agent.entity, zone_tr.transform(*(Vec3*)dt_agent->npos));
+			RecastZone::AgentMove& move = zone.moves.emplace();
+			move.entity = agent.entity;
+			move.tr.pos = zone_tr.transform(*(Vec3*)dt_agent->npos);
+			move.tr.rot = m_universe.getRotation(agent.entity);
 
 			if ((agent.flags & Agent::USE_ROOT_MOTION) == 0) {
 				Vec3 vel = *(Vec3*)dt_agent->nvel;
@@ -421,15 +932,13 @@ struct NavigationSceneImpl final : public NavigationScene
 					vel *= 1 / len;
 					float angle = atan2f(vel.x, vel.z);
 					Quat wanted_rot(Vec3(0, 1, 0), angle);
-					Quat old_rot = m_universe.getRotation(agent.entity);
-					Quat new_rot = nlerp(wanted_rot, old_rot, 0.90f);
-					m_universe.setRotation(agent.entity, new_rot);
+					move.tr.rot = nlerp(wanted_rot, move.tr.rot, 0.90f);
 				}
 			}
 			else if (agent.flags & Agent::GET_ROOT_MOTION_FROM_ANIM_CONTROLLER && anim_scene) {
 				if (anim_scene->getUniverse().hasComponent(agent.entity, ANIMATOR_TYPE)) {
 					LocalRigidTransform root_motion = anim_scene->getAnimatorRootMotion(agent.entity);
-					m_universe.setRotation(agent.entity, m_universe.getRotation(agent.entity) * root_motion.rot);
+					move.tr.rot = move.tr.rot * root_motion.rot;
 				}
 			}
 
@@ -437,7 +946,7 @@ struct NavigationSceneImpl final : public NavigationScene
 				if (!agent.is_finished) {
 					zone.crowd->resetMoveTarget(agent.agent);
 					agent.is_finished = true;
-					onPathFinished(agent);
+					zone.finished.push(agent.entity);
 				}
 			}
 			else if (dt_agent->ncorners == 1 && agent.stop_distance > 0) {
@@ -445,22 +954,42 @@ struct NavigationSceneImpl final : public NavigationScene
 				if (diff.squaredLength() < agent.stop_distance * agent.stop_distance) {
 					zone.crowd->resetMoveTarget(agent.agent);
 					agent.is_finished = true;
-					onPathFinished(agent);
+					zone.finished.push(agent.entity);
 				}
 			}
 			else {
 				agent.is_finished = false;
 			}
-			m_moving_agent = INVALID_ENTITY;
 		}
 	}
 
 	void lateUpdate(float time_delta, bool paused) override {
 		PROFILE_FUNCTION();
 		if (paused) return;
-		for (RecastZone& zone : m_zones) {
-			lateUpdate(zone, time_delta);
+
+		static const u32 ANIMATION_HASH = crc32("animation");
+		auto* anim_scene = (AnimationScene*)m_universe.getScene(ANIMATION_HASH);
+
+		Array<RecastZone*> zones(m_allocator);
+		getActiveZones(zones);
+		JobSystem::forEach(zones.size(), [&](int idx){
+			lateUpdate(*zones[idx], time_delta, anim_scene);
+		});
+
+		for (RecastZone* zone : zones) {
+			for (const RecastZone::AgentMove& move : zone->moves) {
+				m_moving_agent = move.entity;
+				m_universe.setTransform(move.entity, move.tr);
+			}
 		}
+		m_moving_agent = INVALID_ENTITY;
+
+		// scripts can create or destroy agents and zones, so copy the entities first
+		Array<EntityRef> finished(m_allocator);
+		for (RecastZone* zone : zones) {
+			for (EntityRef e : zone->finished) finished.push(e);
+		}
+		for (EntityRef e : finished) onPathFinished(e);
 	}
 
 	static float distancePtLine2d(const float* pt, const float* p, const float* q)
@@ -646,31 +1175,17 @@ struct NavigationSceneImpl final : public NavigationScene
 				return;
 			}
 
-			InputMemoryStream file(mem, size);
-			file.read(&scene.m_num_tiles_x, sizeof(scene.m_num_tiles_x));
-			file.read(&scene.m_num_tiles_z, sizeof(scene.m_num_tiles_z));
-			dtNavMeshParams params;
-			file.read(&params, sizeof(params));
-			if (dtStatusFailed(zone.navmesh->init(&params))) {
-				logError("Navigation") << "Could not init Detour navmesh";
+			const bool loaded = size >= sizeof(NavmeshFileHeader) && ((const NavmeshFileHeader*)mem)->magic == NAVMESH_FILE_MAGIC
+				? scene.loadNavmeshFile(zone, mem, size)
+				: scene.loadLegacyNavmesh(zone, mem, size);
+			if (!loaded) {
 				LUMIX_DELETE(scene.m_allocator, this);
 				return;
 			}
-			for (int j = 0; j < scene.m_num_tiles_z; ++j) {
-				for (int i = 0; i < scene.m_num_tiles_x; ++i) {
-					int data_size;
-					file.read(&data_size, sizeof(data_size));
-					u8* data = (u8*)dtAlloc(data_size, DT_ALLOC_PERM);
-					file.read(data, data_size);
-					if (dtStatusFailed(zone.navmesh->addTile(data, data_size, DT_TILE_FREE_DATA, 0, 0))) {
-						dtFree(data);
-						LUMIX_DELETE(scene.m_allocator, this);
-						return;
-					}
-				}
-			}
 
+			scene.updateStreaming(zone);
 			if (!zone.crowd) scene.initCrowd(zone);
+			scene.markObstaclesDirty(entity);
 
 			LUMIX_DELETE(scene.m_allocator, this);
 		}
@@ -679,7 +1194,221 @@ struct NavigationSceneImpl final : public NavigationScene
 		EntityRef entity;
 	};
 
+	bool loadLegacyNavmesh(RecastZone& zone, const u8* mem, u64 size) {
+		InputMemoryStream file(mem, size);
+		file.read(&m_num_tiles_x, sizeof(m_num_tiles_x));
+		file.read(&m_num_tiles_z, sizeof(m_num_tiles_z));
+		dtNavMeshParams params;
+		file.read(&params, sizeof(params));
+		if (dtStatusFailed(zone.navmesh->init(&params))) {
+			logError("Navigation") << "Could not init Detour navmesh";
+			return false;
+		}
+		for (int j = 0; j < m_num_tiles_z; ++j) {
+			for (int i = 0; i < m_num_tiles_x; ++i) {
+				int data_size;
+				file.read(&data_size, sizeof(data_size));
+				u8* data = (u8*)dtAlloc(data_size, DT_ALLOC_PERM);
+				file.read(data, data_size);
+				if (dtStatusFailed(zone.navmesh->addTile(data, data_size, DT_TILE_FREE_DATA, 0, 0))) {
+					dtFree(data);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// detour writes links to tile data, so the file content is copied to a single writable buffer
+	bool loadNavmeshFile(RecastZone& zone, const u8* mem, u64 size) {
+		if (size < sizeof(NavmeshFileHeader)) {
+			logError("Navigation") << "Corrupted navmesh file";
+			return false;
+		}
+
+		const NavmeshFileHeader& header = *(const NavmeshFileHeader*)mem;
+		const u64 table_end = sizeof(header) + sizeof(NavmeshFileTile) * (u64(header.tiles_x) * u64(header.tiles_z));
+		if (header.version > NAVMESH_FILE_VERSION || header.tiles_x < 0 || header.tiles_z < 0 || table_end > size) {
+			logError("Navigation") << "Unsupported or corrupted navmesh file";
+			return false;
+		}
+
+		NavmeshFile* file = LUMIX_NEW(m_allocator, NavmeshFile)(m_allocator);
+		file->data = (u8*)m_allocator.allocate_aligned(size, NAVMESH_FILE_ALIGN);
+		file->size = size;
+		memcpy(file->data, mem, size);
+		zone.file = file;
+
+		if (dtStatusFailed(zone.navmesh->init(&header.params))) {
+			logError("Navigation") << "Could not init Detour navmesh";
+			return false;
+		}
+
+		m_num_tiles_x = header.tiles_x;
+		m_num_tiles_z = header.tiles_z;
+		const NavmeshFileTile* tiles = file->getTiles();
+		for (int i = 0, c = header.tiles_x * header.tiles_z; i < c; ++i) {
+			if (tiles[i].size == 0) continue;
+			if (tiles[i].offset % NAVMESH_FILE_ALIGN != 0 || u64(tiles[i].offset) + tiles[i].size > size) {
+				logError("Navigation") << "Corrupted navmesh file";
+				return false;
+			}
+		}
+
+		if (zone.streaming_radius > 0) return true;
+
+		for (int i = 0, c = header.tiles_x * header.tiles_z; i < c; ++i) {
+			if (!loadTile(zone, i % header.tiles_x, i / header.tiles_x)) return false;
+		}
+		return true;
+	}
+
+	bool loadTile(RecastZone& zone, int x, int z) {
+		const NavmeshFile& file = *zone.file;
+		const NavmeshFileTile& tile = file.getTiles()[x + z * file.getHeader().tiles_x];
+		if (tile.size == 0) return true;
+
+		if (dtStatusFailed(zone.navmesh->addTile(file.data + tile.offset, tile.size, 0, 0, nullptr))) {
+			logError("Navigation") << "Could not add Detour tile.";
+			return false;
+		}
+
+		// tile data in file does not contain obstacles
+		for (const NavmeshObstacle& obstacle : m_obstacles) {
+			if (obstacle.zone != zone.entity) continue;
+			
+			const IVec4 range = getTileRange(zone, obstacle.aabb);
+			if (x < range.x || x > range.z || z < range.y || z > range.w) continue;
+
+			const u64 key = getTileKey(zone.entity, x, z);
+			if (m_dirty_tiles.indexOf(key) < 0) m_dirty_tiles.push(key);
+		}
+		return true;
+	}
+
+	static IVec4 getStreamRange(const NavmeshFileHeader& header, const Vec3& pos, float radius) {
+		const float tile_width = header.params.tileWidth;
+		const float tile_height = header.params.tileHeight;
+		const Vec3& orig = *(const Vec3*)header.params.orig;
+		IVec4 range;
+		range.x = maximum(0, int(floorf((pos.x - radius - orig.x) / tile_width)));
+		range.y = maximum(0, int(floorf((pos.z - radius - orig.z) / tile_height)));
+		range.z = minimum(header.tiles_x - 1, int(floorf((pos.x + radius - orig.x) / tile_width)));
+		range.w = minimum(header.tiles_z - 1, int(floorf((pos.z + radius - orig.z) / tile_height)));
+		return range;
+	}
+
+	static bool isInRanges(const Array<IVec4>& ranges, int x, int z) {
+		for (const IVec4& r : ranges) {
+			if (x >= r.x && x <= r.z && z >= r.y && z <= r.w) return true;
+		}
+		return false;
+	}
+
+	static bool containsRange(const Array<IVec4>& ranges, const IVec4& range) {
+		for (const IVec4& r : ranges) {
+			if (memcmp(&r, &range, sizeof(r)) == 0) return true;
+		}
+		return false;
+	}
+
+	void unloadStreamedTile(RecastZone& zone, int x, int z) {
+		if (!zone.navmesh->getTileAt(x, z, 0)) return;
+		if (isInRanges(zone.file->keep_ranges, x, z)) return;
+		// frees data only if the tile was rebuilt, i.e. has DT_TILE_FREE_DATA
+		zone.navmesh->removeTile(zone.navmesh->getTileRefAt(x, z, 0), nullptr, nullptr);
+	}
+
+	// loads tiles around agents and active camera, unloads distant tiles
+	// only tile ranges which changed since the last update are visited
+	void updateStreaming(RecastZone& zone) {
+		if (!zone.file || !zone.navmesh || zone.streaming_radius <= 0) return;
+
+		NavmeshFile& file = *zone.file;
+		const NavmeshFileHeader& header = file.getHeader();
+		file.needed_ranges.clear();
+		file.keep_ranges.clear();
+
+		const Transform inv_zone_tr = m_universe.getTransform(zone.entity).inverted();
+		auto addSource = [&](const DVec3& world_pos){
+			const Vec3 pos = inv_zone_tr.transform(world_pos).toFloat();
+			file.needed_ranges.push(getStreamRange(header, pos, zone.streaming_radius));
+			file.keep_ranges.push(getStreamRange(header, pos, zone.streaming_radius * STREAM_OUT_FACTOR));
+		};
+
+		for (EntityRef agent : zone.agents) addSource(m_universe.getPosition(agent));
+		auto* render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
+		const EntityPtr camera = render_scene ? render_scene->getActiveCamera() : INVALID_ENTITY;
+		if (camera.isValid()) addSource(m_universe.getPosition((EntityRef)camera));
+
+		if (!file.stream_rescan
+			&& file.keep_ranges.size() == file.prev_keep_ranges.size()
+			&& memcmp(file.keep_ranges.begin(), file.prev_keep_ranges.begin(), file.keep_ranges.byte_size()) == 0
+			&& memcmp(file.needed_ranges.begin(), file.prev_needed_ranges.begin(), file.needed_ranges.byte_size()) == 0)
+		{
+			return;
+		}
+
+		if (file.stream_rescan) {
+			for (int z = 0; z < header.tiles_z; ++z) {
+				for (int x = 0; x < header.tiles_x; ++x) {
+					unloadStreamedTile(zone, x, z);
+				}
+			}
+			file.prev_needed_ranges.clear();
+			file.stream_rescan = false;
+		}
+		else {
+			for (const IVec4& r : file.prev_keep_ranges) {
+				if (containsRange(file.keep_ranges, r)) continue;
+				for (int z = r.y; z <= r.w; ++z) {
+					for (int x = r.x; x <= r.z; ++x) {
+						unloadStreamedTile(zone, x, z);
+					}
+				}
+			}
+		}
+
+		for (const IVec4& r : file.needed_ranges) {
+			if (containsRange(file.prev_needed_ranges, r)) continue;
+			for (int z = r.y; z <= r.w; ++z) {
+				for (int x = r.x; x <= r.z; ++x) {
+					if (!zone.navmesh->getTileAt(x, z, 0)) loadTile(zone, x, z);
+				}
+			}
+		}
+
+		file.prev_needed_ranges.swap(file.needed_ranges);
+		file.prev_keep_ranges.swap(file.keep_ranges);
+	}
+
+	void updateStreaming() {
+		PROFILE_FUNCTION();
+		for (RecastZone& zone : m_zones) updateStreaming(zone);
+	}
+
+	void setNavmeshStreamingRadius(EntityRef zone_entity, float radius) override {
+		RecastZone& zone = m_zones[zone_entity];
+		const bool was_streamed = zone.streaming_radius > 0;
+		zone.streaming_radius = radius;
+		if (zone.file) zone.file->stream_rescan = true;
+		if (!zone.file || !zone.navmesh || radius > 0 || !was_streamed) return;
+
+		const NavmeshFileHeader& header = zone.file->getHeader();
+		for (int z = 0; z < header.tiles_z; ++z) {
+			for (int x = 0; x < header.tiles_x; ++x) {
+				if (!zone.navmesh->getTileAt(x, z, 0)) loadTile(zone, x, z);
+			}
+		}
+	}
+
+	float getNavmeshStreamingRadius(EntityRef zone) override {
+		return m_zones[zone].streaming_radius;
+	}
+
 	bool load(EntityRef zone_entity, const char* path) override {
+		cancelNavmeshBuild(zone_entity);
+		clearTileLayers(zone_entity);
 		RecastZone& zone = m_zones[zone_entity];
 		clearNavmesh(zone);
 
@@ -700,18 +1429,46 @@ struct NavigationSceneImpl final : public NavigationScene
 		OS::OutputFile file;
 		if (!fs.open(path, Ref(file))) return false;
 
-		bool success = file.write(&m_num_tiles_x, sizeof(m_num_tiles_x));
-		success = success && file.write(&m_num_tiles_z, sizeof(m_num_tiles_z));
-		const dtNavMeshParams* params = zone.navmesh->getParams();
-		success = success && file.write(params, sizeof(*params));
+		const dtNavMesh& navmesh = *zone.navmesh;
+		NavmeshFileHeader header;
+		header.tiles_x = m_num_tiles_x;
+		header.tiles_z = m_num_tiles_z;
+		header.params = *navmesh.getParams();
+
+		// tiles streamed out are copied from the loaded file
+		Array<NavmeshFileTile> tiles(m_allocator);
+		Array<const u8*> tiles_data(m_allocator);
+		tiles.resize(m_num_tiles_x * m_num_tiles_z);
+		tiles_data.resize(tiles.size());
+		u32 offset = sizeof(header) + tiles.byte_size();
 		for (int j = 0; j < m_num_tiles_z; ++j) {
 			for (int i = 0; i < m_num_tiles_x; ++i) {
-				const auto* tile = zone.navmesh->getTileAt(i, j, 0);
-				success = success && file.write(&tile->dataSize, sizeof(tile->dataSize));
-				success = success && file.write(tile->data, tile->dataSize);
+				const int idx = i + j * m_num_tiles_x;
+				const dtMeshTile* tile = navmesh.getTileAt(i, j, 0);
+				tiles_data[idx] = tile ? tile->data : nullptr;
+				tiles[idx].size = tile ? tile->dataSize : 0;
+				if (!tile && zone.file && zone.file->getHeader().tiles_x == m_num_tiles_x && zone.file->getHeader().tiles_z == m_num_tiles_z) {
+					const NavmeshFileTile& file_tile = zone.file->getTiles()[idx];
+					tiles_data[idx] = zone.file->data + file_tile.offset;
+					tiles[idx].size = file_tile.size;
+				}
+				offset = (offset + NAVMESH_FILE_ALIGN - 1) & ~(NAVMESH_FILE_ALIGN - 1);
+				tiles[idx].offset = offset;
+				offset += tiles[idx].size;
 			}
 		}
 
+		bool success = file.write(&header, sizeof(header));
+		success = success && file.write(tiles.begin(), tiles.byte_size());
+		u64 pos = sizeof(header) + tiles.byte_size();
+		static const u8 padding[NAVMESH_FILE_ALIGN] = {};
+		for (int i = 0; i < tiles.size(); ++i) {
+			if (tiles[i].size == 0) continue;
+			success = success && file.write(padding, tiles[i].offset - pos);
+			success = success && file.write(tiles_data[i], tiles[i].size);
+			pos = tiles[i].offset + tiles[i].size;
+		}
+
 		file.close();
 		return success;
 	}
@@ -947,11 +1704,10 @@ struct NavigationSceneImpl final : public NavigationScene
 	{
 		for (RecastZone& zone : m_zones) {
 			if (zone.crowd) {
-				for (Agent& agent : m_agents) {
-					if (agent.zone == zone.entity) {
-						zone.crowd->removeAgent(agent.agent);
-						agent.agent = -1;
-					}
+				for (EntityRef entity : zone.agents) {
+					Agent& agent = m_agents[entity];
+					if (agent.agent >= 0) zone.crowd->removeAgent(agent.agent);
+					agent.agent = -1;
 				}
 				dtFreeCrowd(zone.crowd);
 				zone.crowd = nullptr;
@@ -994,9 +1750,12 @@ struct NavigationSceneImpl final : public NavigationScene
 				&& pos.x < max.x && pos.y < max.y && pos.z < max.z)
 			{
 				agent.zone = zone.entity;
-				addCrowdAgent(agent, zone);
+				zone.agents.push(agent.entity);
 			}
 		}
+		for (EntityRef entity : zone.agents) {
+			addCrowdAgent(m_agents[entity], zone);
+		}
 		return true;
 	}
 
@@ -1104,6 +1863,11 @@ struct NavigationSceneImpl final : public NavigationScene
 
 
 	bool generateTileAt(EntityRef zone_entity, const DVec3& world_pos, bool keep_data) override {
+		if (getBuildIndex(zone_entity) >= 0) {
+			logError("Navigation") << "Could not generate tile, navmesh is being built.";
+			return false;
+		}
+		clearTileLayers(zone_entity);
 		RecastZone& zone = m_zones[zone_entity];
 		const Transform tr = m_universe.getTransform(zone_entity);
 		const Vec3 pos = tr.inverted().transform(world_pos).toFloat();
@@ -1113,149 +1877,316 @@ struct NavigationSceneImpl final : public NavigationScene
 		return generateTile(zone, zone_entity, x, z, keep_data);
 	}
 
-	bool generateTile(RecastZone& zone, EntityRef zone_entity, int x, int z, bool keep_data) {
-		PROFILE_FUNCTION();
-		if (!zone.navmesh) return false;
-
-		zone.navmesh->removeTile(zone.navmesh->getTileRefAt(x, z, 0), 0, 0);
-
-		rcContext ctx;
-		const Vec3 min = -zone.zone.extents;
-		const Vec3 max = zone.zone.extents;
-		Vec3 bmin(min.x + x * CELLS_PER_TILE_SIDE * CELL_SIZE - (1 + m_config.borderSize) * m_config.cs,
+	static AABB getTileAABB(const rcConfig& cfg, const Vec3& min, const Vec3& max, int x, int z) {
+		const float border = (1 + cfg.borderSize) * cfg.cs;
+		const Vec3 bmin(min.x + x * CELLS_PER_TILE_SIDE * CELL_SIZE - border,
 			min.y,
-			min.z + z * CELLS_PER_TILE_SIDE * CELL_SIZE - (1 + m_config.borderSize) * m_config.cs);
-		Vec3 bmax(bmin.x + CELLS_PER_TILE_SIDE * CELL_SIZE + (1 + m_config.borderSize) * m_config.cs,
+			min.z + z * CELLS_PER_TILE_SIDE * CELL_SIZE - border);
+		const Vec3 bmax(bmin.x + CELLS_PER_TILE_SIDE * CELL_SIZE + border,
 			max.y,
-			bmin.z + CELLS_PER_TILE_SIDE * CELL_SIZE + (1 + m_config.borderSize) * m_config.cs);
-		if (keep_data) m_debug_tile_origin = bmin;
-		rcVcopy(m_config.bmin, &bmin.x);
-		rcVcopy(m_config.bmax, &bmax.x);
-		rcHeightfield* solid = rcAllocHeightfield();
-		zone.debug_heightfield = keep_data ? solid : nullptr;
-		if (!solid) {
-			logError("Navigation") << "Could not generate navmesh: Out of memory 'solid'.";
-			return false;
-		}
+			bmin.z + CELLS_PER_TILE_SIDE * CELL_SIZE + border);
+		return AABB(bmin, bmax);
+	}
 
-		if (!rcCreateHeightfield(
-				&ctx, *solid, m_config.width, m_config.height, m_config.bmin, m_config.bmax, m_config.cs, m_config.ch))
-		{
-			logError("Navigation") << "Could not generate navmesh: Could not create solid heightfield.";
-			return false;
+	// intermediate Recast data of a single tile, either freed or handed over to debug_zone
+	struct TileScratch {
+		~TileScratch() {
+			if (debug_zone) {
+				debug_zone->debug_heightfield = solid;
+				debug_zone->debug_compact_heightfield = chf;
+				debug_zone->debug_contours = cset;
+			}
+			else {
+				rcFreeHeightField(solid);
+				rcFreeCompactHeightfield(chf);
+				rcFreeContourSet(cset);
+			}
+			rcFreePolyMesh(polymesh);
+			rcFreePolyMeshDetail(detail_mesh);
 		}
 
-		const Transform tr = m_universe.getTransform(zone_entity);
-		rasterizeGeometry(tr, AABB(bmin, bmax), ctx, m_config, *solid);
+		RecastZone* debug_zone = nullptr;
+		rcHeightfield* solid = nullptr;
+		rcCompactHeightfield* chf = nullptr;
+		rcContourSet* cset = nullptr;
+		rcPolyMesh* polymesh = nullptr;
+		rcPolyMeshDetail* detail_mesh = nullptr;
+	};
 
-		rcFilterLowHangingWalkableObstacles(&ctx, m_config.walkableClimb, *solid);
-		rcFilterLedgeSpans(&ctx, m_config.walkableHeight, m_config.walkableClimb, *solid);
-		rcFilterWalkableLowHeightSpans(&ctx, m_config.walkableHeight, *solid);
+	static rcConfig getTileConfig(const rcConfig& base_config, const Vec3& min, const Vec3& max, int x, int z) {
+		rcConfig cfg = base_config;
+		const AABB aabb = getTileAABB(cfg, min, max, x, z);
+		rcVcopy(cfg.bmin, &aabb.min.x);
+		rcVcopy(cfg.bmax, &aabb.max.x);
+		return cfg;
+	}
 
-		rcCompactHeightfield* chf = rcAllocCompactHeightfield();
-		zone.debug_compact_heightfield = keep_data ? chf : nullptr;
-		if (!chf) {
-			logError("Navigation") << "Could not generate navmesh: Out of memory 'chf'.";
-			return false;
-		}
+	// rasterizes the tile into scratch.chf, walkable area is already eroded
+	static const char* buildTileLayer(const NavmeshGeometry& geometry, const rcConfig& cfg, int x, int z, rcContext& ctx, TileScratch& scratch) {
+		PROFILE_FUNCTION();
+		scratch.solid = rcAllocHeightfield();
+		if (!scratch.solid) return "Out of memory 'solid'.";
 
-		if (!rcBuildCompactHeightfield(&ctx, m_config.walkableHeight, m_config.walkableClimb, *solid, *chf)) {
-			logError("Navigation") << "Could not generate navmesh: Could not build compact data.";
-			return false;
+		if (!rcCreateHeightfield(&ctx, *scratch.solid, cfg.width, cfg.height, cfg.bmin, cfg.bmax, cfg.cs, cfg.ch)) {
+			return "Could not create solid heightfield.";
 		}
 
-		if (!zone.debug_heightfield) rcFreeHeightField(solid);
+		const AABB aabb(Vec3(cfg.bmin[0], cfg.bmin[1], cfg.bmin[2]), Vec3(cfg.bmax[0], cfg.bmax[1], cfg.bmax[2]));
+		rasterizeGeometry(geometry, geometry.getTileIndex(x, z), aabb, ctx, *scratch.solid);
 
-		if (!rcErodeWalkableArea(&ctx, m_config.walkableRadius, *chf)) {
-			logError("Navigation") << "Could not generate navmesh: Could not erode.";
-			return false;
-		}
+		rcFilterLowHangingWalkableObstacles(&ctx, cfg.walkableClimb, *scratch.solid);
+		rcFilterLedgeSpans(&ctx, cfg.walkableHeight, cfg.walkableClimb, *scratch.solid);
+		rcFilterWalkableLowHeightSpans(&ctx, cfg.walkableHeight, *scratch.solid);
 
-		if (!rcBuildDistanceField(&ctx, *chf)) {
-			logError("Navigation") << "Could not generate navmesh: Could not build distance field.";
-			return false;
-		}
+		scratch.chf = rcAllocCompactHeightfield();
+		if (!scratch.chf) return "Out of memory 'chf'.";
 
-		if (!rcBuildRegions(&ctx, *chf, m_config.borderSize, m_config.minRegionArea, m_config.mergeRegionArea)) {
-			logError("Navigation") << "Could not generate navmesh: Could not build regions.";
-			return false;
+		if (!rcBuildCompactHeightfield(&ctx, cfg.walkableHeight, cfg.walkableClimb, *scratch.solid, *scratch.chf)) {
+			return "Could not build compact data.";
 		}
 
-		rcContourSet* cset = rcAllocContourSet();
-		zone.debug_contours = keep_data ? cset : nullptr;
-		if (!cset) {
-			ctx.log(RC_LOG_ERROR, "Could not generate navmesh: Out of memory 'cset'.");
-			return false;
+		if (!scratch.debug_zone) {
+			rcFreeHeightField(scratch.solid);
+			scratch.solid = nullptr;
 		}
 
-		if (!rcBuildContours(&ctx, *chf, m_config.maxSimplificationError, m_config.maxEdgeLen, *cset)) {
-			logError("Navigation") << "Could not generate navmesh: Could not create contours.";
-			return false;
+		if (!rcErodeWalkableArea(&ctx, cfg.walkableRadius, *scratch.chf)) return "Could not erode.";
+		return nullptr;
+	}
+
+	// obstacles are marked after erosion, so they are expanded by the agent radius here
+	static void markObstacles(const Array<NavmeshObstacle>& obstacles, const rcConfig& cfg, rcContext& ctx, rcCompactHeightfield& chf) {
+		const AABB aabb(Vec3(cfg.bmin[0], cfg.bmin[1], cfg.bmin[2]), Vec3(cfg.bmax[0], cfg.bmax[1], cfg.bmax[2]));
+		const float offset = cfg.walkableRadius * cfg.cs;
+		for (const NavmeshObstacle& obstacle : obstacles) {
+			if (!obstacle.aabb.overlaps(aabb)) continue;
+
+			switch (obstacle.type) {
+				case NavmeshObstacle::Type::CYLINDER:
+					rcMarkCylinderArea(&ctx, &obstacle.pos.x, obstacle.radius + offset, obstacle.height, RC_NULL_AREA, chf);
+					break;
+				case NavmeshObstacle::Type::BOX: {
+					const float c = cosf(obstacle.yaw);
+					const float s = sinf(obstacle.yaw);
+					const float hx = obstacle.half_extents.x + offset;
+					const float hz = obstacle.half_extents.z + offset;
+					const Vec2 corners[] = { {-hx, -hz}, {hx, -hz}, {hx, hz}, {-hx, hz} };
+					float verts[lengthOf(corners) * 3];
+					for (u32 i = 0; i < lengthOf(corners); ++i) {
+						verts[i * 3 + 0] = obstacle.pos.x + corners[i].x * c + corners[i].y * s;
+						verts[i * 3 + 1] = obstacle.pos.y;
+						verts[i * 3 + 2] = obstacle.pos.z - corners[i].x * s + corners[i].y * c;
+					}
+					const float hmin = obstacle.pos.y - obstacle.half_extents.y;
+					const float hmax = obstacle.pos.y + obstacle.half_extents.y;
+					rcMarkConvexPolyArea(&ctx, verts, lengthOf(corners), hmin, hmax, RC_NULL_AREA, chf);
+					break;
+				}
+				case NavmeshObstacle::Type::CONVEX: {
+					const float c = cosf(obstacle.yaw);
+					const float s = sinf(obstacle.yaw);
+					float verts[NavmeshObstacle::MAX_VERTS * 3];
+					for (int i = 0; i < obstacle.verts_count; ++i) {
+						Vec2 v = obstacle.verts[i];
+						const float len = v.length();
+						if (len > 0) v *= (len + offset) / len;
+						verts[i * 3 + 0] = obstacle.pos.x + v.x * c + v.y * s;
+						verts[i * 3 + 1] = obstacle.pos.y;
+						verts[i * 3 + 2] = obstacle.pos.z - v.x * s + v.y * c;
+					}
+					rcMarkConvexPolyArea(&ctx, verts, obstacle.verts_count, obstacle.pos.y, obstacle.pos.y + obstacle.height, RC_NULL_AREA, chf);
+					break;
+				}
+			}
 		}
+	}
 
-		zone.polymesh = rcAllocPolyMesh();
-		if (!zone.polymesh) {
-			logError("Navigation") << "Could not generate navmesh: Out of memory 'm_polymesh'.";
-			return false;
+	// builds Detour tile data from an eroded compact heightfield, tiles without any polygon produce no data
+	static const char* buildTileMesh(const rcConfig& cfg
+		, rcCompactHeightfield& chf
+		, const Array<NavmeshObstacle>& obstacles
+		, int x
+		, int z
+		, rcContext& ctx
+		, TileScratch& scratch
+		, u8** nav_data
+		, int* nav_data_size)
+	{
+		PROFILE_FUNCTION();
+		*nav_data = nullptr;
+		*nav_data_size = 0;
+
+		markObstacles(obstacles, cfg, ctx, chf);
+
+		if (!rcBuildDistanceField(&ctx, chf)) return "Could not build distance field.";
+		if (!rcBuildRegions(&ctx, chf, cfg.borderSize, cfg.minRegionArea, cfg.mergeRegionArea)) {
+			return "Could not build regions.";
 		}
-		if (!rcBuildPolyMesh(&ctx, *cset, m_config.maxVertsPerPoly, *zone.polymesh)) {
-			logError("Navigation") << "Could not generate navmesh: Could not triangulate contours.";
-			return false;
+
+		scratch.cset = rcAllocContourSet();
+		if (!scratch.cset) return "Out of memory 'cset'.";
+
+		if (!rcBuildContours(&ctx, chf, cfg.maxSimplificationError, cfg.maxEdgeLen, *scratch.cset)) {
+			return "Could not create contours.";
 		}
 
-		zone.detail_mesh = rcAllocPolyMeshDetail();
-		if (!zone.detail_mesh) {
-			logError("Navigation") << "Could not generate navmesh: Out of memory 'pmdtl'.";
-			return false;
+		scratch.polymesh = rcAllocPolyMesh();
+		if (!scratch.polymesh) return "Out of memory 'polymesh'.";
+		if (!rcBuildPolyMesh(&ctx, *scratch.cset, cfg.maxVertsPerPoly, *scratch.polymesh)) {
+			return "Could not triangulate contours.";
 		}
 
+		scratch.detail_mesh = rcAllocPolyMeshDetail();
+		if (!scratch.detail_mesh) return "Out of memory 'pmdtl'.";
+
 		if (!rcBuildPolyMeshDetail(
-				&ctx, *zone.polymesh, *chf, m_config.detailSampleDist, m_config.detailSampleMaxError, *zone.detail_mesh))
+				&ctx, *scratch.polymesh, chf, cfg.detailSampleDist, cfg.detailSampleMaxError, *scratch.detail_mesh))
 		{
-			logError("Navigation") << "Could not generate navmesh: Could not build detail mesh.";
-			return false;
+			return "Could not build detail mesh.";
 		}
 
-		if (!zone.debug_compact_heightfield) rcFreeCompactHeightfield(chf);
-		if (!zone.debug_contours) rcFreeContourSet(cset);
+		rcPolyMesh& polymesh = *scratch.polymesh;
+		if (polymesh.npolys == 0) return nullptr;
 
-		unsigned char* nav_data = 0;
-		int nav_data_size = 0;
-
-		for (int i = 0; i < zone.polymesh->npolys; ++i) {
-			zone.polymesh->flags[i] = zone.polymesh->areas[i] == RC_WALKABLE_AREA ? 1 : 0;
+		for (int i = 0; i < polymesh.npolys; ++i) {
+			polymesh.flags[i] = polymesh.areas[i] == RC_WALKABLE_AREA ? 1 : 0;
 		}
 
 		dtNavMeshCreateParams params = {};
-		params.verts = zone.polymesh->verts;
-		params.vertCount = zone.polymesh->nverts;
-		params.polys = zone.polymesh->polys;
-		params.polyAreas = zone.polymesh->areas;
-		params.polyFlags = zone.polymesh->flags;
-		params.polyCount = zone.polymesh->npolys;
-		params.nvp = zone.polymesh->nvp;
-		params.detailMeshes = zone.detail_mesh->meshes;
-		params.detailVerts = zone.detail_mesh->verts;
-		params.detailVertsCount = zone.detail_mesh->nverts;
-		params.detailTris = zone.detail_mesh->tris;
-		params.detailTriCount = zone.detail_mesh->ntris;
-		params.walkableHeight = m_config.walkableHeight * m_config.ch;
-		params.walkableRadius = m_config.walkableRadius * m_config.cs;
-		params.walkableClimb = m_config.walkableClimb * m_config.ch;
+		params.verts = polymesh.verts;
+		params.vertCount = polymesh.nverts;
+		params.polys = polymesh.polys;
+		params.polyAreas = polymesh.areas;
+		params.polyFlags = polymesh.flags;
+		params.polyCount = polymesh.npolys;
+		params.nvp = polymesh.nvp;
+		params.detailMeshes = scratch.detail_mesh->meshes;
+		params.detailVerts = scratch.detail_mesh->verts;
+		params.detailVertsCount = scratch.detail_mesh->nverts;
+		params.detailTris = scratch.detail_mesh->tris;
+		params.detailTriCount = scratch.detail_mesh->ntris;
+		params.walkableHeight = cfg.walkableHeight * cfg.ch;
+		params.walkableRadius = cfg.walkableRadius * cfg.cs;
+		params.walkableClimb = cfg.walkableClimb * cfg.ch;
 		params.tileX = x;
 		params.tileY = z;
-		rcVcopy(params.bmin, zone.polymesh->bmin);
-		rcVcopy(params.bmax, zone.polymesh->bmax);
-		params.cs = m_config.cs;
-		params.ch = m_config.ch;
+		rcVcopy(params.bmin, polymesh.bmin);
+		rcVcopy(params.bmax, polymesh.bmax);
+		params.cs = cfg.cs;
+		params.ch = cfg.ch;
 		params.buildBvTree = false;
 
-		if (!dtCreateNavMeshData(&params, &nav_data, &nav_data_size)) {
-			logError("Navigation") << "Could not build Detour navmesh.";
+		if (!dtCreateNavMeshData(&params, nav_data, nav_data_size)) return "Could not build Detour navmesh.";
+		return nullptr;
+	}
+
+	// can run on any thread, returns error message or nullptr
+	static const char* buildTile(const NavmeshGeometry& geometry
+		, const rcConfig& base_config
+		, const Vec3& min
+		, const Vec3& max
+		, int x
+		, int z
+		, const Array<NavmeshObstacle>& obstacles
+		, RecastZone* debug_zone
+		, u8** nav_data
+		, int* nav_data_size)
+	{
+		PROFILE_FUNCTION();
+		*nav_data = nullptr;
+		*nav_data_size = 0;
+
+		rcContext ctx;
+		const rcConfig cfg = getTileConfig(base_config, min, max, x, z);
+		TileScratch scratch;
+		scratch.debug_zone = debug_zone;
+		const char* error = buildTileLayer(geometry, cfg, x, z, ctx, scratch);
+		if (error) return error;
+
+		return buildTileMesh(cfg, *scratch.chf, obstacles, x, z, ctx, scratch, nav_data, nav_data_size);
+	}
+
+	static void rebuildTileJob(void* data) {
+		PROFILE_FUNCTION();
+		NavmeshTileRebuild* rebuild = (NavmeshTileRebuild*)data;
+		NavmeshTileLayer& layer = *rebuild->layer;
+
+		rcContext ctx;
+		TileScratch scratch;
+		if (layer.chf) {
+			memcpy(layer.chf->areas, layer.areas.begin(), layer.areas.size());
+		}
+		else {
+			NavmeshGeometry& geometry = rebuild->geometry;
+			finishGeometry(rebuild->base_config, rebuild->min, geometry);
+			Array<float4> tmp(geometry.allocator);
+			for (int i = 0; i < geometry.chunks.size(); ++i) {
+				prepareChunk(geometry, i, tmp);
+			}
+			rebuild->error = buildTileLayer(geometry, rebuild->config, rebuild->x, rebuild->z, ctx, scratch);
+			if (!rebuild->error) {
+				layer.chf = scratch.chf;
+				scratch.chf = nullptr;
+				layer.areas.resize(layer.chf->spanCount);
+				memcpy(layer.areas.begin(), layer.chf->areas, layer.chf->spanCount);
+			}
+		}
+
+		if (!rebuild->error) {
+			rebuild->error = buildTileMesh(rebuild->config
+				, *layer.chf
+				, rebuild->obstacles
+				, rebuild->x
+				, rebuild->z
+				, ctx
+				, scratch
+				, &rebuild->data
+				, &rebuild->data_size);
+		}
+		MT::memoryBarrier();
+		rebuild->is_done = 1;
+	}
+
+	bool generateTile(RecastZone& zone, EntityRef zone_entity, int x, int z, bool keep_data) {
+		PROFILE_FUNCTION();
+		if (!zone.navmesh) return false;
+
+		zone.navmesh->removeTile(zone.navmesh->getTileRefAt(x, z, 0), 0, 0);
+
+		const Vec3 min = -zone.zone.extents;
+		const Vec3 max = zone.zone.extents;
+		const AABB aabb = getTileAABB(m_config, min, max, x, z);
+		if (keep_data) {
+			m_debug_tile_origin = aabb.min;
+			rcFreeCompactHeightfield(zone.debug_compact_heightfield);
+			rcFreeHeightField(zone.debug_heightfield);
+			rcFreeContourSet(zone.debug_contours);
+			zone.debug_compact_heightfield = nullptr;
+			zone.debug_heightfield = nullptr;
+			zone.debug_contours = nullptr;
+		}
+
+		NavmeshGeometry geometry(m_allocator);
+		gatherGeometry(m_universe.getTransform(zone_entity), m_config, min, max, IVec2(x, z), IVec2(1, 1), geometry);
+		finishGeometry(m_config, min, geometry);
+		Array<float4> tmp(m_allocator);
+		for (int i = 0; i < geometry.chunks.size(); ++i) {
+			prepareChunk(geometry, i, tmp);
+		}
+
+		u8* nav_data;
+		int nav_data_size;
+		Array<NavmeshObstacle> obstacles(m_allocator);
+		getObstacles(zone_entity, obstacles);
+		const char* error = buildTile(geometry, m_config, min, max, x, z, obstacles, keep_data ? &zone : nullptr, &nav_data, &nav_data_size);
+		if (error) {
+			logError("Navigation") << "Could not generate navmesh: " << error;
 			return false;
 		}
+		if (!nav_data) return true;
 
 		if (dtStatusFailed(zone.navmesh->addTile(nav_data, nav_data_size, DT_TILE_FREE_DATA, 0, nullptr))) {
+			dtFree(nav_data);
 			logError("Navigation") << "Could not add Detour tile.";
 			return false;
 		}
@@ -1285,8 +2216,101 @@ struct NavigationSceneImpl final : public NavigationScene
 		return true;
 	}
 
+	static void prepareGeometryJob(void* data) {
+		const NavmeshBuild::Job* job = (const NavmeshBuild::Job*)data;
+		NavmeshBuild* build = job->build;
+		Array<float4> tmp(build->geometry.allocator);
+		for (i32 idx = job->from; idx < job->to; ++idx) {
+			if (build->is_canceled) return;
+
+			prepareChunk(build->geometry, idx, tmp);
+		}
+	}
+
+	static void buildTilesJob(void* data) {
+		const NavmeshBuild::Job* job = (const NavmeshBuild::Job*)data;
+		NavmeshBuild* build = job->build;
+		for (i32 idx = job->from; idx < job->to; ++idx) {
+			if (build->is_canceled) return;
+
+			NavmeshBuild::Tile& tile = build->tiles[idx];
+			tile.error = buildTile(build->geometry
+				, build->config
+				, build->min
+				, build->max
+				, tile.x
+				, tile.z
+				, build->obstacles
+				, nullptr
+				, &tile.data
+				, &tile.data_size);
+			MT::memoryBarrier();
+			tile.is_built = 1;
+		}
+	}
+
+	// tiles are built on workers, only adding them to the navmesh happens here
+	void finalizeBuilds() {
+		PROFILE_FUNCTION();
+		for (int i = m_builds.size() - 1; i >= 0; --i) {
+			NavmeshBuild* build = m_builds[i];
+			RecastZone& zone = m_zones[build->zone];
+			for (NavmeshBuild::Tile& tile : build->tiles) {
+				if (tile.is_finalized || !tile.is_built) continue;
+
+				tile.is_finalized = true;
+				++build->finalized_count;
+				if (tile.error) {
+					logError("Navigation") << "Could not generate navmesh: " << tile.error;
+					continue;
+				}
+				if (!tile.data) continue;
+
+				if (dtStatusFailed(zone.navmesh->addTile(tile.data, tile.data_size, DT_TILE_FREE_DATA, 0, nullptr))) {
+					dtFree(tile.data);
+					logError("Navigation") << "Could not add Detour tile.";
+				}
+				tile.data = nullptr;
+			}
+
+			if (build->finalized_count == (u32)build->tiles.size()) {
+				JobSystem::wait(build->signal);
+				LUMIX_DELETE(m_allocator, build);
+				m_builds.erase(i);
+			}
+		}
+	}
+
+	int getBuildIndex(EntityRef zone) const {
+		return m_builds.find([zone](NavmeshBuild* build){ return build->zone == zone; });
+	}
+
+	float getNavmeshBuildProgress(EntityRef zone) const override {
+		const int idx = getBuildIndex(zone);
+		if (idx < 0) return 1;
+		const NavmeshBuild* build = m_builds[idx];
+		return build->finalized_count / (float)build->tiles.size();
+	}
+
+	// tiles added so far stay in the navmesh
+	void cancelNavmeshBuild(EntityRef zone) override {
+		const int idx = getBuildIndex(zone);
+		if (idx < 0) return;
+
+		NavmeshBuild* build = m_builds[idx];
+		build->is_canceled = 1;
+		JobSystem::wait(build->signal);
+		for (NavmeshBuild::Tile& tile : build->tiles) {
+			if (!tile.is_finalized) dtFree(tile.data);
+		}
+		LUMIX_DELETE(m_allocator, build);
+		m_builds.erase(idx);
+	}
+
 	bool generateNavmesh(EntityRef zone_entity) override {
 		PROFILE_FUNCTION();
+		cancelNavmeshBuild(zone_entity);
+		clearTileLayers(zone_entity);
 		RecastZone& zone =  m_zones[zone_entity];
 		clearNavmesh(zone);
 
@@ -1299,10 +2323,9 @@ struct NavigationSceneImpl final : public NavigationScene
 		rcVcopy(params.orig, &min.x);
 		params.tileWidth = float(CELLS_PER_TILE_SIDE * CELL_SIZE);
 		params.tileHeight = float(CELLS_PER_TILE_SIDE * CELL_SIZE);
-		int grid_width, grid_height;
-		rcCalcGridSize(&min.x, &max.x, CELL_SIZE, &grid_width, &grid_height);
-		m_num_tiles_x = (grid_width + CELLS_PER_TILE_SIDE - 1) / CELLS_PER_TILE_SIDE;
-		m_num_tiles_z = (grid_height + CELLS_PER_TILE_SIDE - 1) / CELLS_PER_TILE_SIDE;
+		const IVec2 tile_count = getTileCount(zone);
+		m_num_tiles_x = tile_count.x;
+		m_num_tiles_z = tile_count.y;
 		params.maxTiles = m_num_tiles_x * m_num_tiles_z;
 		int tiles_bits = log2(nextPow2(params.maxTiles));
 		params.maxPolys = 1 << (22 - tiles_bits); // keep 10 bits for salt
@@ -1312,17 +2335,535 @@ struct NavigationSceneImpl final : public NavigationScene
 			return false;
 		}
 
+		NavmeshBuild* build = LUMIX_NEW(m_allocator, NavmeshBuild)(zone_entity, m_allocator);
+		build->config = m_config;
+		build->min = min;
+		build->max = max;
+		getObstacles(zone_entity, build->obstacles);
+		gatherGeometry(m_universe.getTransform(zone_entity), m_config, min, max, IVec2(0, 0), tile_count, build->geometry);
+		finishGeometry(m_config, min, build->geometry);
+
+		build->tiles.reserve(m_num_tiles_x * m_num_tiles_z);
 		for (int j = 0; j < m_num_tiles_z; ++j) {
 			for (int i = 0; i < m_num_tiles_x; ++i) {
-				if (!generateTile(zone, zone_entity, i, j, false)) {
-					return false;
-				}
+				NavmeshBuild::Tile& tile = build->tiles.emplace();
+				tile.x = i;
+				tile.z = j;
 			}
 		}
+
+		m_builds.push(build);
+		// jobs must not move once they are queued
+		build->chunk_jobs.reserve((build->geometry.chunks.size() + CHUNKS_PER_JOB - 1) / CHUNKS_PER_JOB);
+		for (i32 i = 0, c = build->geometry.chunks.size(); i < c; i += CHUNKS_PER_JOB) {
+			build->chunk_jobs.push({build, i, minimum(i + CHUNKS_PER_JOB, c)});
+		}
+		for (NavmeshBuild::Job& job : build->chunk_jobs) {
+			JobSystem::run(&job, &prepareGeometryJob, &build->prepare_signal);
+		}
+		build->tile_jobs.reserve(build->tiles.size());
+		for (i32 i = 0, c = build->tiles.size(); i < c; i += TILES_PER_JOB) {
+			build->tile_jobs.push({build, i, minimum(i + TILES_PER_JOB, c)});
+		}
+		for (NavmeshBuild::Job& job : build->tile_jobs) {
+			JobSystem::runEx(&job, &buildTilesJob, &build->signal, build->prepare_signal, JobSystem::ANY_WORKER);
+		}
 		return true;
 	}
 
 
+	static IVec2 getTileCount(const RecastZone& zone) {
+		const Vec3 min = -zone.zone.extents;
+		const Vec3 max = zone.zone.extents;
+		int grid_width, grid_height;
+		rcCalcGridSize(&min.x, &max.x, CELL_SIZE, &grid_width, &grid_height);
+		return IVec2((grid_width + CELLS_PER_TILE_SIDE - 1) / CELLS_PER_TILE_SIDE, (grid_height + CELLS_PER_TILE_SIDE - 1) / CELLS_PER_TILE_SIDE);
+	}
+
+	static u64 getTileKey(EntityRef zone, int x, int z) {
+		return ((u64)zone.index << 32) | ((u32)x & 0xffFF) | ((u32)z << 16);
+	}
+
+	void getObstacles(EntityRef zone, Array<NavmeshObstacle>& obstacles) const {
+		for (const NavmeshObstacle& obstacle : m_obstacles) {
+			if (obstacle.zone == zone) obstacles.push(obstacle);
+		}
+	}
+
+	// tiles, including their borders, overlapped by aabb; x, y - from, z, w - to, inclusive
+	IVec4 getTileRange(const RecastZone& zone, const AABB& aabb) const {
+		const Vec3 min = -zone.zone.extents;
+		const float tile_size = CELLS_PER_TILE_SIDE * CELL_SIZE;
+		const float border = (1 + m_config.borderSize) * m_config.cs;
+		const IVec2 count = getTileCount(zone);
+		const IVec2 from(maximum(0, int(floorf((aabb.min.x - min.x - border) / tile_size)))
+			, maximum(0, int(floorf((aabb.min.z - min.z - border) / tile_size))));
+		const IVec2 to(minimum(count.x - 1, int(floorf((aabb.max.x - min.x + border) / tile_size)))
+			, minimum(count.y - 1, int(floorf((aabb.max.z - min.z + border) / tile_size))));
+		return IVec4(from, to);
+	}
+
+	void markTilesDirty(const NavmeshObstacle& obstacle) {
+		const RecastZone& zone = m_zones[obstacle.zone];
+		if (!zone.navmesh) return;
+
+		const IVec4 range = getTileRange(zone, obstacle.aabb);
+		for (int z = range.y; z <= range.w; ++z) {
+			for (int x = range.x; x <= range.z; ++x) {
+				const u64 key = getTileKey(obstacle.zone, x, z);
+				if (m_dirty_tiles.indexOf(key) < 0) m_dirty_tiles.push(key);
+			}
+		}
+	}
+
+	void updateObstacleAABB(NavmeshObstacle& obstacle) {
+		float radius = 0;
+		float y_min = obstacle.pos.y;
+		float y_max = obstacle.pos.y + obstacle.height;
+		switch (obstacle.type) {
+			case NavmeshObstacle::Type::BOX:
+				radius = Vec2(obstacle.half_extents.x, obstacle.half_extents.z).length();
+				y_min = obstacle.pos.y - obstacle.half_extents.y;
+				y_max = obstacle.pos.y + obstacle.half_extents.y;
+				break;
+			case NavmeshObstacle::Type::CYLINDER:
+				radius = obstacle.radius;
+				break;
+			case NavmeshObstacle::Type::CONVEX:
+				for (int i = 0; i < obstacle.verts_count; ++i) {
+					radius = maximum(radius, obstacle.verts[i].length());
+				}
+				break;
+		}
+		// expanded by the agent radius, see markObstacles
+		radius += m_config.walkableRadius * m_config.cs;
+		obstacle.aabb.min = Vec3(obstacle.pos.x - radius, y_min, obstacle.pos.z - radius);
+		obstacle.aabb.max = Vec3(obstacle.pos.x + radius, y_max, obstacle.pos.z + radius);
+	}
+
+	void setObstaclePose(NavmeshObstacle& obstacle, const DVec3& world_pos, float yaw) {
+		const Transform zone_tr = m_universe.getTransform(obstacle.zone);
+		obstacle.pos = zone_tr.inverted().transform(world_pos).toFloat();
+		obstacle.yaw = yaw - zone_tr.rot.toEuler().y;
+		updateObstacleAABB(obstacle);
+	}
+
+	u32 addObstacle(const NavmeshObstacle& obstacle) {
+		++m_last_obstacle;
+		m_obstacles.insert(m_last_obstacle, obstacle);
+		markTilesDirty(obstacle);
+		return m_last_obstacle;
+	}
+
+	u32 addBoxObstacle(EntityRef zone, const DVec3& pos, const Vec3& half_extents, float yaw) override {
+		NavmeshObstacle obstacle;
+		obstacle.zone = zone;
+		obstacle.type = NavmeshObstacle::Type::BOX;
+		obstacle.half_extents = half_extents;
+		setObstaclePose(obstacle, pos, yaw);
+		return addObstacle(obstacle);
+	}
+
+	u32 addCylinderObstacle(EntityRef zone, const DVec3& pos, float radius, float height) override {
+		NavmeshObstacle obstacle;
+		obstacle.zone = zone;
+		obstacle.type = NavmeshObstacle::Type::CYLINDER;
+		obstacle.radius = radius;
+		obstacle.height = height;
+		setObstaclePose(obstacle, pos, 0);
+		return addObstacle(obstacle);
+	}
+
+	u32 addConvexObstacle(EntityRef zone, Span<const DVec3> points, float height) override {
+		ASSERT(points.length() >= 3);
+		NavmeshObstacle obstacle;
+		obstacle.zone = zone;
+		obstacle.type = NavmeshObstacle::Type::CONVEX;
+		obstacle.height = height;
+		obstacle.verts_count = minimum((int)points.length(), NavmeshObstacle::MAX_VERTS);
+		DVec3 center = points[0];
+		for (int i = 1; i < obstacle.verts_count; ++i) {
+			center.x += points[i].x;
+			center.y = minimum(center.y, points[i].y);
+			center.z += points[i].z;
+		}
+		center.x /= obstacle.verts_count;
+		center.z /= obstacle.verts_count;
+		for (int i = 0; i < obstacle.verts_count; ++i) {
+			obstacle.verts[i] = Vec2(float(points[i].x - center.x), float(points[i].z - center.z));
+		}
+		setObstaclePose(obstacle, center, 0);
+		return addObstacle(obstacle);
+	}
+
+	void moveObstacle(u32 handle, const DVec3& pos, float yaw) override {
+		auto iter = m_obstacles.find(handle);
+		if (!iter.isValid()) return;
+
+		NavmeshObstacle& obstacle = iter.value();
+		markTilesDirty(obstacle);
+		setObstaclePose(obstacle, pos, yaw);
+		markTilesDirty(obstacle);
+	}
+
+	void removeObstacle(u32 handle) override {
+		auto iter = m_obstacles.find(handle);
+		if (!iter.isValid()) return;
+
+		markTilesDirty(iter.value());
+		m_obstacles.erase(iter);
+	}
+
+	void finishTileRebuild(NavmeshTileRebuild& rebuild) {
+		RecastZone& zone = m_zones[rebuild.zone];
+		if (rebuild.error) {
+			logError("Navigation") << "Could not rebuild navmesh tile: " << rebuild.error;
+			return;
+		}
+
+		zone.navmesh->removeTile(zone.navmesh->getTileRefAt(rebuild.x, rebuild.z, 0), 0, 0);
+		if (!rebuild.data) return;
+
+		if (dtStatusFailed(zone.navmesh->addTile(rebuild.data, rebuild.data_size, DT_TILE_FREE_DATA, 0, nullptr))) {
+			dtFree(rebuild.data);
+			logError("Navigation") << "Could not add Detour tile.";
+		}
+		rebuild.data = nullptr;
+	}
+
+	bool isRebuilding(u64 tile_key) const {
+		for (const NavmeshTileRebuild* rebuild : m_tile_rebuilds) {
+			if (getTileKey(rebuild->zone, rebuild->x, rebuild->z) == tile_key) return true;
+		}
+		return false;
+	}
+
+	void startTileRebuild(u64 tile_key) {
+		const EntityRef zone_entity = { i32(tile_key >> 32) };
+		const RecastZone& zone = m_zones[zone_entity];
+		const Vec3 min = -zone.zone.extents;
+		const Vec3 max = zone.zone.extents;
+
+		NavmeshTileRebuild* rebuild = LUMIX_NEW(m_allocator, NavmeshTileRebuild)(zone_entity, m_allocator);
+		rebuild->x = tile_key & 0xffFF;
+		rebuild->z = (tile_key >> 16) & 0xffFF;
+		rebuild->base_config = m_config;
+		rebuild->config = getTileConfig(m_config, min, max, rebuild->x, rebuild->z);
+		getObstacles(zone_entity, rebuild->obstacles);
+
+		auto iter = m_tile_layers.find(tile_key);
+		if (iter.isValid()) {
+			rebuild->layer = iter.value();
+		}
+		else {
+			rebuild->layer = LUMIX_NEW(m_allocator, NavmeshTileLayer)(m_allocator);
+			m_tile_layers.insert(tile_key, rebuild->layer);
+		}
+
+		// only a snapshot of what overlaps the tile's padded AABB is taken here, the rest is done in the job
+		if (!rebuild->layer->chf) {
+			const IVec2 tile(rebuild->x, rebuild->z);
+			gatherGeometry(m_universe.getTransform(zone_entity), m_config, min, max, tile, IVec2(1, 1), rebuild->geometry);
+			rebuild->min = min;
+		}
+
+		m_tile_rebuilds.push(rebuild);
+		JobSystem::run(rebuild, &rebuildTileJob, &rebuild->signal);
+	}
+
+	// dirty tiles are rebuilt on workers, main thread work is limited by DIRTY_TILES_BUDGET_MS
+	void updateDirtyTiles() {
+		PROFILE_FUNCTION();
+		OS::Timer timer;
+		for (int i = m_tile_rebuilds.size() - 1; i >= 0; --i) {
+			NavmeshTileRebuild* rebuild = m_tile_rebuilds[i];
+			if (!rebuild->is_done) continue;
+			if (timer.getTimeSinceStart() * 1000 > DIRTY_TILES_BUDGET_MS) return;
+
+			JobSystem::wait(rebuild->signal);
+			finishTileRebuild(*rebuild);
+			LUMIX_DELETE(m_allocator, rebuild);
+			m_tile_rebuilds.erase(i);
+		}
+
+		for (int i = 0; i < m_dirty_tiles.size();) {
+			if (m_tile_rebuilds.size() >= (int)JobSystem::getWorkersCount()) return;
+			if (timer.getTimeSinceStart() * 1000 > DIRTY_TILES_BUDGET_MS) return;
+
+			const u64 key = m_dirty_tiles[i];
+			const EntityRef zone = { i32(key >> 32) };
+			const RecastZone& recast_zone = m_zones[zone];
+			if (!recast_zone.navmesh) {
+				m_dirty_tiles.erase(i);
+				continue;
+			}
+			// streamed out, obstacles are applied again when the tile is loaded
+			if (recast_zone.file && !recast_zone.navmesh->getTileAt(key & 0xffFF, (key >> 16) & 0xffFF, 0)) {
+				m_dirty_tiles.erase(i);
+				continue;
+			}
+			if (getBuildIndex(zone) >= 0 || isRebuilding(key)) {
+				++i;
+				continue;
+			}
+			m_dirty_tiles.erase(i);
+			startTileRebuild(key);
+		}
+	}
+
+	// drops cached layers and pending rebuilds, called whenever tiles of the zone are created from scratch
+	void clearTileLayers(EntityRef zone) {
+		for (int i = m_tile_rebuilds.size() - 1; i >= 0; --i) {
+			NavmeshTileRebuild* rebuild = m_tile_rebuilds[i];
+			if (rebuild->zone != zone) continue;
+
+			JobSystem::wait(rebuild->signal);
+			dtFree(rebuild->data);
+			LUMIX_DELETE(m_allocator, rebuild);
+			m_tile_rebuilds.erase(i);
+		}
+		m_dirty_tiles.eraseItems([zone](u64 key){ return i32(key >> 32) == zone.index; });
+
+		Array<u64> keys(m_allocator);
+		for (auto iter = m_tile_layers.begin(), end = m_tile_layers.end(); iter != end; ++iter) {
+			if (i32(iter.key() >> 32) == zone.index) keys.push(iter.key());
+		}
+		for (u64 key : keys) {
+			LUMIX_DELETE(m_allocator, m_tile_layers[key]);
+			m_tile_layers.erase(key);
+		}
+	}
+
+	void markObstaclesDirty(EntityRef zone) {
+		for (const NavmeshObstacle& obstacle : m_obstacles) {
+			if (obstacle.zone == zone) markTilesDirty(obstacle);
+		}
+	}
+
+
+	u32 addQuery(EntityRef zone, NavQuery::Type type, const DVec3& from, const DVec3& to) {
+		NavQuery* query = LUMIX_NEW(m_allocator, NavQuery);
+		query->type = type;
+		query->zone = zone;
+		query->zone_tr = m_universe.getTransform(zone);
+		const Transform inv_zone_tr = query->zone_tr.inverted();
+		query->from = inv_zone_tr.transform(from).toFloat();
+		query->to = inv_zone_tr.transform(to).toFloat();
+		++m_last_query;
+		m_queries.insert(m_last_query, query);
+		m_pending_queries.push(query);
+		return m_last_query;
+	}
+
+	u32 queryPath(EntityRef zone, const DVec3& from, const DVec3& to) override {
+		return addQuery(zone, NavQuery::Type::PATH, from, to);
+	}
+
+	u32 queryRaycast(EntityRef zone, const DVec3& from, const DVec3& to) override {
+		return addQuery(zone, NavQuery::Type::RAYCAST, from, to);
+	}
+
+	u32 queryNearestPoly(EntityRef zone, const DVec3& pos) override {
+		return addQuery(zone, NavQuery::Type::NEAREST_POLY, pos, pos);
+	}
+
+	NavQueryStatus getQueryStatus(u32 handle) const override {
+		auto iter = m_queries.find(handle);
+		if (!iter.isValid()) return NavQueryStatus::INVALID;
+		return iter.value()->status;
+	}
+
+	Span<const DVec3> getQueryPoints(u32 handle) const override {
+		auto iter = m_queries.find(handle);
+		if (!iter.isValid()) return {};
+		const NavQuery* query = iter.value();
+		return Span<const DVec3>(query->points, query->points_count);
+	}
+
+	bool isQueryHit(u32 handle) const override {
+		auto iter = m_queries.find(handle);
+		return iter.isValid() && iter.value()->is_hit;
+	}
+
+	void releaseQuery(u32 handle) override {
+		auto iter = m_queries.find(handle);
+		if (!iter.isValid()) return;
+
+		NavQuery* query = iter.value();
+		if (query->slot) {
+			if (query->slot->current == query) query->slot->current = nullptr;
+			query->slot->queue.eraseItem(query);
+		}
+		m_pending_queries.eraseItem(query);
+		m_queries.erase(iter);
+		LUMIX_DELETE(m_allocator, query);
+	}
+
+	// fails all queries of the zone, must be called before its navmesh is destroyed
+	void clearQuerySlots(EntityRef zone) {
+		for (int i = m_query_slots.size() - 1; i >= 0; --i) {
+			NavQuerySlot* slot = m_query_slots[i];
+			if (slot->zone != zone) continue;
+
+			if (slot->current) slot->current->status = NavQueryStatus::FAILED;
+			for (NavQuery* query : slot->queue) {
+				query->status = NavQueryStatus::FAILED;
+				query->slot = nullptr;
+			}
+			if (slot->current) slot->current->slot = nullptr;
+			LUMIX_DELETE(m_allocator, slot);
+			m_query_slots.erase(i);
+		}
+	}
+
+	NavQuerySlot* getQuerySlot(RecastZone& zone) {
+		int count = 0;
+		NavQuerySlot* best = nullptr;
+		for (NavQuerySlot* slot : m_query_slots) {
+			if (slot->zone != zone.entity) continue;
+			++count;
+			if (!best || slot->queue.size() < best->queue.size()) best = slot;
+		}
+		if (count >= (int)JobSystem::getWorkersCount()) return best;
+
+		NavQuerySlot* slot = LUMIX_NEW(m_allocator, NavQuerySlot)(zone.entity, m_allocator);
+		slot->navquery = dtAllocNavMeshQuery();
+		if (!slot->navquery || dtStatusFailed(slot->navquery->init(zone.navmesh, 2048))) {
+			logError("Navigation") << "Could not init Detour navmesh query";
+			LUMIX_DELETE(m_allocator, slot);
+			return best;
+		}
+		m_query_slots.push(slot);
+		return slot;
+	}
+
+	static void finishPathQuery(NavQuerySlot& slot, NavQuery& query) {
+		dtPolyRef polys[MAX_PATH_POLYS];
+		int polys_count = 0;
+		query.status = NavQueryStatus::FAILED;
+		slot.current = nullptr;
+		query.slot = nullptr;
+		if (dtStatusFailed(slot.navquery->finalizeSlicedFindPath(polys, &polys_count, lengthOf(polys)))) return;
+		if (polys_count == 0) return;
+
+		Vec3 end = query.to;
+		if (polys[polys_count - 1] != slot.current_end_poly) {
+			slot.navquery->closestPointOnPoly(polys[polys_count - 1], &query.to.x, &end.x, nullptr);
+		}
+
+		float points[NavQuery::MAX_POINTS * 3];
+		int points_count = 0;
+		if (dtStatusFailed(slot.navquery->findStraightPath(&query.from.x, &end.x, polys, polys_count, points, nullptr, nullptr, &points_count, NavQuery::MAX_POINTS))) {
+			return;
+		}
+		for (int i = 0; i < points_count; ++i) {
+			query.points[i] = query.zone_tr.transform(*(Vec3*)&points[i * 3]);
+		}
+		query.points_count = points_count;
+		query.status = NavQueryStatus::SUCCESS;
+	}
+
+	// runs on a worker, does at most PATH_QUERY_ITERATIONS search iterations
+	static void processQuerySlot(NavQuerySlot& slot) {
+		PROFILE_FUNCTION();
+		static const float EXTENTS[] = { 1.0f, 20.0f, 1.0f };
+		int iterations = PATH_QUERY_ITERATIONS;
+		while (iterations > 0) {
+			if (slot.current) {
+				int done_iterations = 0;
+				const dtStatus status = slot.navquery->updateSlicedFindPath(iterations, &done_iterations);
+				iterations -= maximum(done_iterations, 1);
+				if (dtStatusInProgress(status)) continue;
+				if (dtStatusFailed(status)) {
+					slot.current->status = NavQueryStatus::FAILED;
+					slot.current->slot = nullptr;
+					slot.current = nullptr;
+					continue;
+				}
+				finishPathQuery(slot, *slot.current);
+				continue;
+			}
+
+			if (slot.queue.empty()) return;
+			NavQuery& query = *slot.queue[0];
+			slot.queue.erase(0);
+			query.slot = nullptr;
+			--iterations;
+
+			dtPolyRef start_poly;
+			Vec3 start;
+			if (dtStatusFailed(slot.navquery->findNearestPoly(&query.from.x, EXTENTS, &slot.filter, &start_poly, &start.x)) || !start_poly) {
+				query.status = NavQueryStatus::FAILED;
+				continue;
+			}
+
+			switch (query.type) {
+				case NavQuery::Type::NEAREST_POLY:
+					query.points[0] = query.zone_tr.transform(start);
+					query.points_count = 1;
+					query.status = NavQueryStatus::SUCCESS;
+					break;
+				case NavQuery::Type::RAYCAST: {
+					float t;
+					Vec3 normal;
+					dtPolyRef polys[MAX_PATH_POLYS];
+					int polys_count;
+					if (dtStatusFailed(slot.navquery->raycast(start_poly, &start.x, &query.to.x, &slot.filter, &t, &normal.x, polys, &polys_count, lengthOf(polys)))) {
+						query.status = NavQueryStatus::FAILED;
+						break;
+					}
+					iterations -= polys_count;
+					query.is_hit = t <= 1;
+					const Vec3 end = query.is_hit ? start + (query.to - start) * t : query.to;
+					query.points[0] = query.zone_tr.transform(end);
+					query.points_count = 1;
+					query.status = NavQueryStatus::SUCCESS;
+					break;
+				}
+				case NavQuery::Type::PATH: {
+					if (dtStatusFailed(slot.navquery->findNearestPoly(&query.to.x, EXTENTS, &slot.filter, &slot.current_end_poly, nullptr)) || !slot.current_end_poly) {
+						query.status = NavQueryStatus::FAILED;
+						break;
+					}
+					query.from = start;
+					if (dtStatusFailed(slot.navquery->initSlicedFindPath(start_poly, slot.current_end_poly, &query.from.x, &query.to.x, &slot.filter))) {
+						query.status = NavQueryStatus::FAILED;
+						break;
+					}
+					slot.current = &query;
+					query.slot = &slot;
+					break;
+				}
+			}
+		}
+	}
+
+	void updateQueries() {
+		PROFILE_FUNCTION();
+		for (NavQuery* query : m_pending_queries) {
+			auto iter = m_zones.find(query->zone);
+			NavQuerySlot* slot = iter.isValid() && iter.value().navmesh ? getQuerySlot(iter.value()) : nullptr;
+			if (!slot) {
+				query->status = NavQueryStatus::FAILED;
+				continue;
+			}
+			query->slot = slot;
+			slot->queue.push(query);
+		}
+		m_pending_queries.clear();
+
+		Array<NavQuerySlot*> slots(m_allocator);
+		for (NavQuerySlot* slot : m_query_slots) {
+			if (slot->current || !slot->queue.empty()) slots.push(slot);
+		}
+		if (slots.empty()) return;
+
+		JobSystem::forEach(slots.size(), [&](int idx){
+			processQuerySlot(*slots[idx]);
+		});
+	}
+
+
 	void addCrowdAgent(Agent& agent, RecastZone& zone) {
 		ASSERT(zone.crowd);
 
@@ -1343,7 +2884,7 @@ struct NavigationSceneImpl final : public NavigationScene
 	}
 
 	void createZone(EntityRef entity) {
-		RecastZone zone;
+		RecastZone zone(m_allocator);
 		zone.zone.extents = Vec3(1);
 		zone.entity = entity;
 		m_zones.insert(entity, zone);
@@ -1351,17 +2892,19 @@ struct NavigationSceneImpl final : public NavigationScene
 	}
 
 	void destroyZone(EntityRef entity) {
+		cancelNavmeshBuild(entity);
+		clearTileLayers(entity);
+		clearQuerySlots(entity);
+		m_obstacles.eraseIf([entity](const NavmeshObstacle& obstacle){ return obstacle.zone == entity; });
 		auto iter = m_zones.find(entity);
 		const RecastZone& zone = iter.value();
-		if (zone.crowd) {
-			for (Agent& agent : m_agents) {
-				if (agent.zone == zone.entity) {
-					zone.crowd->removeAgent(agent.agent);
-					agent.agent = -1;
-				}
-			}
-			dtFreeCrowd(zone.crowd);
+		for (EntityRef agent_entity : zone.agents) {
+			Agent& agent = m_agents[agent_entity];
+			if (zone.crowd && agent.agent >= 0) zone.crowd->removeAgent(agent.agent);
+			agent.agent = -1;
+			agent.zone = INVALID_ENTITY;
 		}
+		if (zone.crowd) dtFreeCrowd(zone.crowd);
 
 		m_zones.erase(iter);
 		m_universe.onComponentDestroyed(entity, NAVMESH_ZONE_TYPE, this);
@@ -1378,6 +2921,7 @@ struct NavigationSceneImpl final : public NavigationScene
 				&& pos.x < max.x && pos.y < max.y && pos.z < max.z)
 			{
 				agent.zone = zone.entity;
+				zone.agents.push(agent.entity);
 				if (zone.crowd) addCrowdAgent(agent, zone);
 				return;
 			}
@@ -1393,8 +2937,7 @@ struct NavigationSceneImpl final : public NavigationScene
 		agent.agent = -1;
 		agent.flags = Agent::USE_ROOT_MOTION;
 		agent.is_finished = true;
-		m_agents.insert(entity, agent);
-		assignZone(agent);
+		assignZone(m_agents.insert(entity, static_cast<Agent&&>(agent)));
 		m_universe.onComponentCreated(entity, NAVMESH_AGENT_TYPE, this);
 	}
 
@@ -1404,8 +2947,9 @@ struct NavigationSceneImpl final : public NavigationScene
 		if (agent.zone.isValid()) {
 			RecastZone& zone = m_zones[(EntityRef)agent.zone];
 			if (zone.crowd && agent.agent >= 0) zone.crowd->removeAgent(agent.agent);
-			m_agents.erase(iter);
+			zone.agents.swapAndPopItem(entity);
 		}
+		m_agents.erase(iter);
 		m_universe.onComponentDestroyed(entity, NAVMESH_AGENT_TYPE, this);
 	}
 
@@ -1438,7 +2982,7 @@ struct NavigationSceneImpl final : public NavigationScene
 		serializer.read(count);
 		m_zones.reserve(count + m_zones.size());
 		for (u32 i = 0; i < count; ++i) {
-			RecastZone zone;
+			RecastZone zone(m_allocator);
 			EntityRef e;
 			serializer.read(e);
 			e = entity_map.get(e);
@@ -1529,6 +3073,16 @@ struct NavigationSceneImpl final : public NavigationScene
 	IPlugin& m_system;
 	Engine& m_engine;
 	HashMap<EntityRef, RecastZone> m_zones;
+	Array<NavmeshBuild*> m_builds;
+	HashMap<u32, NavmeshObstacle> m_obstacles;
+	u32 m_last_obstacle = 0;
+	HashMap<u64, NavmeshTileLayer*> m_tile_layers;
+	Array<u64> m_dirty_tiles;
+	Array<NavmeshTileRebuild*> m_tile_rebuilds;
+	HashMap<u32, NavQuery*> m_queries;
+	u32 m_last_query = 0;
+	Array<NavQuery*> m_pending_queries;
+	Array<NavQuerySlot*> m_query_slots;
 	HashMap<EntityRef, Agent> m_agents;
 	EntityPtr m_moving_agent = INVALID_ENTITY;
 	
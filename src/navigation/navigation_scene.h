@@ -20,6 +20,14 @@ struct NavmeshZone {
 };
 
 
+enum class NavQueryStatus : u8 {
+	INVALID,
+	PENDING,
+	SUCCESS,
+	FAILED
+};
+
+
 class NavigationScene : public IScene
 {
 public:
@@ -44,8 +52,26 @@ public:
 	virtual void setIsGettingRootMotionFromAnim(EntityRef entity, bool is) = 0;
 	virtual bool generateNavmesh(EntityRef zone) = 0;
 	virtual bool generateTileAt(EntityRef zone, const DVec3& pos, bool keep_data) = 0;
+	virtual float getNavmeshBuildProgress(EntityRef zone) const = 0;
+	virtual void cancelNavmeshBuild(EntityRef zone) = 0;
+	virtual u32 addBoxObstacle(EntityRef zone, const DVec3& pos, const Vec3& half_extents, float yaw) = 0;
+	virtual u32 addCylinderObstacle(EntityRef zone, const DVec3& pos, float radius, float height) = 0;
+	virtual u32 addConvexObstacle(EntityRef zone, Span<const DVec3> points, float height) = 0;
+	virtual void moveObstacle(u32 obstacle, const DVec3& pos, float yaw) = 0;
+	virtual void removeObstacle(u32 obstacle) = 0;
+	virtual u32 queryPath(EntityRef zone, const DVec3& from, const DVec3& to) = 0;
+	virtual u32 queryRaycast(EntityRef zone, const DVec3& from, const DVec3& to) = 0;
+	virtual u32 queryNearestPoly(EntityRef zone, const DVec3& pos) = 0;
+	virtual NavQueryStatus getQueryStatus(u32 query) const = 0;
+	// path corners, raycast hit (or end) position or nearest point on navmesh
+	virtual Span<const DVec3> getQueryPoints(u32 query) const = 0;
+	virtual bool isQueryHit(u32 query) const = 0;
+	virtual void releaseQuery(u32 query) = 0;
 	virtual bool load(EntityRef zone_entity, const char* path) = 0;
 	virtual bool save(EntityRef zone_entity, const char* path) = 0;
+	// 0 - all tiles of a loaded navmesh are resident, otherwise tiles are streamed in around agents and active camera
+	virtual void setNavmeshStreamingRadius(EntityRef zone, float radius) = 0;
+	virtual float getNavmeshStreamingRadius(EntityRef zone) = 0;
 	virtual void debugDrawNavmesh(EntityRef zone, const DVec3& pos, bool inner_boundaries, bool outer_boundaries, bool portals) = 0;
 	virtual void debugDrawCompactHeightfield(EntityRef zone) = 0;
 	virtual void debugDrawHeightfield(EntityRef zone) = 0;
@@ -159,6 +159,25 @@ LUMIX_PLUGIN_ENTRY(navigation)
 }
 
 
+static int LUA_getQueryResult(lua_State* L)
+{
+	auto* scene = LuaWrapper::checkArg<NavigationScene*>(L, 1);
+	const u32 query = LuaWrapper::checkArg<u32>(L, 2);
+	const NavQueryStatus status = scene->getQueryStatus(query);
+	LuaWrapper::push(L, (int)status);
+	if (status != NavQueryStatus::SUCCESS) return 1;
+
+	const Span<const DVec3> points = scene->getQueryPoints(query);
+	lua_createtable(L, points.length(), 0);
+	for (u32 i = 0; i < points.length(); ++i) {
+		LuaWrapper::push(L, points[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	LuaWrapper::push(L, scene->isQueryHit(query));
+	return 3;
+}
+
+
 static void registerLuaAPI(lua_State* L)
 {
 	#define REGISTER_FUNCTION(name) \
@@ -168,6 +187,17 @@ static void registerLuaAPI(lua_State* L)
 		} while(false) \
 
 	REGISTER_FUNCTION(generateNavmesh);
+	REGISTER_FUNCTION(getNavmeshBuildProgress);
+	REGISTER_FUNCTION(cancelNavmeshBuild);
+	REGISTER_FUNCTION(addBoxObstacle);
+	REGISTER_FUNCTION(addCylinderObstacle);
+	REGISTER_FUNCTION(moveObstacle);
+	REGISTER_FUNCTION(removeObstacle);
+	REGISTER_FUNCTION(queryPath);
+	REGISTER_FUNCTION(queryRaycast);
+	REGISTER_FUNCTION(queryNearestPoly);
+	REGISTER_FUNCTION(releaseQuery);
+	REGISTER_FUNCTION(setNavmeshStreamingRadius);
 	REGISTER_FUNCTION(navigate);
 	REGISTER_FUNCTION(setActorActive);
 	REGISTER_FUNCTION(cancelNavigation);
@@ -182,6 +212,8 @@ static void registerLuaAPI(lua_State* L)
 	REGISTER_FUNCTION(getAgentSpeed);
 
 	#undef REGISTER_FUNCTION
+
+	LuaWrapper::createSystemFunction(L, "Navigation", "getQueryResult", &LUA_getQueryResult);
 }
 
 
@@ -45,6 +45,12 @@ static const ComponentType D6_JOINT_TYPE = Reflection::getComponentType("d6_join
 static const ComponentType VEHICLE_TYPE = Reflection::getComponentType("vehicle");
 static const ComponentType WHEEL_TYPE = Reflection::getComponentType("wheel");
 static const u32 RENDERER_HASH = crc32("renderer");
+static const int PARALLEL_CONTROLLERS_THRESHOLD = 64;
+static const float MIN_CONTROLLER_CELL_SIZE = 4.f;
+static const u32 VEHICLE_LOD_TICK = 4;
+static const float ACTOR_LOD_REGION_SIZE = 32.f;
+static const u32 ACTOR_LOD_UPDATE_FRAMES = 8;
+static const u32 MAX_SUBSTEPS = 8;
 
 
 enum class PhysicsSceneVersion
@@ -195,6 +201,26 @@ struct Vehicle
 	PxRigidDynamic* actor = nullptr;
 	PxVehicleDrive4W* drive = nullptr;
 	float chassis_mass = 10;
+	float lod_time = 0;
+	PxTransform prev_pose = PxTransform(PxIdentity);
+};
+
+
+// vehicles are simulated in batches of fixed size, each batch has its own scene query,
+// so batches can do suspension raycasts and updates concurrently
+struct VehicleBatch
+{
+	static constexpr u32 MAX_VEHICLES = 16;
+	static constexpr u32 MAX_WHEELS = MAX_VEHICLES * 4;
+
+	PxBatchQuery* query = nullptr;
+	u32 count = 0;
+	PxVehicleWheels* wheels[MAX_VEHICLES];
+	float time_deltas[MAX_VEHICLES];
+	PxRaycastQueryResult results[MAX_WHEELS];
+	PxRaycastHit hits[MAX_WHEELS];
+	PxVehicleConcurrentUpdateData concurrent[MAX_VEHICLES];
+	PxVehicleWheelConcurrentUpdateData concurrent_wheels[MAX_WHEELS];
 };
 
 
@@ -307,6 +333,14 @@ struct PhysicsSceneImpl final : public PhysicsScene
 	};
 
 
+	enum class ActorLOD : u8
+	{
+		ACTIVE,
+		SLEEPING,
+		FROZEN
+	};
+
+
 	class RigidActor
 	{
 	public:
@@ -319,6 +353,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 			, dynamic_type(DynamicType::STATIC)
 			, is_trigger(false)
 			, scale(1)
+			, lod(ActorLOD::ACTIVE)
 		{
 		}
 
@@ -340,12 +375,19 @@ struct PhysicsSceneImpl final : public PhysicsScene
 		PhysicsSceneImpl& scene;
 		DynamicType dynamic_type;
 		bool is_trigger;
+		ActorLOD lod;
+		PxTransform prev_pose = PxTransform(PxIdentity);
+		PxVec3 lod_linear_velocity;
+		PxVec3 lod_angular_velocity;
 
 	private:
 		void onStateChanged(Resource::State old_state, Resource::State new_state, Resource&);
 	};
 
 
+	struct Controller;
+
+
 	PhysicsSceneImpl(Universe& context, IAllocator& allocator)
 		: m_allocator(allocator)
 		, m_controllers(m_allocator)
@@ -364,8 +406,12 @@ struct PhysicsSceneImpl final : public PhysicsScene
 		, m_script_scene(nullptr)
 		, m_debug_visualization_flags(0)
 		, m_is_updating_ragdoll(false)
+		, m_is_updating_controllers(false)
+		, m_parallel_controllers(true)
 		, m_update_in_progress(nullptr)
-		, m_vehicle_batch_query(nullptr)
+		, m_vehicle_batches(m_allocator)
+		, m_observers(m_allocator)
+		, m_actor_lod_regions(m_allocator)
 	{
 
 		memset(m_layers_names, 0, sizeof(m_layers_names));
@@ -404,20 +450,13 @@ struct PhysicsSceneImpl final : public PhysicsScene
 	}
 
 
-	PxBatchQuery* createVehicleBatchQuery(u8* mem)
+	PxBatchQuery* createVehicleBatchQuery(VehicleBatch& batch)
 	{
-		const PxU32 maxNumQueriesInBatch = 64;
-		const PxU32 maxNumHitResultsInBatch = 64;
-
-		PxBatchQueryDesc desc(maxNumQueriesInBatch, maxNumQueriesInBatch, 0);
-
-		// TODO
-
-		desc.queryMemory.userRaycastResultBuffer = (PxRaycastQueryResult*)(mem + sizeof(PxRaycastQueryResult) * 64);
-		desc.queryMemory.userRaycastTouchBuffer = (PxRaycastHit*)mem;
-		desc.queryMemory.raycastTouchBufferSize = maxNumHitResultsInBatch;
+		PxBatchQueryDesc desc(VehicleBatch::MAX_WHEELS, 0, 0);
 
-		m_vehicle_results = desc.queryMemory.userRaycastResultBuffer;
+		desc.queryMemory.userRaycastResultBuffer = batch.results;
+		desc.queryMemory.userRaycastTouchBuffer = batch.hits;
+		desc.queryMemory.raycastTouchBufferSize = VehicleBatch::MAX_WHEELS;
 
 /*		desc.preFilterShader = vehicleSceneQueryData.mPreFilterShader;
 		desc.postFilterShader = vehicleSceneQueryData.mPostFilterShader;*/
@@ -444,7 +483,10 @@ struct PhysicsSceneImpl final : public PhysicsScene
 
 	~PhysicsSceneImpl()
 	{
-		m_vehicle_batch_query->release();
+		for (VehicleBatch* batch : m_vehicle_batches) {
+			batch->query->release();
+			LUMIX_DELETE(m_allocator, batch);
+		}
 		m_vehicle_frictions->release();
 		m_controller_manager->release();
 		m_default_material->release();
@@ -1545,20 +1587,142 @@ struct PhysicsSceneImpl final : public PhysicsScene
 	}
 
 
-	void updateDynamicActors()
+	void setActorLOD(RigidActor& actor, ActorLOD lod)
+	{
+		if (actor.lod == lod) return;
+
+		PxRigidDynamic* dynamic = actor.physx_actor->is<PxRigidDynamic>();
+		if (actor.lod == ActorLOD::FROZEN) {
+			dynamic->setRigidBodyFlag(PxRigidBodyFlag::eKINEMATIC, false);
+			// a sleeping actor has no velocity, it is woken up with the velocity it has then
+			if (lod != ActorLOD::SLEEPING) {
+				dynamic->setLinearVelocity(actor.lod_linear_velocity);
+				dynamic->setAngularVelocity(actor.lod_angular_velocity);
+			}
+		}
+
+		switch (lod) {
+			case ActorLOD::ACTIVE: break;
+			case ActorLOD::SLEEPING: dynamic->putToSleep(); break;
+			case ActorLOD::FROZEN:
+				// kinematic actors are not part of the solver, joints to them act as to a static anchor
+				actor.lod_linear_velocity = dynamic->getLinearVelocity();
+				actor.lod_angular_velocity = dynamic->getAngularVelocity();
+				dynamic->setRigidBodyFlag(PxRigidBodyFlag::eKINEMATIC, true);
+				break;
+		}
+		actor.lod = lod;
+	}
+
+
+	void restoreActorLOD(RigidActor& actor)
+	{
+		if (actor.lod != ActorLOD::ACTIVE && actor.physx_actor) setActorLOD(actor, ActorLOD::ACTIVE);
+	}
+
+
+	static ActorLOD getActorLOD(ActorLOD current, double distance_squared, float sleep_distance, float freeze_distance)
+	{
+		// hysteresis, so actors on the boundary do not switch every frame
+		const double sleep = sleep_distance * (current == ActorLOD::ACTIVE ? 1.0 : 0.9);
+		const double freeze = freeze_distance * (current == ActorLOD::FROZEN ? 0.9 : 1.0);
+		if (distance_squared > freeze * freeze) return ActorLOD::FROZEN;
+		if (distance_squared > sleep * sleep) return ActorLOD::SLEEPING;
+		return ActorLOD::ACTIVE;
+	}
+
+
+	// actors are grouped into regions, distance to the closest observer is computed once per region,
+	// each frame only a part of all actors is checked
+	void updateActorsLOD()
+	{
+		PROFILE_FUNCTION();
+		const u32 count = m_dynamic_actors.size();
+		if (count == 0) return;
+
+		if (m_observers.empty()) {
+			for (RigidActor* actor : m_dynamic_actors) restoreActorLOD(*actor);
+			return;
+		}
+
+		m_actor_lod_regions.clear();
+		const u32 step = (count + ACTOR_LOD_UPDATE_FRAMES - 1) / ACTOR_LOD_UPDATE_FRAMES;
+		if (m_actor_lod_offset >= count) m_actor_lod_offset = 0;
+		const u32 end = minimum(count, m_actor_lod_offset + step);
+		for (u32 i = m_actor_lod_offset; i < end; ++i) {
+			RigidActor* actor = m_dynamic_actors[i];
+			if (!actor->physx_actor) continue;
+
+			const DVec3 pos = m_universe.getPosition(actor->entity);
+			const i32 x = (i32)floor(pos.x / ACTOR_LOD_REGION_SIZE);
+			const i32 z = (i32)floor(pos.z / ACTOR_LOD_REGION_SIZE);
+			const u64 key = (u64((u32)x) << 32) | (u32)z;
+			auto iter = m_actor_lod_regions.find(key);
+			double distance_squared;
+			if (iter.isValid()) {
+				distance_squared = iter.value();
+			}
+			else {
+				const DVec3 center((x + 0.5) * ACTOR_LOD_REGION_SIZE, pos.y, (z + 0.5) * ACTOR_LOD_REGION_SIZE);
+				distance_squared = DBL_MAX;
+				for (EntityRef observer : m_observers) {
+					distance_squared = minimum(distance_squared, (m_universe.getPosition(observer) - center).squaredLength());
+				}
+				m_actor_lod_regions.insert(key, distance_squared);
+			}
+			setActorLOD(*actor, getActorLOD(actor->lod, distance_squared, m_actor_sleep_distance, m_actor_freeze_distance));
+		}
+		m_actor_lod_offset = end;
+	}
+
+
+	float getActorSleepDistance() const override { return m_actor_sleep_distance; }
+	void setActorSleepDistance(float distance) override { m_actor_sleep_distance = distance; }
+	float getActorFreezeDistance() const override { return m_actor_freeze_distance; }
+	void setActorFreezeDistance(float distance) override { m_actor_freeze_distance = distance; }
+
+
+	static RigidTransform interpolate(const PxTransform& prev, const PxTransform& current, float t)
+	{
+		if (t >= 1) return fromPhysx(current);
+		RigidTransform res;
+		res.pos = DVec3(fromPhysx(prev.p + (current.p - prev.p) * t));
+		res.rot = nlerp(fromPhysx(prev.q), fromPhysx(current.q), t);
+		return res;
+	}
+
+
+	void storePreviousPoses()
+	{
+		PROFILE_FUNCTION();
+		for (auto* actor : m_dynamic_actors)
+		{
+			if (actor->physx_actor) actor->prev_pose = actor->physx_actor->getGlobalPose();
+		}
+		for (Vehicle& vehicle : m_vehicles) {
+			if (vehicle.actor) vehicle.prev_pose = vehicle.actor->getGlobalPose();
+		}
+	}
+
+
+	// t is the interpolation factor between the previous and the current physics state, 
+	// it's always 1 unless fixed timestep is used
+	void updateDynamicActors(float t)
 	{
 		PROFILE_FUNCTION();
 		for (auto* actor : m_dynamic_actors)
 		{
+			if (actor->lod == ActorLOD::FROZEN) continue;
 			m_update_in_progress = actor;
 			PxTransform trans = actor->physx_actor->getGlobalPose();
-			m_universe.setTransform(actor->entity, fromPhysx(trans));
+			m_universe.setTransform(actor->entity, interpolate(actor->prev_pose, trans, t));
 		}
 		m_update_in_progress = nullptr;
 
 		for (auto iter = m_vehicles.begin(), end = m_vehicles.end(); iter != end; ++iter) {
-			const PxTransform trans = iter.value().actor->getGlobalPose();
-			m_universe.setTransform(iter.key(), fromPhysx(trans));
+			const Vehicle& vehicle = iter.value();
+			const PxTransform trans = vehicle.actor->getGlobalPose();
+			m_universe.setTransform(iter.key(), interpolate(vehicle.prev_pose, trans, t));
 		}
 	}
 
@@ -1586,46 +1750,144 @@ struct PhysicsSceneImpl final : public PhysicsScene
 	}
 
 
-	void updateControllers(float time_delta)
+	Vec3 getControllerDisplacement(Controller& controller, float time_delta, float scene_gravity)
 	{
-		PROFILE_FUNCTION();
-		for (auto& controller : m_controllers)
+		Vec3 dif = controller.m_frame_change;
+		controller.m_frame_change.set(0, 0, 0);
+
+		PxControllerState state;
+		controller.m_controller->getState(state);
+		float gravity_acceleration = 0.0f;
+		if (controller.m_custom_gravity)
+		{
+			gravity_acceleration = controller.m_custom_gravity_acceleration * -1.0f;
+		}
+		else
 		{
-			Vec3 dif = controller.m_frame_change;
-			controller.m_frame_change.set(0, 0, 0);
+			gravity_acceleration = scene_gravity;
+		}
 
-			PxControllerState state;
-			controller.m_controller->getState(state);
-			float gravity_acceleration = 0.0f;
-			if (controller.m_custom_gravity)
-			{
-				gravity_acceleration = controller.m_custom_gravity_acceleration * -1.0f;
-			}
-			else
-			{
-				gravity_acceleration = m_scene->getGravity().y;
-			}
+		bool apply_gravity = (state.collisionFlags & PxControllerCollisionFlag::eCOLLISION_DOWN) == 0;
+		if (apply_gravity)
+		{
+			dif.y += controller.gravity_speed * time_delta;
+			controller.gravity_speed += time_delta * gravity_acceleration;
+		}
+		else
+		{
+			controller.gravity_speed = 0;
+		}
+		return dif;
+	}
 
-			bool apply_gravity = (state.collisionFlags & PxControllerCollisionFlag::eCOLLISION_DOWN) == 0;
-			if (apply_gravity)
-			{
-				dif.y += controller.gravity_speed * time_delta;
-				controller.gravity_speed += time_delta * gravity_acceleration;
-			}
-			else
-			{
-				controller.gravity_speed = 0;
+
+	DVec3 moveControllerInternal(Controller& controller, const Vec3& dif, float time_delta)
+	{
+		PxControllerFilters filters(nullptr, &controller.m_filter_callback);
+		controller.m_controller->move(toPhysx(dif), 0.001f, time_delta, filters);
+		const PxExtendedVec3 p = controller.m_controller->getFootPosition();
+		return {p.x, p.y, p.z};
+	}
+
+
+	// Controllers are bucketed into a grid of columns big enough that two controllers in different 
+	// cells of the same parity can not touch each other during this frame's move. Cells of one parity
+	// are moved in parallel, parities are processed one after another, so the result does not depend
+	// on workers' scheduling.
+	void updateControllersParallel(float time_delta, Span<const Vec3> displacements, Span<DVec3> positions)
+	{
+		PROFILE_FUNCTION();
+		struct Item {
+			u64 key;
+			u32 idx;
+		};
+
+		const u32 count = displacements.length();
+		float reach = 0;
+		for (u32 i = 0; i < count; ++i) {
+			const Controller& ctrl = m_controllers.at(i);
+			const float r = ctrl.m_radius + ctrl.m_controller->getContactOffset() + displacements[i].length();
+			reach = maximum(reach, r);
+		}
+		const float cell_size = maximum(MIN_CONTROLLER_CELL_SIZE, 2 * reach + 0.01f);
+
+		Array<Item> items(m_allocator);
+		items.resize(count);
+		for (u32 i = 0; i < count; ++i) {
+			const PxExtendedVec3 p = m_controllers.at(i).m_controller->getFootPosition();
+			const i32 x = (i32)floor(p.x / cell_size);
+			const i32 z = (i32)floor(p.z / cell_size);
+			const u64 parity = (x & 1) | ((z & 1) << 1);
+			items[i].key = (parity << 62) | (u64((u32)x & 0x7fffFFFF) << 31) | ((u32)z & 0x7fffFFFF);
+			items[i].idx = i;
+		}
+		qsort(items.begin(), items.size(), sizeof(items[0]), [](const void* a, const void* b) -> int {
+			const Item* i0 = (const Item*)a;
+			const Item* i1 = (const Item*)b;
+			if (i0->key != i1->key) return i0->key < i1->key ? -1 : 1;
+			return i0->idx < i1->idx ? -1 : 1;
+		});
+
+		Array<u32> groups(m_allocator);
+		u32 phase_begin = 0;
+		while (phase_begin < count) {
+			const u64 parity = items[phase_begin].key >> 62;
+			groups.clear();
+			u32 i = phase_begin;
+			for (; i < count && (items[i].key >> 62) == parity; ++i) {
+				if (i == phase_begin || items[i].key != items[i - 1].key) groups.push(i);
 			}
+			const u32 phase_end = i;
+			groups.push(phase_end);
+
+			JobSystem::forEach(groups.size() - 1, [&](int group_idx){
+				PROFILE_BLOCK("move controllers");
+				for (u32 j = groups[group_idx], end = groups[group_idx + 1]; j < end; ++j) {
+					const u32 idx = items[j].idx;
+					positions[idx] = moveControllerInternal(m_controllers.at(idx), displacements[idx], time_delta);
+				}
+			});
+			phase_begin = phase_end;
+		}
+	}
+
+
+	void updateControllers(float time_delta)
+	{
+		PROFILE_FUNCTION();
+		const int count = m_controllers.size();
+		if (count == 0) return;
+
+		const float scene_gravity = m_scene->getGravity().y;
+		Array<Vec3> displacements(m_allocator);
+		Array<DVec3> positions(m_allocator);
+		displacements.resize(count);
+		positions.resize(count);
+		for (int i = 0; i < count; ++i) {
+			displacements[i] = getControllerDisplacement(m_controllers.at(i), time_delta, scene_gravity);
+		}
 
-			PxControllerFilters filters(nullptr, &controller.m_filter_callback);
-			controller.m_controller->move(toPhysx(dif), 0.001f, time_delta, filters);
-			PxExtendedVec3 p = controller.m_controller->getFootPosition();
+		if (m_parallel_controllers && count >= PARALLEL_CONTROLLERS_THRESHOLD && JobSystem::getWorkersCount() > 1) {
+			updateControllersParallel(time_delta, displacements, positions);
+		}
+		else {
+			for (int i = 0; i < count; ++i) {
+				positions[i] = moveControllerInternal(m_controllers.at(i), displacements[i], time_delta);
+			}
+		}
 
-			m_universe.setPosition(controller.m_entity, {p.x, p.y, p.z});
+		m_is_updating_controllers = true;
+		for (int i = 0; i < count; ++i) {
+			m_universe.setPosition(m_controllers.at(i).m_entity, positions[i]);
 		}
+		m_is_updating_controllers = false;
 	}
 
 
+	void enableParallelControllers(bool enable) override { m_parallel_controllers = enable; }
+	bool isParallelControllersEnabled() const override { return m_parallel_controllers; }
+
+
 	static RagdollBone* getBone(RagdollBone* bone, int pose_bone_idx)
 	{
 		if (!bone) return nullptr;
@@ -2157,22 +2419,108 @@ struct PhysicsSceneImpl final : public PhysicsScene
 	}
 
 
+	bool isNearObserver(const DVec3& pos, float distance) const
+	{
+		if (m_observers.empty()) return true;
+
+		const double distance_squared = (double)distance * distance;
+		for (EntityRef observer : m_observers) {
+			if ((m_universe.getPosition(observer) - pos).squaredLength() < distance_squared) return true;
+		}
+		return false;
+	}
+
+
+	void addObserver(EntityRef entity) override
+	{
+		if (m_observers.indexOf(entity) < 0) m_observers.push(entity);
+	}
+
+
+	void removeObserver(EntityRef entity) override { m_observers.eraseItem(entity); }
+	float getVehicleLODDistance() const override { return m_vehicle_lod_distance; }
+	void setVehicleLODDistance(float distance) override { m_vehicle_lod_distance = distance; }
+
+
+	static void updateVehicleBatch(VehicleBatch& batch, const PxVec3& gravity, const PxVehicleDrivableSurfaceToTireFrictionPairs& frictions, bool concurrent)
+	{
+		PROFILE_FUNCTION();
+		PxVehicleSuspensionRaycasts(batch.query, batch.count, batch.wheels, batch.count * 4, batch.results);
+
+		// distant vehicles accumulate time, so only vehicles with the same time delta can share an update
+		u32 begin = 0;
+		while (begin < batch.count) {
+			u32 end = begin + 1;
+			while (end < batch.count && batch.time_deltas[end] == batch.time_deltas[begin]) ++end;
+			PxVehicleUpdates(batch.time_deltas[begin]
+				, gravity
+				, frictions
+				, end - begin
+				, batch.wheels + begin
+				, nullptr
+				, concurrent ? batch.concurrent + begin : nullptr);
+			begin = end;
+		}
+	}
+
+
 	void updateVehicles(float time_delta)
 	{
-		PxVehicleWheels* wheels[16];
-		const u32 count = (u32)m_vehicles.size();
-		ASSERT(count <= lengthOf(wheels)); // TODO
+		PROFILE_FUNCTION();
+		if (m_vehicles.size() == 0) return;
 
-		int i = 0;
+		++m_vehicle_frame;
+		u32 batches_count = 0;
+		u32 vehicle_idx = 0;
 		for (auto iter = m_vehicles.begin(), end = m_vehicles.end(); iter != end; ++iter) {
-			if (iter.value().drive) {
-				wheels[i] = iter.value().drive;
-				++i;
+			Vehicle& veh = iter.value();
+			if (!veh.drive) continue;
+
+			float dt = time_delta;
+			if (!isNearObserver(m_universe.getPosition(iter.key()), m_vehicle_lod_distance)) {
+				veh.lod_time += time_delta;
+				if ((m_vehicle_frame + vehicle_idx) % VEHICLE_LOD_TICK != 0) {
+					++vehicle_idx;
+					continue;
+				}
+				dt = veh.lod_time;
+			}
+			veh.lod_time = 0;
+			++vehicle_idx;
+
+			if (batches_count == 0 || m_vehicle_batches[batches_count - 1]->count == VehicleBatch::MAX_VEHICLES) {
+				if ((u32)m_vehicle_batches.size() == batches_count) {
+					VehicleBatch* batch = LUMIX_NEW(m_allocator, VehicleBatch);
+					batch->query = createVehicleBatchQuery(*batch);
+					m_vehicle_batches.push(batch);
+				}
+				m_vehicle_batches[batches_count]->count = 0;
+				++batches_count;
 			}
+			VehicleBatch& batch = *m_vehicle_batches[batches_count - 1];
+			batch.wheels[batch.count] = veh.drive;
+			batch.time_deltas[batch.count] = dt;
+			const u32 wheels_offset = batch.count * 4;
+			batch.concurrent[batch.count].concurrentWheelUpdates = batch.concurrent_wheels + wheels_offset;
+			batch.concurrent[batch.count].nbConcurrentWheelUpdates = 4;
+			++batch.count;
+		}
+		if (batches_count == 0) return;
+
+		const PxVec3 gravity = m_scene->getGravity();
+		if (batches_count == 1) {
+			updateVehicleBatch(*m_vehicle_batches[0], gravity, *m_vehicle_frictions, false);
+			return;
+		}
+
+		JobSystem::forEach(batches_count, [&](int idx){
+			updateVehicleBatch(*m_vehicle_batches[idx], gravity, *m_vehicle_frictions, true);
+		});
+
+		for (u32 i = 0; i < batches_count; ++i) {
+			VehicleBatch& batch = *m_vehicle_batches[i];
+			PxVehiclePostUpdates(batch.concurrent, batch.count, batch.wheels);
 		}
-		PxRaycastQueryResult query_results[lengthOf(wheels) * 4];
-		PxVehicleSuspensionRaycasts(m_vehicle_batch_query, count, wheels, count * 4, query_results);
-		PxVehicleUpdates(time_delta, m_scene->getGravity(), *m_vehicle_frictions, count, wheels, nullptr);
 	}
 
 
@@ -2180,18 +2528,57 @@ struct PhysicsSceneImpl final : public PhysicsScene
 	{
 		if (!m_is_game_running || paused) return;
 
-		time_delta = minimum(1 / 20.0f, time_delta);
-		updateVehicles(time_delta);
-		simulateScene(time_delta);
-		fetchResults();
-		updateRagdolls();
-		updateDynamicActors();
-		updateControllers(time_delta);
+		updateActorsLOD();
+		if (m_fixed_timestep > 0) {
+			updateFixedStep(time_delta);
+		}
+		else {
+			time_delta = minimum(1 / 20.0f, time_delta);
+			updateVehicles(time_delta);
+			simulateScene(time_delta);
+			fetchResults();
+			updateRagdolls();
+			updateDynamicActors(1);
+			updateControllers(time_delta);
+		}
 
 		render();
 	}
 
 
+	// the scene is stepped as many times as fits in the accumulated time, the leftover is used 
+	// to interpolate rendered transforms between the last two physics states
+	void updateFixedStep(float time_delta)
+	{
+		PROFILE_FUNCTION();
+		m_time_accumulator = minimum(m_time_accumulator + time_delta, m_fixed_timestep * MAX_SUBSTEPS);
+		const u32 steps = u32(m_time_accumulator / m_fixed_timestep);
+		for (u32 i = 0; i < steps; ++i) {
+			if (i + 1 == steps) storePreviousPoses();
+			updateVehicles(m_fixed_timestep);
+			simulateScene(m_fixed_timestep);
+			fetchResults();
+		}
+		m_time_accumulator -= steps * m_fixed_timestep;
+
+		updateRagdolls();
+		updateDynamicActors(m_time_accumulator / m_fixed_timestep);
+		// controllers move by the simulated time, pending input stays in m_frame_change until the next step
+		if (steps > 0) updateControllers(steps * m_fixed_timestep);
+	}
+
+
+	float getFixedTimestep() const override { return m_fixed_timestep; }
+
+
+	void setFixedTimestep(float timestep) override
+	{
+		m_fixed_timestep = maximum(0.f, timestep);
+		m_time_accumulator = 0;
+		storePreviousPoses();
+	}
+
+
 	DelegateList<void(const ContactData&)>& onContact() override { return m_contact_callbacks; }
 
 
@@ -2503,7 +2890,11 @@ struct PhysicsSceneImpl final : public PhysicsScene
 	}
 
 
-	void stopGame() override { m_is_game_running = false; }
+	void stopGame() override
+	{
+		for (RigidActor* actor : m_dynamic_actors) restoreActorLOD(*actor);
+		m_is_game_running = false;
+	}
 
 
 	float getControllerRadius(EntityRef entity) override { return m_controllers[entity].m_radius; }
@@ -2593,6 +2984,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 		PxRigidBody* rigid_body = actor->physx_actor->is<PxRigidBody>();
 		if (!rigid_body) return;
 
+		if (actor->dynamic_type == DynamicType::DYNAMIC) restoreActorLOD(*actor);
 		PxRigidBodyExt::addForceAtPos(*rigid_body, toPhysx(force), toPhysx(pos));
 	}
 
@@ -2704,6 +3096,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 
 	void onEntityDestroyed(EntityRef entity)
 	{
+		m_observers.eraseItem(entity);
 		for (int i = 0, c = m_joints.size(); i < c; ++i)
 		{
 			if (m_joints.at(i).connected_body == entity)
@@ -2718,7 +3111,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 		const u64 cmp_mask = m_universe.getComponentsMask(entity);
 		if ((cmp_mask & m_physics_cmps_mask) == 0) return;
 		
-		if (m_universe.hasComponent(entity, CONTROLLER_TYPE)) {
+		if (m_universe.hasComponent(entity, CONTROLLER_TYPE) && !m_is_updating_controllers) {
 			int ctrl_idx = m_controllers.find(entity);
 			if (ctrl_idx >= 0)
 			{
@@ -2760,6 +3153,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 					else
 					{
 						actor->physx_actor->setGlobalPose(toPhysx(trans.getRigidPart()), false);
+						actor->prev_pose = actor->physx_actor->getGlobalPose();
 					}
 					if (actor->resource && actor->scale != trans.scale)
 					{
@@ -3282,6 +3676,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 		RigidActor* actor = m_actors[entity];
 		if (actor->dynamic_type == new_value) return;
 
+		restoreActorLOD(*actor);
 		actor->dynamic_type = new_value;
 		if (new_value == DynamicType::DYNAMIC)
 		{
@@ -3793,9 +4188,26 @@ struct PhysicsSceneImpl final : public PhysicsScene
 
 	void deserializeActors(InputMemoryStream& serializer, const EntityMap& entity_map)
 	{
+		PROFILE_FUNCTION();
+		struct Shape
+		{
+			int type;
+			int index;
+			PxTransform local_pose;
+			PxVec3 half_extents;
+			float radius;
+		};
+
 		u32 count;
 		serializer.read(count);
+		if (count == 0) return;
+
 		m_actors.reserve(count + m_actors.size());
+		Array<RigidActor*> actors(m_allocator);
+		Array<u32> shapes_offsets(m_allocator);
+		Array<Shape> shapes(m_allocator);
+		actors.reserve(count);
+		shapes_offsets.reserve(count + 1);
 		for (u32 j = 0; j < count; ++j) {
 			EntityRef entity;
 			serializer.read(entity);
@@ -3805,46 +4217,89 @@ struct PhysicsSceneImpl final : public PhysicsScene
 			serializer.read(actor->is_trigger);
 			if (actor->dynamic_type == DynamicType::DYNAMIC) m_dynamic_actors.push(actor);
 			m_actors.insert(actor->entity, actor);
+			actors.push(actor);
 			actor->layer = 0;
 			serializer.read(actor->layer);
 
-			PxTransform transform = toPhysx(m_universe.getTransform(actor->entity).getRigidPart());
-			PxRigidActor* physx_actor = actor->dynamic_type == DynamicType::STATIC
-				? (PxRigidActor*)m_system->getPhysics()->createRigidStatic(transform)
-				: (PxRigidActor*)m_system->getPhysics()->createRigidDynamic(transform);
+			shapes_offsets.push(shapes.size());
 			int geoms_count = serializer.read<int>();
 			for (int i = 0; i < geoms_count; ++i)
 			{
-				int type = serializer.read<int>();
-				int index = serializer.read<int>();
-				PxTransform tr = toPhysx(serializer.read<RigidTransform>());
-				PxShape* shape = nullptr;
-				switch (type)
+				Shape& shape = shapes.emplace();
+				shape.type = serializer.read<int>();
+				shape.index = serializer.read<int>();
+				shape.local_pose = toPhysx(serializer.read<RigidTransform>());
+				switch (shape.type)
 				{
 				case PxGeometryType::eBOX:
-				{
-					PxBoxGeometry box_geom;
-					serializer.read(box_geom.halfExtents.x);
-					serializer.read(box_geom.halfExtents.y);
-					serializer.read(box_geom.halfExtents.z);
-
-					shape = PxRigidActorExt::createExclusiveShape(*physx_actor, box_geom, *m_default_material);
-					shape->setLocalPose(tr);
-				}
-				break;
+					serializer.read(shape.half_extents.x);
+					serializer.read(shape.half_extents.y);
+					serializer.read(shape.half_extents.z);
+					break;
 				case PxGeometryType::eSPHERE:
-				{
-					PxSphereGeometry geom;
-					serializer.read(geom.radius);
-					shape = PxRigidActorExt::createExclusiveShape(*physx_actor, geom, *m_default_material);
-					shape->setLocalPose(tr);
-				}
-				break;
+					serializer.read(shape.radius);
+					break;
 				default: ASSERT(false); break;
 				}
-				if (shape) shape->userData = (void*)(intptr_t)index;
 			}
-			actor->setPhysxActor(physx_actor);
+		}
+		shapes_offsets.push(shapes.size());
+
+		// PxPhysics object creation is thread safe and the actors are not in the scene yet,
+		// so they are created concurrently and added to the scene in one call
+		Array<PxActor*> physx_actors(m_allocator);
+		physx_actors.resize(count);
+		constexpr u32 ACTORS_PER_JOB = 64;
+		JobSystem::forEach((count + ACTORS_PER_JOB - 1) / ACTORS_PER_JOB, [&](int job_idx){
+			PROFILE_BLOCK("create actors");
+			PxPhysics& physics = *m_system->getPhysics();
+			for (u32 j = job_idx * ACTORS_PER_JOB, end = minimum(count, j + ACTORS_PER_JOB); j < end; ++j) {
+				RigidActor* actor = actors[j];
+				PxFilterData filter_data;
+				filter_data.word0 = 1 << actor->layer;
+				filter_data.word1 = m_collision_filter[actor->layer];
+				const PxTransform transform = toPhysx(m_universe.getTransform(actor->entity).getRigidPart());
+				PxRigidActor* physx_actor;
+				if (actor->dynamic_type == DynamicType::STATIC) {
+					physx_actor = physics.createRigidStatic(transform);
+				}
+				else {
+					PxRigidDynamic* dynamic = physics.createRigidDynamic(transform);
+					if (actor->dynamic_type == DynamicType::KINEMATIC) dynamic->setRigidBodyFlag(PxRigidBodyFlag::eKINEMATIC, true);
+					physx_actor = dynamic;
+				}
+
+				for (u32 i = shapes_offsets[j], end_shape = shapes_offsets[j + 1]; i < end_shape; ++i) {
+					const Shape& shape = shapes[i];
+					PxShape* px_shape = nullptr;
+					switch (shape.type) {
+						case PxGeometryType::eBOX:
+							px_shape = PxRigidActorExt::createExclusiveShape(*physx_actor, PxBoxGeometry(shape.half_extents), *m_default_material);
+							break;
+						case PxGeometryType::eSPHERE:
+							px_shape = PxRigidActorExt::createExclusiveShape(*physx_actor, PxSphereGeometry(shape.radius), *m_default_material);
+							break;
+						default: ASSERT(false); break;
+					}
+					if (!px_shape) continue;
+					px_shape->setLocalPose(shape.local_pose);
+					px_shape->userData = (void*)(intptr_t)shape.index;
+					px_shape->setSimulationFilterData(filter_data);
+					if (actor->is_trigger && i == shapes_offsets[j]) {
+						px_shape->setFlag(PxShapeFlag::eSIMULATION_SHAPE, false); // must set false first
+						px_shape->setFlag(PxShapeFlag::eTRIGGER_SHAPE, true);
+					}
+				}
+				physx_actor->userData = (void*)(intptr_t)actor->entity.index;
+				actor->physx_actor = physx_actor;
+				actor->prev_pose = transform;
+				physx_actors[j] = physx_actor;
+			}
+		});
+
+		m_scene->addActors(physx_actors.begin(), count);
+
+		for (RigidActor* actor : actors) {
 			m_universe.onComponentCreated(actor->entity, RIGID_ACTOR_TYPE, this);
 		}
 	}
@@ -4100,6 +4555,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 
 		auto* physx_actor = static_cast<PxRigidDynamic*>(actor->physx_actor);
 		if (!physx_actor) return Vec3::ZERO;
+		if (actor->lod == ActorLOD::FROZEN) return fromPhysx(actor->lod_linear_velocity);
 		return fromPhysx(physx_actor->getLinearVelocity());
 	}
 
@@ -4115,6 +4571,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 
 		auto* physx_actor = static_cast<PxRigidDynamic*>(actor->physx_actor);
 		if (!physx_actor) return 0;
+		if (actor->lod == ActorLOD::FROZEN) return actor->lod_linear_velocity.magnitude();
 		return physx_actor->getLinearVelocity().magnitude();
 	}
 
@@ -4151,6 +4608,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 
 		auto* physx_actor = static_cast<PxRigidDynamic*>(actor->physx_actor);
 		if (!physx_actor) return;
+		restoreActorLOD(*actor);
 		physx_actor->addForce(toPhysx(force));
 	}
 
@@ -4169,6 +4627,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 
 		auto* physx_actor = static_cast<PxRigidDynamic*>(actor->physx_actor);
 		if (!physx_actor) return;
+		restoreActorLOD(*actor);
 		physx_actor->addForce(toPhysx(impulse), PxForceMode::eIMPULSE);
 	}
 
@@ -4274,9 +4733,16 @@ struct PhysicsSceneImpl final : public PhysicsScene
 	HashMap<EntityRef, Vehicle> m_vehicles;
 	HashMap<EntityRef, Wheel> m_wheels;
 	PxVehicleDrivableSurfaceToTireFrictionPairs* m_vehicle_frictions;
-	PxBatchQuery* m_vehicle_batch_query;
-	u8 m_vehicle_query_mem[sizeof(PxRaycastQueryResult) * 64 + sizeof(PxRaycastHit) * 64];
-	PxRaycastQueryResult* m_vehicle_results;
+	Array<VehicleBatch*> m_vehicle_batches;
+	u32 m_vehicle_frame = 0;
+	float m_vehicle_lod_distance = 100;
+	Array<EntityRef> m_observers;
+	HashMap<u64, double> m_actor_lod_regions;
+	u32 m_actor_lod_offset = 0;
+	float m_actor_sleep_distance = 150;
+	float m_actor_freeze_distance = 300;
+	float m_fixed_timestep = 0;
+	float m_time_accumulator = 0;
 	u64 m_physics_cmps_mask;
 
 	Array<RigidActor*> m_dynamic_actors;
@@ -4284,6 +4750,8 @@ struct PhysicsSceneImpl final : public PhysicsScene
 	DelegateList<void(const ContactData&)> m_contact_callbacks;
 	bool m_is_game_running;
 	bool m_is_updating_ragdoll;
+	bool m_is_updating_controllers;
+	bool m_parallel_controllers;
 	u32 m_debug_visualization_flags;
 	u32 m_collision_filter[32];
 	char m_layers_names[32][30];
@@ -4312,14 +4780,14 @@ PhysicsScene* PhysicsScene::create(PhysicsSystem& system, Universe& context, Eng
 		return nullptr;
 	}
 
-	impl->m_controller_manager = PxCreateControllerManager(*impl->m_scene);
+	// controllers are moved from job workers, see updateControllersParallel
+	impl->m_controller_manager = PxCreateControllerManager(*impl->m_scene, true);
 
 	impl->m_system = &system;
 	impl->m_default_material = impl->m_system->getPhysics()->createMaterial(0.5f, 0.5f, 0.1f);
 	PxSphereGeometry geom(1);
 	impl->m_dummy_actor =
 		PxCreateDynamic(impl->m_scene->getPhysics(), PxTransform(PxIdentity), geom, *impl->m_default_material, 1);
-	impl->m_vehicle_batch_query = impl->createVehicleBatchQuery(impl->m_vehicle_query_mem);
 	return impl;
 }
 
@@ -4377,8 +4845,10 @@ void PhysicsSceneImpl::RigidActor::setPhysxActor(PxRigidActor* actor)
 		physx_actor->release();
 	}
 	physx_actor = actor;
+	lod = ActorLOD::ACTIVE;
 	if (actor)
 	{
+		prev_pose = actor->getGlobalPose();
 		scene.m_scene->addActor(*actor);
 		actor->userData = (void*)(intptr_t)entity.index;
 		scene.updateFilterData(actor, layer);
@@ -4450,6 +4920,9 @@ void PhysicsScene::registerLuaAPI(lua_State* L)
 	REGISTER_FUNCTION(isControllerCollisionDown);
 	REGISTER_FUNCTION(setRagdollKinematic);
 	REGISTER_FUNCTION(addForceAtPos);
+	REGISTER_FUNCTION(addObserver);
+	REGISTER_FUNCTION(removeObserver);
+	REGISTER_FUNCTION(setFixedTimestep);
 
 	LuaWrapper::createSystemFunction(L, "Physics", "raycast", &PhysicsSceneImpl::LUA_raycast);
 
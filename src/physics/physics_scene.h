@@ -94,6 +94,8 @@ public:
 	virtual EntityPtr raycast(const Vec3& origin, const Vec3& dir, EntityPtr ignore_entity) = 0;
 	virtual bool raycastEx(const Vec3& origin, const Vec3& dir, float distance, RaycastHit& result, EntityPtr ignored, int layer) = 0;
 	virtual PhysicsSystem& getSystem() const = 0;
+	virtual float getFixedTimestep() const = 0;
+	virtual void setFixedTimestep(float timestep) = 0;
 
 	virtual DelegateList<void(const ContactData&)>& onContact() = 0;
 	virtual void setActorLayer(EntityRef entity, u32 layer) = 0;
@@ -186,6 +188,10 @@ public:
 	virtual Vec3 getActorVelocity(EntityRef entity) = 0;
 	virtual float getActorSpeed(EntityRef entity) = 0;
 	virtual void putToSleep(EntityRef entity) = 0;
+	virtual float getActorSleepDistance() const = 0;
+	virtual void setActorSleepDistance(float distance) = 0;
+	virtual float getActorFreezeDistance() const = 0;
+	virtual void setActorFreezeDistance(float distance) = 0;
 
 	virtual bool isControllerCollisionDown(EntityRef entity) const = 0;
 	virtual void moveController(EntityRef entity, const Vec3& v) = 0;
@@ -201,6 +207,8 @@ public:
 	virtual void setControllerCustomGravityAcceleration(EntityRef entity, float gravityacceleration) = 0;
 	virtual bool isControllerTouchingDown(EntityRef entity) = 0;
 	virtual void resizeController(EntityRef entity, float height) = 0;
+	virtual void enableParallelControllers(bool enable) = 0;
+	virtual bool isParallelControllersEnabled() const = 0;
 
 	virtual void addBoxGeometry(EntityRef entity, int index) = 0;
 	virtual void removeBoxGeometry(EntityRef entity, int index) = 0;
@@ -257,6 +265,11 @@ public:
 	virtual void setWheelMOI(EntityRef entity, float moi) = 0;
 	virtual WheelSlot getWheelSlot(EntityRef entity) = 0;
 	virtual void setWheelSlot(EntityRef entity, WheelSlot s) = 0;
+	virtual float getVehicleLODDistance() const = 0;
+	virtual void setVehicleLODDistance(float distance) = 0;
+
+	virtual void addObserver(EntityRef entity) = 0;
+	virtual void removeObserver(EntityRef entity) = 0;
 
 	virtual const char* getCollisionLayerName(int index) = 0;
 	virtual void setCollisionLayerName(int index, const char* name) = 0;